@@ -0,0 +1,33 @@
+#include <stdio.h>
+
+#include "bench_util.h"
+
+int compare_ll(const void *a, const void *b)
+{
+    long long x = *(const long long *)a;
+    long long y = *(const long long *)b;
+    return (x > y) - (x < y);
+}
+
+int compare_double(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+void print_percentiles_header(int width, const char *name)
+{
+    printf("%-*s %-5s %10s %8s %8s %8s %8s %10s\n", width, name, "op", "count", "p50", "p99", "p99.9", "p99.99", "max");
+}
+
+void print_percentiles(int width, const char *name, const char *op, long long *lat, size_t n)
+{
+    if (n == 0)
+    {
+        return;
+    }
+    qsort(lat, n, sizeof(long long), compare_ll);
+    printf("%-*s %-5s %10zu %8lld %8lld %8lld %8lld %10lld\n", width, name, op, n,
+           lat[n / 2], lat[(size_t)(n * 0.99)], lat[(size_t)(n * 0.999)], lat[(size_t)(n * 0.9999)], lat[n - 1]);
+}
@@ -0,0 +1,30 @@
+#ifndef _BENCH_UTIL_H_
+#define _BENCH_UTIL_H_
+
+#include <stdlib.h>
+#include <time.h>
+
+/*
+ * Helpers shared by the benchmarks: the clock of the measurements, and the percentiles
+ * of the latencies of the operations.
+ */
+
+/* Monotonic time in ns (inline: called around each timed operation) */
+static inline long long now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/* Comparison functions of qsort */
+int compare_ll(const void *a, const void *b);
+int compare_double(const void *a, const void *b);
+
+/* Prints the header of the lines of print_percentiles, the first column being width characters wide */
+void print_percentiles_header(int width, const char *name);
+
+/* Sorts the n latencies and prints their count, p50, p99, p99.9, p99.99 and maximum (nothing if n is 0) */
+void print_percentiles(int width, const char *name, const char *op, long long *lat, size_t n);
+
+#endif /* !_BENCH_UTIL_H_ */
@@ -0,0 +1,190 @@
+/*
+ * Huge pages: dTLB misses and throughput of a large standard pool.
+ *
+ * For each huge page mode of my_mmap (none, transparent huge pages, hugetlb),
+ * a standard pool of heap_size bytes (a single segment) is filled with blocks
+ * of random sizes, then the blocks are read in a random order. The time of
+ * both phases is reported, with the number of dTLB load misses of the random
+ * reads (when the perf events are available) and the amount of memory that was
+ * actually backed by huge pages.
+ *
+ * usage: huge_pages [-m heap_size_in_MB] [-n nb_reads] [-s seed]
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../mem_alloc_types.h"
+#include "../mem_alloc_standard_pool.h"
+#include "../mem_alloc_page_map.h"
+#include "../my_mmap.h"
+#include "perf_counters.h"
+#include "bench_util.h"
+
+#define MIN_SIZE 64
+#define MAX_SIZE 4096
+
+static const struct
+{
+    int mode;
+    const char *name;
+} modes[] = {
+    {HUGE_PAGES_NONE, "none"},
+    {HUGE_PAGES_THP, "THP"},
+    {HUGE_PAGES_HUGETLB, "hugetlb"}};
+
+#define NB_MODES (sizeof(modes) / sizeof(modes[0]))
+
+/* Returns the amount of memory (in kB) of the process backed by huge pages (transparent or hugetlb) */
+static long huge_pages_kb(void)
+{
+    FILE *f = fopen("/proc/self/smaps_rollup", "r");
+    char line[256];
+    long total = 0;
+    long kb;
+
+    if (f == NULL)
+    {
+        return -1;
+    }
+    while (fgets(line, sizeof(line), f) != NULL)
+    {
+        if (sscanf(line, "AnonHugePages: %ld kB", &kb) == 1 || sscanf(line, "Private_Hugetlb: %ld kB", &kb) == 1)
+        {
+            total += kb;
+        }
+    }
+    fclose(f);
+    return total;
+}
+
+int main(int argc, char *argv[])
+{
+    size_t heap_size = 512UL << 20;
+    size_t nb_reads = 20000000;
+    unsigned int seed0 = 42;
+    size_t max_blocks;
+    void **blocks;
+    size_t m;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "m:n:s:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'm':
+            heap_size = strtoul(optarg, NULL, 10) << 20;
+            break;
+        case 'n':
+            nb_reads = strtoul(optarg, NULL, 10);
+            break;
+        case 's':
+            seed0 = strtoul(optarg, NULL, 10);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-m heap_size_in_MB] [-n nb_reads] [-s seed]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    max_blocks = heap_size / MIN_SIZE;
+    blocks = malloc(max_blocks * sizeof(void *));
+    if (blocks == NULL || heap_size == 0)
+    {
+        fprintf(stderr, "Invalid parameters\n");
+        return EXIT_FAILURE;
+    }
+
+    printf("heap of %zu MB, blocks of %d..%d bytes, %zu random reads\n", heap_size >> 20, MIN_SIZE, MAX_SIZE, nb_reads);
+    printf("%-8s %10s %12s %12s %14s %12s\n", "mode", "blocks", "fill (ms)", "reads (ms)", "dTLB misses", "huge (MB)");
+
+    for (m = 0; m < NB_MODES; m++)
+    {
+        mem_pool_t pool;
+        mem_std_segment_t *segment;
+        unsigned int seed = seed0;
+        size_t nb_blocks = 0;
+        long long fill_time;
+        long long read_time;
+        perf_counters_t counters;
+        double misses = -1.0;
+        long huge_kb;
+        volatile uint64_t sum = 0;
+        size_t i;
+
+        memset(&pool, 0, sizeof(pool));
+        pool.pool_id = 3;
+        pool.pool_type = STANDARD_POOL;
+        my_mmap_huge_pages = modes[m].mode;
+        init_standard_pool(&pool, heap_size, MIN_SIZE, SIZE_MAX);
+        if (pool.segments == NULL)
+        {
+            fprintf(stderr, "%s: mapping failed\n", modes[m].name);
+            return EXIT_FAILURE;
+        }
+
+        // Fill the pool (the blocks are written, so that their pages are allocated)
+        fill_time = now_ns();
+        while (nb_blocks < max_blocks)
+        {
+            size_t size = MIN_SIZE + (size_t)rand_r(&seed) % (MAX_SIZE - MIN_SIZE + 1);
+            void *b = mem_alloc_standard_pool(&pool, size);
+            if (b == NULL)
+            {
+                break;
+            }
+            if (((mem_std_segment_t *)pool.segments)->next != NULL)
+            {
+                // The first segment is full: the one mapped for this block is released
+                mem_free_standard_pool(&pool, b);
+                break;
+            }
+            memset(b, (int)nb_blocks, size);
+            blocks[nb_blocks++] = b;
+        }
+        fill_time = now_ns() - fill_time;
+        huge_kb = huge_pages_kb();
+
+        // Random reads
+        if (perf_counters_open_one(&counters, PERF_DTLB_MISSES) == 0)
+        {
+            perf_counters_start(&counters);
+        }
+        read_time = now_ns();
+        for (i = 0; i < nb_reads; i++)
+        {
+            sum += *(uint64_t *)blocks[(size_t)rand_r(&seed) % nb_blocks];
+        }
+        read_time = now_ns() - read_time;
+        if (counters.fds[PERF_DTLB_MISSES] >= 0)
+        {
+            perf_counters_stop(&counters);
+            misses = perf_counters_get(&counters, PERF_DTLB_MISSES);
+            perf_counters_close(&counters);
+        }
+
+        if (misses >= 0)
+        {
+            printf("%-8s %10zu %12.1f %12.1f %14.0f %12ld\n", modes[m].name, nb_blocks, fill_time / 1e6, read_time / 1e6, misses, huge_kb >> 10);
+        }
+        else
+        {
+            printf("%-8s %10zu %12.1f %12.1f %14s %12ld\n", modes[m].name, nb_blocks, fill_time / 1e6, read_time / 1e6, "n/a", huge_kb >> 10);
+        }
+
+        // Give back the memory: free the blocks, then unmap the remaining segment (in the mode it was mapped with)
+        for (i = 0; i < nb_blocks; i++)
+        {
+            mem_free_standard_pool(&pool, blocks[i]);
+        }
+        segment = (mem_std_segment_t *)pool.segments;
+        page_map_unregister(segment->start, segment->end);
+        my_munmap(segment, segment->mapped_size);
+    }
+
+    free(blocks);
+    return EXIT_SUCCESS;
+}
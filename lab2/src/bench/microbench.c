@@ -0,0 +1,425 @@
+/*
+ * Cost of the operations of each pool, measured in isolation.
+ *
+ * Each benchmark times batches of operations (clock_gettime around the whole batch,
+ * the preparation of the batch not being timed) and gives the time per operation:
+ *   fast alloc, fast free, fast alloc+free: mem_alloc_fast_pool / mem_free_fast_pool
+ *       on a fast pool of 64 bytes blocks (without thread cache)
+ *   std FF/BF/NF alloc L: mem_alloc_standard_pool of 4KB blocks, with L free blocks
+ *       (of 2KB, too small) in the address-ordered free list before the free tail
+ *   std SF/TLSF alloc L: same with the segregated policies, for reference
+ *   std free: mem_free_standard_pool of blocks whose neighbours are allocated (no
+ *       coalescing), or free (coalescing with both of them)
+ *   memory_alloc+free 64B / 4KB, fast alloc+free: the difference between the cost of
+ *       memory_alloc/memory_free (dispatch, thread cache) and the one of the pool
+ * After the warmup batches, the statistics of the time per operation (in ns) over the
+ * measured batches are reported: minimum, median, mean, standard deviation and maximum.
+ * With -p, the hardware counters (see perf_counters.h) of the timed parts of the measured
+ * batches are reported too, per operation: comparing the std alloc benchmarks of several
+ * free list lengths gives the cache and dTLB misses of the walk of the free list.
+ *
+ * usage: microbench [-n batch_size] [-r nb_batches] [-w nb_warmup_batches] [-b name] [-p]
+ *   -b: only the benchmarks whose name contains name
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../mem_alloc.h"
+#include "../mem_alloc_types.h"
+#include "../mem_alloc_fast_pool.h"
+#include "../mem_alloc_standard_pool.h"
+#include "../mem_alloc_trace.h"
+#include "perf_counters.h"
+#include "bench_util.h"
+
+/* Sizes of the blocks of the standard pool benchmarks */
+#define STD_SMALL_SIZE 2048
+#define STD_SIZE 4096
+
+/* Size of the standard pools (large enough for all the blocks of the benchmarks: no new segment) */
+#define STD_POOL_SIZE (64 << 20)
+
+/* State of the running benchmark */
+static mem_pool_t pool;
+static void **blocks;
+static size_t free_list_length;
+static std_pool_placement_policy_t policy;
+
+/* Hardware counters of the timed parts of the batches (NULL: not counted) */
+static perf_counters_t *counters = NULL;
+
+/* Starts the timed part of a batch, and returns its start time */
+static inline long long batch_start(void)
+{
+    if (counters != NULL)
+    {
+        perf_counters_start(counters);
+    }
+    return now_ns();
+}
+
+/* Ends the timed part of a batch, and returns its duration */
+static inline long long batch_end(long long start)
+{
+    long long time = now_ns() - start;
+
+    if (counters != NULL)
+    {
+        perf_counters_stop(counters);
+    }
+    return time;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Fast pool
+
+static void setup_fast(void)
+{
+    memset(&pool, 0, sizeof(pool));
+    pool.pool_id = 0;
+    pool.pool_type = FAST_POOL;
+    init_fast_pool(&pool, 64 * 1024, 1, 64);
+}
+
+static long long run_fast_alloc(size_t n)
+{
+    long long start = batch_start();
+    long long time;
+    size_t i;
+
+    for (i = 0; i < n; i++)
+    {
+        blocks[i] = mem_alloc_fast_pool(&pool, 64);
+    }
+    time = batch_end(start);
+    for (i = 0; i < n; i++)
+    {
+        mem_free_fast_pool(&pool, blocks[i]);
+    }
+    return time;
+}
+
+static long long run_fast_free(size_t n)
+{
+    long long start;
+    size_t i;
+
+    for (i = 0; i < n; i++)
+    {
+        blocks[i] = mem_alloc_fast_pool(&pool, 64);
+    }
+    start = batch_start();
+    for (i = 0; i < n; i++)
+    {
+        mem_free_fast_pool(&pool, blocks[i]);
+    }
+    return batch_end(start);
+}
+
+static long long run_fast_alloc_free(size_t n)
+{
+    long long start = batch_start();
+    size_t i;
+
+    for (i = 0; i < n; i++)
+    {
+        mem_free_fast_pool(&pool, mem_alloc_fast_pool(&pool, 64));
+    }
+    return batch_end(start);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Standard pool
+
+static void setup_std(void)
+{
+    size_t i;
+
+    memset(&pool, 0, sizeof(pool));
+    pool.pool_id = NB_FAST_POOLS;
+    pool.pool_type = STANDARD_POOL;
+    std_pool_policy = policy;
+    init_standard_pool(&pool, STD_POOL_SIZE, FAST_POOL_MAX_SIZE + 1, SIZE_MAX);
+
+    // free_list_length free blocks too small for the benchmarks, separated by allocated blocks
+    for (i = 0; i < 2 * free_list_length; i++)
+    {
+        blocks[i] = mem_alloc_standard_pool(&pool, STD_SMALL_SIZE);
+    }
+    for (i = 0; i < 2 * free_list_length; i += 2)
+    {
+        mem_free_standard_pool(&pool, blocks[i]);
+    }
+}
+
+static long long run_std_alloc(size_t n)
+{
+    long long start = batch_start();
+    long long time;
+    size_t i;
+
+    for (i = 0; i < n; i++)
+    {
+        blocks[i] = mem_alloc_standard_pool(&pool, STD_SIZE);
+    }
+    time = batch_end(start);
+    // The blocks coalesce with the free tail again
+    for (i = n; i > 0; i--)
+    {
+        mem_free_standard_pool(&pool, blocks[i - 1]);
+    }
+    return time;
+}
+
+/* Frees one block out of two: the neighbours of the freed blocks are allocated */
+static long long run_std_free(size_t n)
+{
+    long long start;
+    long long time;
+    size_t i;
+
+    for (i = 0; i < 2 * n + 1; i++)
+    {
+        blocks[i] = mem_alloc_standard_pool(&pool, STD_SIZE);
+    }
+    start = batch_start();
+    for (i = 1; i < 2 * n + 1; i += 2)
+    {
+        mem_free_standard_pool(&pool, blocks[i]);
+    }
+    time = batch_end(start);
+    for (i = 0; i < 2 * n + 1; i += 2)
+    {
+        mem_free_standard_pool(&pool, blocks[i]);
+    }
+    return time;
+}
+
+/* Frees the middle block of triples whose first and last blocks are free */
+static long long run_std_free_coalesce(size_t n)
+{
+    long long start;
+    long long time;
+    size_t i;
+
+    for (i = 0; i < 3 * n + 1; i++)
+    {
+        blocks[i] = mem_alloc_standard_pool(&pool, STD_SIZE);
+    }
+    for (i = 0; i < 3 * n; i += 3)
+    {
+        mem_free_standard_pool(&pool, blocks[i]);
+        mem_free_standard_pool(&pool, blocks[i + 2]);
+    }
+    start = batch_start();
+    for (i = 1; i < 3 * n; i += 3)
+    {
+        mem_free_standard_pool(&pool, blocks[i]);
+    }
+    time = batch_end(start);
+    mem_free_standard_pool(&pool, blocks[3 * n]);
+    return time;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// memory_alloc
+
+static void setup_memory(void)
+{
+    static int initialized = 0;
+
+    if (!initialized)
+    {
+        trace_mode = TRACE_NONE; // The traces can still be enabled by MEMALLOC_CONF
+        memory_init();
+        initialized = 1;
+    }
+}
+
+static long long run_memory_alloc_free_64(size_t n)
+{
+    long long start = batch_start();
+    size_t i;
+
+    for (i = 0; i < n; i++)
+    {
+        memory_free(memory_alloc(64));
+    }
+    return batch_end(start);
+}
+
+static long long run_memory_alloc_free_4k(size_t n)
+{
+    long long start = batch_start();
+    size_t i;
+
+    for (i = 0; i < n; i++)
+    {
+        memory_free(memory_alloc(STD_SIZE));
+    }
+    return batch_end(start);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+typedef struct
+{
+    char name[32];
+    void (*setup)(void);
+    long long (*run)(size_t n); /* time of n operations, in ns */
+    std_pool_placement_policy_t policy;
+    size_t free_list_length;
+} microbench_t;
+
+static const size_t free_list_lengths[] = {0, 16, 128, 1024};
+
+#define NB_FREE_LIST_LENGTHS (sizeof(free_list_lengths) / sizeof(free_list_lengths[0]))
+
+#define MAX_BENCHMARKS 64
+
+static void run_benchmark(const microbench_t *b, size_t batch, size_t nb_batches, size_t nb_warmup, double *ns_per_op)
+{
+    double sum = 0.0;
+    double sq = 0.0;
+    double mean;
+    size_t i;
+
+    policy = b->policy;
+    free_list_length = b->free_list_length;
+    b->setup();
+    for (i = 0; i < nb_warmup; i++)
+    {
+        b->run(batch);
+    }
+    if (counters != NULL)
+    {
+        perf_counters_clear(counters);
+    }
+    for (i = 0; i < nb_batches; i++)
+    {
+        ns_per_op[i] = (double)b->run(batch) / batch;
+        sum += ns_per_op[i];
+    }
+    mean = sum / nb_batches;
+    for (i = 0; i < nb_batches; i++)
+    {
+        sq += (ns_per_op[i] - mean) * (ns_per_op[i] - mean);
+    }
+    qsort(ns_per_op, nb_batches, sizeof(double), compare_double);
+    printf("%-24s %9.1f %9.1f %9.1f %9.1f %9.1f\n", b->name, ns_per_op[0], ns_per_op[nb_batches / 2], mean,
+           sqrt(sq / nb_batches), ns_per_op[nb_batches - 1]);
+    if (counters != NULL)
+    {
+        printf("%-24s", "");
+        perf_counters_print(counters, (double)batch * nb_batches);
+    }
+    fflush(stdout);
+}
+
+/* Builds the list of the benchmarks; returns their number */
+static size_t list_benchmarks(microbench_t *list)
+{
+    static const struct
+    {
+        std_pool_placement_policy_t policy;
+        const char *name;
+    } policies[] = {{FIRST_FIT, "FF"}, {BEST_FIT, "BF"}, {NEXT_FIT, "NF"}, {SEGREGATED_FIT, "SF"}, {TLSF, "TLSF"}};
+    size_t n = 0;
+    size_t p;
+    size_t l;
+
+    list[n++] = (microbench_t){"fast alloc", setup_fast, run_fast_alloc, FIRST_FIT, 0};
+    list[n++] = (microbench_t){"fast free", setup_fast, run_fast_free, FIRST_FIT, 0};
+    list[n++] = (microbench_t){"fast alloc+free", setup_fast, run_fast_alloc_free, FIRST_FIT, 0};
+    for (p = 0; p < sizeof(policies) / sizeof(policies[0]); p++)
+    {
+        for (l = 0; l < NB_FREE_LIST_LENGTHS; l++)
+        {
+            list[n] = (microbench_t){"", setup_std, run_std_alloc, policies[p].policy, free_list_lengths[l]};
+            snprintf(list[n].name, sizeof(list[n].name), "std %s alloc %zu", policies[p].name, free_list_lengths[l]);
+            n++;
+        }
+    }
+    list[n++] = (microbench_t){"std free", setup_std, run_std_free, FIRST_FIT, 0};
+    list[n++] = (microbench_t){"std free coalescing", setup_std, run_std_free_coalesce, FIRST_FIT, 0};
+    list[n++] = (microbench_t){"memory_alloc+free 64B", setup_memory, run_memory_alloc_free_64, FIRST_FIT, 0};
+    list[n++] = (microbench_t){"memory_alloc+free 4KB", setup_memory, run_memory_alloc_free_4k, FIRST_FIT, 0};
+    return n;
+}
+
+int main(int argc, char *argv[])
+{
+    microbench_t list[MAX_BENCHMARKS];
+    size_t batch = 1000;
+    size_t nb_batches = 200;
+    size_t nb_warmup = 20;
+    const char *filter = NULL;
+    perf_counters_t perf;
+    double *ns_per_op;
+    size_t nb;
+    size_t i;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:r:w:b:p")) != -1)
+    {
+        switch (opt)
+        {
+        case 'n':
+            batch = strtoul(optarg, NULL, 10);
+            break;
+        case 'r':
+            nb_batches = strtoul(optarg, NULL, 10);
+            break;
+        case 'w':
+            nb_warmup = strtoul(optarg, NULL, 10);
+            break;
+        case 'b':
+            filter = optarg;
+            break;
+        case 'p':
+            counters = &perf;
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-n batch_size] [-r nb_batches] [-w nb_warmup_batches] [-b name] [-p]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    // The standard pool benchmarks use up to 3 blocks per operation, plus the free list
+    blocks = malloc((3 * batch + 2 * free_list_lengths[NB_FREE_LIST_LENGTHS - 1] + 1) * sizeof(void *));
+    ns_per_op = malloc(nb_batches * sizeof(double));
+    if (blocks == NULL || ns_per_op == NULL || batch == 0 || nb_batches == 0 || (size_t)STD_SIZE * 3 * batch > STD_POOL_SIZE / 2)
+    {
+        fprintf(stderr, "Invalid parameters\n");
+        return EXIT_FAILURE;
+    }
+
+    if (counters != NULL && perf_counters_open(counters) == 0)
+    {
+        fprintf(stderr, "No hardware counter available (see /proc/sys/kernel/perf_event_paranoid)\n");
+        counters = NULL;
+    }
+
+    printf("%zu operations per batch, %zu batches (after %zu warmup batches), ns per operation\n", batch, nb_batches, nb_warmup);
+    printf("%-24s %9s %9s %9s %9s %9s\n", "benchmark", "min", "median", "mean", "stddev", "max");
+    nb = list_benchmarks(list);
+    for (i = 0; i < nb; i++)
+    {
+        if (filter == NULL || strstr(list[i].name, filter) != NULL)
+        {
+            run_benchmark(&(list[i]), batch, nb_batches, nb_warmup, ns_per_op);
+        }
+    }
+
+    if (counters != NULL)
+    {
+        perf_counters_close(counters);
+    }
+    free(blocks);
+    free(ns_per_op);
+    return EXIT_SUCCESS;
+}
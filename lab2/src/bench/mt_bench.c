@@ -0,0 +1,555 @@
+/*
+ * Multithreaded benchmarks of malloc/free: our allocator (preloaded shared library)
+ * against the malloc of the C library.
+ *
+ * Workloads (each thread runs for a fixed duration, an operation is a malloc or a free):
+ *   larson:   server simulation: each thread replaces random blocks (16..512 bytes) of a
+ *             set of live blocks; after each round, it gives its set to another thread,
+ *             so the blocks are freed by other threads than the ones allocating them
+ *   threadtest: each thread allocates batches of 64 bytes blocks and frees them
+ *   prodcons: each thread allocates blocks (16..256 bytes) and passes them to the next
+ *             thread, which frees them (through a single-producer single-consumer queue)
+ *   churn:    random allocations and frees of mixed sizes (mostly small blocks, some
+ *             medium, a few huge ones) in a set of slots of each thread
+ * The thread count is swept from 1 to the number of CPUs (-t to change it). For each
+ * allocator and each thread count, the workload runs in a new process (with LD_PRELOAD
+ * set to the library for our allocator), which reports the number of operations per
+ * second and its peak RSS. The traces of our allocator are disabled (MEMALLOC_CONF).
+ *
+ * usage: mt_bench [-w workload,...] [-t max_threads] [-d duration_ms] [-l library]
+ *   the library is bin/libmalloc-bench.so by default (libmalloc.so built with the
+ *   benchmark flags, see BENCH_FLAGS in the Makefile)
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+#include <limits.h>
+#include <libgen.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/wait.h>
+
+#include "bench_util.h"
+
+#define MAX_THREADS 256
+
+/* Number of operations between two checks of the end of the run */
+#define CHECK_PERIOD 64
+
+/* larson: live blocks of a set, operations per round */
+#define LARSON_BLOCKS 1000
+#define LARSON_ROUND 10000
+
+/* threadtest: blocks per batch */
+#define THREADTEST_BATCH 1000
+#define THREADTEST_SIZE 64
+
+/* prodcons: size of the queues (a power of two) */
+#define PRODCONS_QUEUE 1024
+
+/* churn: slots of each thread */
+#define CHURN_SLOTS 4096
+
+/////////////////////////////////////////////////////////////////////////////
+// Workloads (run in the child processes)
+
+typedef struct
+{
+    int id;
+    int nb_threads;
+    unsigned int seed;
+    unsigned long nb_ops;
+} worker_t;
+
+static volatile int stop = 0;
+static pthread_barrier_t start_barrier;
+
+static inline size_t random_size(unsigned int *seed, size_t min, size_t max)
+{
+    return min + (size_t)rand_r(seed) % (max - min + 1);
+}
+
+/* Allocates a block and writes its first byte (the block is used) */
+static inline void *alloc_block(size_t size)
+{
+    char *b = malloc(size);
+    if (b == NULL)
+    {
+        fprintf(stderr, "malloc(%zu) failed\n", size);
+        exit(EXIT_FAILURE);
+    }
+    b[0] = (char)size;
+    return b;
+}
+
+/* larson: the sets of blocks not used by a thread, oldest first */
+static void **larson_sets[MAX_THREADS];
+static int larson_first = 0;
+static int larson_count = 0;
+static pthread_mutex_t larson_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void *larson(void *arg)
+{
+    worker_t *w = arg;
+    void **set = malloc(LARSON_BLOCKS * sizeof(void *));
+    int i;
+
+    for (i = 0; i < LARSON_BLOCKS; i++)
+    {
+        set[i] = alloc_block(random_size(&(w->seed), 16, 512));
+    }
+    pthread_barrier_wait(&start_barrier);
+    while (!stop)
+    {
+        for (i = 0; i < LARSON_ROUND && (i % CHECK_PERIOD != 0 || !stop); i++)
+        {
+            int k = rand_r(&(w->seed)) % LARSON_BLOCKS;
+            free(set[k]);
+            set[k] = alloc_block(random_size(&(w->seed), 16, 512));
+        }
+        w->nb_ops += 2 * (unsigned long)i;
+
+        // Take the set left for the longest time by another thread, and leave this one
+        pthread_mutex_lock(&larson_lock);
+        if (larson_count > 0)
+        {
+            void **other = larson_sets[larson_first];
+            larson_sets[(larson_first + larson_count) % w->nb_threads] = set;
+            larson_first = (larson_first + 1) % w->nb_threads;
+            set = other;
+        }
+        else if (w->nb_threads > 1)
+        {
+            // The first round: the set is left without taking another one
+            larson_sets[(larson_first + larson_count) % w->nb_threads] = set;
+            larson_count++;
+            pthread_mutex_unlock(&larson_lock);
+            set = malloc(LARSON_BLOCKS * sizeof(void *));
+            for (i = 0; i < LARSON_BLOCKS; i++)
+            {
+                set[i] = alloc_block(random_size(&(w->seed), 16, 512));
+            }
+            w->nb_ops += LARSON_BLOCKS;
+            continue;
+        }
+        pthread_mutex_unlock(&larson_lock);
+    }
+    return NULL;
+}
+
+static void *threadtest(void *arg)
+{
+    worker_t *w = arg;
+    void **batch = malloc(THREADTEST_BATCH * sizeof(void *));
+    int i;
+
+    pthread_barrier_wait(&start_barrier);
+    while (!stop)
+    {
+        for (i = 0; i < THREADTEST_BATCH; i++)
+        {
+            batch[i] = alloc_block(THREADTEST_SIZE);
+        }
+        for (i = 0; i < THREADTEST_BATCH; i++)
+        {
+            free(batch[i]);
+        }
+        w->nb_ops += 2 * THREADTEST_BATCH;
+    }
+    free(batch);
+    return NULL;
+}
+
+/* prodcons: queue of the blocks to free by each thread (written by the previous thread) */
+typedef struct
+{
+    void *slots[PRODCONS_QUEUE];
+    unsigned long head __attribute__((aligned(64))); /* next slot read by the consumer */
+    unsigned long tail __attribute__((aligned(64))); /* next slot written by the producer */
+} prodcons_queue_t;
+
+static prodcons_queue_t *queues;
+
+static void *prodcons(void *arg)
+{
+    worker_t *w = arg;
+    prodcons_queue_t *out = &(queues[(w->id + 1) % w->nb_threads]);
+    prodcons_queue_t *in = &(queues[w->id]);
+    unsigned long i = 0;
+
+    pthread_barrier_wait(&start_barrier);
+    while (i % CHECK_PERIOD != 0 || !stop)
+    {
+        void *b = alloc_block(random_size(&(w->seed), 16, 256));
+        unsigned long tail = out->tail;
+        unsigned long head;
+
+        if (tail - __atomic_load_n(&(out->head), __ATOMIC_ACQUIRE) < PRODCONS_QUEUE)
+        {
+            out->slots[tail % PRODCONS_QUEUE] = b;
+            __atomic_store_n(&(out->tail), tail + 1, __ATOMIC_RELEASE);
+        }
+        else
+        {
+            free(b); // The queue is full
+        }
+        i += 2;
+
+        // Free the blocks received
+        head = in->head;
+        tail = __atomic_load_n(&(in->tail), __ATOMIC_ACQUIRE);
+        while (head != tail)
+        {
+            free(in->slots[head % PRODCONS_QUEUE]);
+            head++;
+        }
+        __atomic_store_n(&(in->head), head, __ATOMIC_RELEASE);
+    }
+    w->nb_ops = i;
+    return NULL;
+}
+
+/* churn: mostly small blocks, some medium ones (above the fast pools) and a few huge ones */
+static size_t churn_size(unsigned int *seed)
+{
+    int r = rand_r(seed) % 1000;
+
+    if (r < 700)
+    {
+        return random_size(seed, 8, 1024);
+    }
+    if (r < 995)
+    {
+        return random_size(seed, 1025, 65536);
+    }
+    return random_size(seed, 1 << 20, 4 << 20);
+}
+
+static void *churn(void *arg)
+{
+    worker_t *w = arg;
+    void **slots = calloc(CHURN_SLOTS, sizeof(void *));
+    unsigned long i = 0;
+
+    pthread_barrier_wait(&start_barrier);
+    while (i % CHECK_PERIOD != 0 || !stop)
+    {
+        int k = rand_r(&(w->seed)) % CHURN_SLOTS;
+        if (slots[k] != NULL)
+        {
+            free(slots[k]);
+            slots[k] = NULL;
+        }
+        else
+        {
+            slots[k] = alloc_block(churn_size(&(w->seed)));
+        }
+        i++;
+    }
+    w->nb_ops = i;
+    return NULL;
+}
+
+static const struct
+{
+    const char *name;
+    void *(*run)(void *);
+} workloads[] = {
+    {"larson", larson},
+    {"threadtest", threadtest},
+    {"prodcons", prodcons},
+    {"churn", churn}};
+
+#define NB_WORKLOADS (sizeof(workloads) / sizeof(workloads[0]))
+
+/* Reads the peak RSS of the process (in kB, -1 if not available) */
+static long read_peak_rss(void)
+{
+    FILE *f = fopen("/proc/self/status", "r");
+    char line[256];
+    long res = -1;
+
+    if (f == NULL)
+    {
+        return -1;
+    }
+    while (fgets(line, sizeof(line), f) != NULL)
+    {
+        if (strncmp(line, "VmHWM:", 6) == 0)
+        {
+            res = strtol(line + 6, NULL, 10);
+            break;
+        }
+    }
+    fclose(f);
+    return res;
+}
+
+/* Runs a workload, and prints the number of operations, the time (in ns) and the peak RSS (in kB) */
+static int run_workload(int workload, int nb_threads, long duration_ms)
+{
+    pthread_t threads[MAX_THREADS];
+    worker_t workers[MAX_THREADS];
+    struct timespec d = {duration_ms / 1000, (duration_ms % 1000) * 1000000};
+    unsigned long nb_ops = 0;
+    long long start;
+    long long time;
+    int i;
+
+    queues = calloc(nb_threads, sizeof(prodcons_queue_t));
+    pthread_barrier_init(&start_barrier, NULL, nb_threads + 1);
+    for (i = 0; i < nb_threads; i++)
+    {
+        workers[i].id = i;
+        workers[i].nb_threads = nb_threads;
+        workers[i].seed = 42 + i;
+        workers[i].nb_ops = 0;
+        if (pthread_create(&(threads[i]), NULL, workloads[workload].run, &(workers[i])) != 0)
+        {
+            fprintf(stderr, "pthread_create failed\n");
+            return EXIT_FAILURE;
+        }
+    }
+    pthread_barrier_wait(&start_barrier);
+    start = now_ns();
+    nanosleep(&d, NULL);
+    stop = 1;
+    for (i = 0; i < nb_threads; i++)
+    {
+        pthread_join(threads[i], NULL);
+        nb_ops += workers[i].nb_ops;
+    }
+    time = now_ns() - start;
+
+    printf("%lu %lld %ld\n", nb_ops, time, read_peak_rss());
+    return EXIT_SUCCESS;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Driver
+
+typedef struct
+{
+    double mops;  /* millions of operations per second (< 0: failed) */
+    double rss_mb;
+} result_t;
+
+/* Runs a workload in a new process (preloading library if not NULL) */
+static result_t run_child(const char *self, const char *library, int workload, int nb_threads, long duration_ms)
+{
+    result_t res = {-1.0, -1.0};
+    char threads_arg[16];
+    char duration_arg[32];
+    char line[128];
+    int fds[2];
+    int status;
+    pid_t pid;
+
+    if (pipe(fds) != 0)
+    {
+        return res;
+    }
+    snprintf(threads_arg, sizeof(threads_arg), "%d", nb_threads);
+    snprintf(duration_arg, sizeof(duration_arg), "%ld", duration_ms);
+    pid = fork();
+    if (pid == 0)
+    {
+        char *conf = getenv("MEMALLOC_CONF");
+        char buf[1024];
+        int null_fd;
+
+        dup2(fds[1], STDOUT_FILENO);
+        close(fds[0]);
+        close(fds[1]);
+        if (library != NULL)
+        {
+            // The settings of the user come last (they win)
+            snprintf(buf, sizeof(buf), "trace=NONE%s%s", (conf != NULL && conf[0] != '\0') ? "," : "", (conf != NULL) ? conf : "");
+            setenv("MEMALLOC_CONF", buf, 1);
+            setenv("LD_PRELOAD", library, 1);
+            // The allocator prints a message at exit, in the middle of the table (its failures are reported as such by the parent)
+            null_fd = open("/dev/null", O_WRONLY);
+            if (null_fd >= 0)
+            {
+                dup2(null_fd, STDERR_FILENO);
+                close(null_fd);
+            }
+        }
+        else
+        {
+            unsetenv("LD_PRELOAD");
+        }
+        execl(self, self, "-c", workloads[workload].name, "-n", threads_arg, "-d", duration_arg, (char *)NULL);
+        perror("exec failed");
+        _exit(EXIT_FAILURE);
+    }
+    close(fds[1]);
+    if (pid > 0)
+    {
+        FILE *f = fdopen(fds[0], "r");
+        unsigned long nb_ops;
+        long long time;
+        long rss;
+
+        if (f != NULL && fgets(line, sizeof(line), f) != NULL && sscanf(line, "%lu %lld %ld", &nb_ops, &time, &rss) == 3 && time > 0)
+        {
+            res.mops = nb_ops * 1e3 / time;
+            res.rss_mb = (rss >= 0) ? rss / 1024.0 : -1.0;
+        }
+        if (f != NULL)
+        {
+            fclose(f);
+        }
+        else
+        {
+            close(fds[0]);
+        }
+        if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS)
+        {
+            res.mops = -1.0;
+        }
+    }
+    else
+    {
+        close(fds[0]);
+    }
+    return res;
+}
+
+static void print_result(result_t r)
+{
+    if (r.mops < 0)
+    {
+        printf(" %10s %9s", "failed", "");
+    }
+    else
+    {
+        printf(" %10.2f %9.1f", r.mops, r.rss_mb);
+    }
+}
+
+static int find_workload(const char *name, size_t len)
+{
+    size_t w;
+
+    for (w = 0; w < NB_WORKLOADS; w++)
+    {
+        if (strlen(workloads[w].name) == len && strncasecmp(name, workloads[w].name, len) == 0)
+        {
+            return (int)w;
+        }
+    }
+    return -1;
+}
+
+int main(int argc, char *argv[])
+{
+    int selected[NB_WORKLOADS] = {1, 1, 1, 1};
+    int max_threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    long duration_ms = 1000;
+    char self[PATH_MAX];
+    char library[PATH_MAX + 32] = "";
+    const char *child = NULL;
+    const char *s;
+    ssize_t len;
+    size_t w;
+    int nb_threads = 1;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "w:t:d:l:c:n:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'w':
+            memset(selected, 0, sizeof(selected));
+            for (s = optarg; s != NULL; s = strchr(s, ','), s = (s == NULL) ? NULL : s + 1)
+            {
+                int k = find_workload(s, strcspn(s, ","));
+                if (k < 0)
+                {
+                    fprintf(stderr, "Unknown workload %.*s\n", (int)strcspn(s, ","), s);
+                    return EXIT_FAILURE;
+                }
+                selected[k] = 1;
+            }
+            break;
+        case 't':
+            max_threads = atoi(optarg);
+            break;
+        case 'd':
+            duration_ms = atol(optarg);
+            break;
+        case 'l':
+            snprintf(library, sizeof(library), "%s", optarg);
+            break;
+        case 'c': // Child process: runs a single workload
+            child = optarg;
+            break;
+        case 'n':
+            nb_threads = atoi(optarg);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-w workload,...] [-t max_threads] [-d duration_ms] [-l library]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (max_threads < 1 || max_threads > MAX_THREADS || nb_threads < 1 || nb_threads > MAX_THREADS || duration_ms <= 0)
+    {
+        fprintf(stderr, "Invalid parameters (at most %d threads)\n", MAX_THREADS);
+        return EXIT_FAILURE;
+    }
+    if (child != NULL)
+    {
+        int k = find_workload(child, strlen(child));
+        return (k < 0) ? EXIT_FAILURE : run_workload(k, nb_threads, duration_ms);
+    }
+
+    // The children are new instances of this program
+    len = readlink("/proc/self/exe", self, sizeof(self) - 1);
+    if (len < 0)
+    {
+        perror("readlink /proc/self/exe");
+        return EXIT_FAILURE;
+    }
+    self[len] = '\0';
+    if (library[0] == '\0')
+    {
+        char dir[PATH_MAX];
+        snprintf(dir, sizeof(dir), "%s", self);
+        snprintf(library, sizeof(library), "%s/libmalloc-bench.so", dirname(dir));
+    }
+    if (access(library, R_OK) != 0)
+    {
+        perror(library);
+        return EXIT_FAILURE;
+    }
+
+    printf("%ld ms per run, operations per second in millions, peak RSS in MB\n", duration_ms);
+    for (w = 0; w < NB_WORKLOADS; w++)
+    {
+        if (!selected[w])
+        {
+            continue;
+        }
+        printf("\n%-10s %7s %10s %9s %10s %9s %7s\n", workloads[w].name, "threads", "glibc", "RSS", "mem_alloc", "RSS", "ratio");
+        for (nb_threads = 1; nb_threads <= max_threads; nb_threads++)
+        {
+            result_t glibc = run_child(self, NULL, (int)w, nb_threads, duration_ms);
+            result_t ours = run_child(self, library, (int)w, nb_threads, duration_ms);
+
+            printf("%-10s %7d", "", nb_threads);
+            print_result(glibc);
+            print_result(ours);
+            if (glibc.mops > 0 && ours.mops >= 0)
+            {
+                printf(" %7.2f", ours.mops / glibc.mops);
+            }
+            printf("\n");
+            fflush(stdout);
+        }
+    }
+    return EXIT_SUCCESS;
+}
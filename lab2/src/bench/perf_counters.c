@@ -0,0 +1,167 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "perf_counters.h"
+
+const char *perf_counter_names[NB_PERF_COUNTERS] = {"cycles", "instr", "L1d-miss", "LLC-miss", "dTLB-miss", "br-miss"};
+
+#define CACHE_READ_MISS(cache) ((cache) | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16))
+
+static const struct
+{
+    uint32_t type;
+    uint64_t config;
+} perf_events[NB_PERF_COUNTERS] = {
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {PERF_TYPE_HW_CACHE, CACHE_READ_MISS(PERF_COUNT_HW_CACHE_L1D)},
+    {PERF_TYPE_HW_CACHE, CACHE_READ_MISS(PERF_COUNT_HW_CACHE_LL)},
+    {PERF_TYPE_HW_CACHE, CACHE_READ_MISS(PERF_COUNT_HW_CACHE_DTLB)},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES}};
+
+/* Value read from a counter (read_format: TOTAL_TIME_ENABLED | TOTAL_TIME_RUNNING) */
+typedef struct
+{
+    uint64_t value;
+    uint64_t time_enabled;
+    uint64_t time_running;
+} perf_read_t;
+
+static int open_counter(perf_counter_t counter)
+{
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = perf_events[counter].type;
+    attr.config = perf_events[counter].config;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    attr.disabled = 1;
+    attr.inherit = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+int perf_counters_open(perf_counters_t *c)
+{
+    int nb = 0;
+    int i;
+
+    for (i = 0; i < NB_PERF_COUNTERS; i++)
+    {
+        c->fds[i] = open_counter((perf_counter_t)i);
+        c->values[i] = 0.0;
+        if (c->fds[i] >= 0)
+        {
+            nb++;
+        }
+    }
+    return nb;
+}
+
+int perf_counters_open_one(perf_counters_t *c, perf_counter_t counter)
+{
+    int i;
+
+    for (i = 0; i < NB_PERF_COUNTERS; i++)
+    {
+        c->fds[i] = -1;
+        c->values[i] = 0.0;
+    }
+    c->fds[counter] = open_counter(counter);
+    return (c->fds[counter] >= 0) ? 0 : -1;
+}
+
+void perf_counters_start(perf_counters_t *c)
+{
+    int i;
+
+    for (i = 0; i < NB_PERF_COUNTERS; i++)
+    {
+        if (c->fds[i] >= 0)
+        {
+            ioctl(c->fds[i], PERF_EVENT_IOC_RESET, 0);
+            ioctl(c->fds[i], PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+}
+
+void perf_counters_stop(perf_counters_t *c)
+{
+    perf_read_t r;
+    int i;
+
+    for (i = 0; i < NB_PERF_COUNTERS; i++)
+    {
+        if (c->fds[i] >= 0)
+        {
+            ioctl(c->fds[i], PERF_EVENT_IOC_DISABLE, 0);
+        }
+    }
+    for (i = 0; i < NB_PERF_COUNTERS; i++)
+    {
+        if (c->fds[i] >= 0 && read(c->fds[i], &r, sizeof(r)) == sizeof(r) && r.time_running > 0)
+        {
+            // Multiplexed counter: extrapolated to the whole time it was enabled
+            c->values[i] += (double)r.value * r.time_enabled / r.time_running;
+        }
+    }
+}
+
+void perf_counters_clear(perf_counters_t *c)
+{
+    int i;
+
+    for (i = 0; i < NB_PERF_COUNTERS; i++)
+    {
+        c->values[i] = 0.0;
+    }
+}
+
+double perf_counters_get(perf_counters_t *c, perf_counter_t counter)
+{
+    return (c->fds[counter] >= 0) ? c->values[counter] : -1.0;
+}
+
+void perf_counters_print(perf_counters_t *c, double nb_ops)
+{
+    int i;
+
+    for (i = 0; i < NB_PERF_COUNTERS; i++)
+    {
+        if (c->fds[i] >= 0)
+        {
+            printf(" %s %.2f", perf_counter_names[i], c->values[i] / nb_ops);
+        }
+        else
+        {
+            printf(" %s n/a", perf_counter_names[i]);
+        }
+    }
+    if (c->fds[PERF_CYCLES] >= 0 && c->fds[PERF_INSTRUCTIONS] >= 0 && c->values[PERF_CYCLES] > 0)
+    {
+        printf(" IPC %.2f", c->values[PERF_INSTRUCTIONS] / c->values[PERF_CYCLES]);
+    }
+    printf("\n");
+}
+
+void perf_counters_close(perf_counters_t *c)
+{
+    int i;
+
+    for (i = 0; i < NB_PERF_COUNTERS; i++)
+    {
+        if (c->fds[i] >= 0)
+        {
+            close(c->fds[i]);
+            c->fds[i] = -1;
+        }
+    }
+}
@@ -0,0 +1,55 @@
+#ifndef _PERF_COUNTERS_H_
+#define _PERF_COUNTERS_H_
+
+/*
+ * Hardware counters of the benchmarks (perf_event_open), counting the events of the
+ * calling thread (and of the threads it creates afterwards) in user mode.
+ * Each counter is opened on its own: the ones that are not available (no PMU, no
+ * permission, see /proc/sys/kernel/perf_event_paranoid) are reported as such, the other
+ * ones still count. When the PMU has fewer counters than opened, the kernel multiplexes
+ * them and the counts are scaled by the fraction of the time they were counting.
+ */
+typedef enum
+{
+    PERF_CYCLES,
+    PERF_INSTRUCTIONS,
+    PERF_L1D_MISSES,
+    PERF_LLC_MISSES,
+    PERF_DTLB_MISSES,
+    PERF_BRANCH_MISSES,
+    NB_PERF_COUNTERS
+} perf_counter_t;
+
+typedef struct
+{
+    int fds[NB_PERF_COUNTERS];          /* -1: not available */
+    double values[NB_PERF_COUNTERS];    /* accumulated by perf_counters_stop (scaled) */
+} perf_counters_t;
+
+/* Short names of the counters */
+extern const char *perf_counter_names[NB_PERF_COUNTERS];
+
+/* Opens the counters; returns the number of counters available */
+int perf_counters_open(perf_counters_t *c);
+
+/* Opens a single counter (the other ones are not available); returns 0 on success */
+int perf_counters_open_one(perf_counters_t *c, perf_counter_t counter);
+
+/* Counts the events from now on, until perf_counters_stop */
+void perf_counters_start(perf_counters_t *c);
+
+/* Stops counting, and adds the events counted since perf_counters_start to the values */
+void perf_counters_stop(perf_counters_t *c);
+
+/* Clears the values */
+void perf_counters_clear(perf_counters_t *c);
+
+/* Value of a counter (< 0 if not available) */
+double perf_counters_get(perf_counters_t *c, perf_counter_t counter);
+
+/* Prints the values divided by nb_ops (n/a for the counters not available), with the IPC */
+void perf_counters_print(perf_counters_t *c, double nb_ops);
+
+void perf_counters_close(perf_counters_t *c);
+
+#endif /* !_PERF_COUNTERS_H_ */
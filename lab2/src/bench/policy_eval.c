@@ -0,0 +1,482 @@
+/*
+ * Evaluation of the placement policies of the standard pool on a trace.
+ *
+ * The allocations of the trace (a mem_shell scenario or a binary trace file, see
+ * trace_load.h) served by the standard pools (FAST_POOL_MAX_SIZE < size < HUGE_THRESHOLD,
+ * or all of them with -a) and their frees are replayed through the standard pool code,
+ * with each placement policy and each initial pool size. Each configuration runs in a
+ * child process of its own (the same trace in the same order for all of them).
+ *
+ * Every interval operations (and at the end of the trace), a sample gives the state of
+ * the pool: live blocks, payload bytes in use, bytes mapped, length of the free list(s),
+ * free bytes, largest free block, external fragmentation (1 - largest free / free bytes),
+ * and the mean and maximum number of free blocks examined per allocation since the previous
+ * sample (search steps, see find_free_block). With -s, only a summary of each configuration
+ * is printed. The output is CSV (one line per sample or configuration) or JSON.
+ *
+ * usage: policy_eval [-f csv|json] [-s] [-a] [-i interval] [-P policy,...] [-p pool_size,...] trace_file
+ *   policies: FF, BF, NF, SF, TLSF (default: all of them)
+ *   pool sizes: in bytes, with an optional K, M or G suffix (default: 64K,1M,16M)
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "../mem_alloc_types.h"
+#include "../mem_alloc_standard_pool.h"
+#include "../mem_alloc_huge_pool.h"
+#include "../my_mmap.h"
+#include "trace_load.h"
+
+static const struct
+{
+    std_pool_placement_policy_t policy;
+    const char *name;
+} policies[] = {
+    {FIRST_FIT, "FF"},
+    {BEST_FIT, "BF"},
+    {NEXT_FIT, "NF"},
+    {SEGREGATED_FIT, "SF"},
+    {TLSF, "TLSF"}};
+
+#define NB_POLICIES (sizeof(policies) / sizeof(policies[0]))
+
+#define MAX_POOL_SIZES 16
+
+typedef enum
+{
+    OUTPUT_CSV,
+    OUTPUT_JSON
+} output_format_t;
+
+/* Options of the evaluation */
+typedef struct
+{
+    output_format_t format;
+    int summary_only;
+    size_t interval;
+} eval_options_t;
+
+/* State of the pool at a point of the replay */
+typedef struct
+{
+    size_t op; /* number of operations replayed */
+    size_t live_blocks;
+    uint64_t in_use_bytes;
+    uint64_t mapped_bytes;
+    size_t free_blocks;
+    size_t free_bytes;
+    size_t largest_free;
+    double ext_frag;
+    double mean_steps; /* per allocation, since the previous sample */
+    uint64_t max_steps;
+} eval_sample_t;
+
+/* Summary of a configuration */
+typedef struct
+{
+    size_t nb_allocs;
+    size_t nb_failures;
+    size_t nb_samples;
+    uint64_t total_steps;
+    uint64_t max_steps;
+    double sum_ext_frag;
+    double max_ext_frag;
+    size_t max_free_blocks;
+    uint64_t peak_mapped;
+    eval_sample_t last;
+} eval_summary_t;
+
+/* Parses a size (with an optional K, M or G suffix); returns 0 if invalid */
+static size_t parse_size(const char *s)
+{
+    char *end;
+    size_t n = strtoul(s, &end, 10);
+
+    switch (*end)
+    {
+    case 'K':
+    case 'k':
+        n <<= 10;
+        end++;
+        break;
+    case 'M':
+    case 'm':
+        n <<= 20;
+        end++;
+        break;
+    case 'G':
+    case 'g':
+        n <<= 30;
+        end++;
+        break;
+    default:
+        break;
+    }
+    return (*end == '\0' || *end == ',') ? n : 0;
+}
+
+/* Returns 1 if an allocation of the trace is replayed */
+static inline int is_replayed(const replay_op_t *op, int all_sizes)
+{
+    return all_sizes || (op->size > FAST_POOL_MAX_SIZE && op->size < HUGE_THRESHOLD);
+}
+
+/* Returns the number of operations of the trace that are replayed */
+static size_t count_replayed(const trace_t *t, int all_sizes)
+{
+    uint8_t *replayed = calloc(t->nb_handles + 1, 1);
+    size_t n = 0;
+    size_t i;
+
+    for (i = 0; i < t->nb_ops; i++)
+    {
+        const replay_op_t *op = &(t->ops[i]);
+        if (op->is_alloc ? is_replayed(op, all_sizes) : replayed[op->handle])
+        {
+            replayed[op->handle] = op->is_alloc;
+            n++;
+        }
+    }
+    free(replayed);
+    return n;
+}
+
+static void take_sample(mem_pool_t *pool, eval_sample_t *s, size_t op, size_t live_blocks, uint64_t steps, size_t nb_allocs)
+{
+    s->op = op;
+    s->live_blocks = live_blocks;
+    s->in_use_bytes = pool->counters.allocated_bytes - pool->counters.freed_bytes;
+    s->mapped_bytes = pool->counters.mapped_bytes;
+    mem_get_free_blocks_standard_pool(pool, &(s->free_blocks), &(s->largest_free), &(s->free_bytes));
+    s->ext_frag = (s->free_bytes > 0) ? 1.0 - (double)s->largest_free / s->free_bytes : 0.0;
+    s->mean_steps = (nb_allocs > 0) ? (double)steps / nb_allocs : 0.0;
+}
+
+static void print_sample(const eval_options_t *opts, const char *policy, size_t pool_size, const eval_sample_t *s, int first)
+{
+    if (opts->format == OUTPUT_CSV)
+    {
+        printf("%s,%zu,%zu,%zu,%lu,%lu,%zu,%zu,%zu,%.4f,%.2f,%lu\n", policy, pool_size, s->op, s->live_blocks,
+               (unsigned long)s->in_use_bytes, (unsigned long)s->mapped_bytes, s->free_blocks, s->free_bytes,
+               s->largest_free, s->ext_frag, s->mean_steps, (unsigned long)s->max_steps);
+    }
+    else
+    {
+        printf("%s\n        {\"op\": %zu, \"live_blocks\": %zu, \"in_use_bytes\": %lu, \"mapped_bytes\": %lu, "
+               "\"free_blocks\": %zu, \"free_bytes\": %zu, \"largest_free\": %zu, \"ext_frag\": %.4f, "
+               "\"mean_search_steps\": %.2f, \"max_search_steps\": %lu}",
+               first ? "" : ",", s->op, s->live_blocks, (unsigned long)s->in_use_bytes, (unsigned long)s->mapped_bytes,
+               s->free_blocks, s->free_bytes, s->largest_free, s->ext_frag, s->mean_steps, (unsigned long)s->max_steps);
+    }
+}
+
+static void print_summary(const eval_options_t *opts, const char *policy, size_t pool_size, const eval_summary_t *sum)
+{
+    double mean_steps = (sum->nb_allocs > 0) ? (double)sum->total_steps / sum->nb_allocs : 0.0;
+    double mean_ext_frag = (sum->nb_samples > 0) ? sum->sum_ext_frag / sum->nb_samples : 0.0;
+
+    if (opts->format == OUTPUT_CSV)
+    {
+        printf("%s,%zu,%zu,%zu,%.2f,%lu,%.4f,%.4f,%zu,%lu,%lu\n", policy, pool_size, sum->nb_allocs, sum->nb_failures,
+               mean_steps, (unsigned long)sum->max_steps, mean_ext_frag, sum->max_ext_frag, sum->max_free_blocks,
+               (unsigned long)sum->peak_mapped, (unsigned long)sum->last.mapped_bytes);
+    }
+    else
+    {
+        printf("      \"summary\": {\"allocs\": %zu, \"failures\": %zu, \"mean_search_steps\": %.2f, \"max_search_steps\": %lu, "
+               "\"mean_ext_frag\": %.4f, \"max_ext_frag\": %.4f, \"max_free_blocks\": %zu, \"peak_mapped_bytes\": %lu, "
+               "\"final_mapped_bytes\": %lu}\n",
+               sum->nb_allocs, sum->nb_failures, mean_steps, (unsigned long)sum->max_steps, mean_ext_frag,
+               sum->max_ext_frag, sum->max_free_blocks, (unsigned long)sum->peak_mapped, (unsigned long)sum->last.mapped_bytes);
+    }
+}
+
+static void add_sample(eval_summary_t *sum, const eval_sample_t *s)
+{
+    sum->nb_samples++;
+    sum->sum_ext_frag += s->ext_frag;
+    if (s->ext_frag > sum->max_ext_frag)
+    {
+        sum->max_ext_frag = s->ext_frag;
+    }
+    if (s->free_blocks > sum->max_free_blocks)
+    {
+        sum->max_free_blocks = s->free_blocks;
+    }
+    sum->last = *s;
+}
+
+/* Replays the trace with a configuration, and prints its samples and summary */
+static void run_config(const eval_options_t *opts, const trace_t *t, int all_sizes, int p, size_t pool_size)
+{
+    void **handles = calloc(t->nb_handles + 1, sizeof(void *));
+    eval_summary_t sum;
+    eval_sample_t s;
+    mem_pool_t pool;
+    uint64_t interval_steps = 0;
+    size_t interval_allocs = 0;
+    size_t live_blocks = 0;
+    size_t nb_ops = 0;
+    size_t i;
+
+    memset(&sum, 0, sizeof(sum));
+    memset(&s, 0, sizeof(s));
+    memset(&pool, 0, sizeof(pool));
+    pool.pool_id = NB_FAST_POOLS;
+    pool.pool_type = STANDARD_POOL;
+    std_pool_policy = policies[p].policy;
+    init_standard_pool(&pool, pool_size, FAST_POOL_MAX_SIZE + 1, HUGE_THRESHOLD - 1);
+    if (handles == NULL || pool.start_addr == NULL)
+    {
+        fprintf(stderr, "%s, %zu: initialization failed\n", policies[p].name, pool_size);
+        exit(EXIT_FAILURE);
+    }
+
+    if (opts->format == OUTPUT_JSON)
+    {
+        printf("    {\n      \"policy\": \"%s\",\n      \"pool_size\": %zu,\n", policies[p].name, pool_size);
+        if (!opts->summary_only)
+        {
+            printf("      \"samples\": [");
+        }
+    }
+
+    for (i = 0; i < t->nb_ops; i++)
+    {
+        const replay_op_t *op = &(t->ops[i]);
+
+        if (op->is_alloc)
+        {
+            uint64_t steps = pool.counters.search_steps;
+
+            if (!is_replayed(op, all_sizes))
+            {
+                continue;
+            }
+            handles[op->handle] = mem_alloc_standard_pool(&pool, op->size);
+            steps = pool.counters.search_steps - steps;
+            sum.nb_allocs++;
+            sum.total_steps += steps;
+            interval_allocs++;
+            interval_steps += steps;
+            if (steps > s.max_steps)
+            {
+                s.max_steps = steps;
+            }
+            if (steps > sum.max_steps)
+            {
+                sum.max_steps = steps;
+            }
+            if (handles[op->handle] == NULL)
+            {
+                sum.nb_failures++;
+            }
+            else
+            {
+                live_blocks++;
+            }
+        }
+        else
+        {
+            if (handles[op->handle] == NULL)
+            {
+                continue; // Not replayed (or failed)
+            }
+            mem_free_standard_pool(&pool, handles[op->handle]);
+            handles[op->handle] = NULL;
+            live_blocks--;
+        }
+        nb_ops++;
+
+        if (pool.counters.mapped_bytes > sum.peak_mapped)
+        {
+            sum.peak_mapped = pool.counters.mapped_bytes;
+        }
+        if (nb_ops % opts->interval == 0)
+        {
+            take_sample(&pool, &s, nb_ops, live_blocks, interval_steps, interval_allocs);
+            add_sample(&sum, &s);
+            if (!opts->summary_only)
+            {
+                print_sample(opts, policies[p].name, pool_size, &s, sum.nb_samples == 1);
+            }
+            interval_steps = 0;
+            interval_allocs = 0;
+            s.max_steps = 0;
+        }
+    }
+
+    // State at the end of the trace
+    if (nb_ops % opts->interval != 0 || nb_ops == 0)
+    {
+        take_sample(&pool, &s, nb_ops, live_blocks, interval_steps, interval_allocs);
+        add_sample(&sum, &s);
+        if (!opts->summary_only)
+        {
+            print_sample(opts, policies[p].name, pool_size, &s, sum.nb_samples == 1);
+        }
+    }
+
+    if (opts->format == OUTPUT_JSON && !opts->summary_only)
+    {
+        printf("\n      ],\n");
+    }
+    if (opts->summary_only || opts->format == OUTPUT_JSON)
+    {
+        print_summary(opts, policies[p].name, pool_size, &sum);
+    }
+    if (opts->format == OUTPUT_JSON)
+    {
+        printf("    }");
+    }
+    free(handles);
+}
+
+int main(int argc, char *argv[])
+{
+    eval_options_t opts = {OUTPUT_CSV, 0, 0};
+    size_t pool_sizes[MAX_POOL_SIZES] = {64 << 10, 1 << 20, 16 << 20};
+    size_t nb_pool_sizes = 3;
+    int selected[NB_POLICIES] = {1, 1, 1, 1, 1};
+    size_t nb_replayed;
+    int all_sizes = 0;
+    int first = 1;
+    const char *s;
+    trace_t t;
+    size_t p;
+    size_t k;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "f:sai:P:p:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'f':
+            if (strcasecmp(optarg, "csv") == 0)
+            {
+                opts.format = OUTPUT_CSV;
+            }
+            else if (strcasecmp(optarg, "json") == 0)
+            {
+                opts.format = OUTPUT_JSON;
+            }
+            else
+            {
+                fprintf(stderr, "Unknown output format %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 's':
+            opts.summary_only = 1;
+            break;
+        case 'a':
+            all_sizes = 1;
+            break;
+        case 'i':
+            opts.interval = strtoul(optarg, NULL, 10);
+            break;
+        case 'P':
+            memset(selected, 0, sizeof(selected));
+            for (s = optarg; s != NULL; s = strchr(s, ','), s = (s == NULL) ? NULL : s + 1)
+            {
+                size_t len = strcspn(s, ",");
+                for (p = 0; p < NB_POLICIES; p++)
+                {
+                    if (strlen(policies[p].name) == len && strncasecmp(s, policies[p].name, len) == 0)
+                    {
+                        selected[p] = 1;
+                        break;
+                    }
+                }
+                if (p == NB_POLICIES)
+                {
+                    fprintf(stderr, "Unknown policy %.*s\n", (int)len, s);
+                    return EXIT_FAILURE;
+                }
+            }
+            break;
+        case 'p':
+            nb_pool_sizes = 0;
+            for (s = optarg; s != NULL; s = strchr(s, ','), s = (s == NULL) ? NULL : s + 1)
+            {
+                if (nb_pool_sizes == MAX_POOL_SIZES || (pool_sizes[nb_pool_sizes] = parse_size(s)) < OS_BASE_PAGE_SIZE)
+                {
+                    fprintf(stderr, "Invalid pool sizes %s\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                nb_pool_sizes++;
+            }
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-f csv|json] [-s] [-a] [-i interval] [-P policy,...] [-p pool_size,...] trace_file\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (optind != argc - 1)
+    {
+        fprintf(stderr, "usage: %s [-f csv|json] [-s] [-a] [-i interval] [-P policy,...] [-p pool_size,...] trace_file\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    load_trace(argv[optind], &t);
+    nb_replayed = count_replayed(&t, all_sizes);
+    // About 100 samples per configuration by default
+    if (opts.interval == 0)
+    {
+        opts.interval = (nb_replayed >= 100) ? nb_replayed / 100 : 1;
+    }
+
+    if (opts.format == OUTPUT_CSV && opts.summary_only)
+    {
+        printf("policy,pool_size,allocs,failures,mean_search_steps,max_search_steps,mean_ext_frag,max_ext_frag,max_free_blocks,peak_mapped_bytes,final_mapped_bytes\n");
+    }
+    else if (opts.format == OUTPUT_CSV)
+    {
+        printf("policy,pool_size,op,live_blocks,in_use_bytes,mapped_bytes,free_blocks,free_bytes,largest_free,ext_frag,mean_search_steps,max_search_steps\n");
+    }
+    else
+    {
+        printf("{\n  \"trace\": \"%s\",\n  \"operations\": %zu,\n  \"replayed_operations\": %zu,\n  \"interval\": %zu,\n  \"configurations\": [\n",
+               argv[optind], t.nb_ops, nb_replayed, opts.interval);
+    }
+
+    for (p = 0; p < NB_POLICIES; p++)
+    {
+        for (k = 0; k < nb_pool_sizes && selected[p]; k++)
+        {
+            int status;
+            pid_t pid;
+
+            if (opts.format == OUTPUT_JSON && !first)
+            {
+                printf(",\n");
+            }
+            first = 0;
+            fflush(stdout);
+            // Each configuration starts from a fresh process (the pools are never unmapped)
+            pid = fork();
+            if (pid == 0)
+            {
+                run_config(&opts, &t, all_sizes, (int)p, pool_sizes[k]);
+                fflush(stdout);
+                _exit(EXIT_SUCCESS);
+            }
+            if (pid < 0 || waitpid(pid, &status, 0) != pid || !WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS)
+            {
+                fprintf(stderr, "%s, %zu: replay failed\n", policies[p].name, pool_sizes[k]);
+                return EXIT_FAILURE;
+            }
+        }
+    }
+
+    if (opts.format == OUTPUT_JSON)
+    {
+        printf("\n  ]\n}\n");
+    }
+    free_trace(&t);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,161 @@
+/*
+ * Latency of the placement policies of the standard pool.
+ *
+ * For each policy, a standard pool is first filled with a number of live blocks
+ * (random sizes, then one block out of two freed, to get a fragmented heap), then
+ * a sequence of random allocations and deallocations is replayed, each one being
+ * timed. The sequence (sizes and order) is the same for all the policies.
+ * The percentiles of the latencies (in nanoseconds) are reported.
+ *
+ * usage: std_pool_latency [-n nb_operations] [-l nb_live_blocks] [-s seed]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../mem_alloc_types.h"
+#include "../mem_alloc_standard_pool.h"
+#include "bench_util.h"
+
+#define MIN_SIZE 1025
+#define MAX_SIZE 65536
+
+static const struct
+{
+    std_pool_placement_policy_t policy;
+    const char *name;
+} policies[] = {
+    {FIRST_FIT, "FF"},
+    {BEST_FIT, "BF"},
+    {NEXT_FIT, "NF"},
+    {SEGREGATED_FIT, "SF"},
+    {TLSF, "TLSF"}};
+
+#define NB_POLICIES (sizeof(policies) / sizeof(policies[0]))
+
+/* Random size between MIN_SIZE and MAX_SIZE, small sizes being more frequent (log-uniform) */
+static size_t random_size(unsigned int *seed)
+{
+    int shift = rand_r(seed) % 7; // 1KB .. 64KB
+    size_t max = (size_t)MIN_SIZE << shift;
+    if (max > MAX_SIZE)
+    {
+        max = MAX_SIZE;
+    }
+    return MIN_SIZE + (size_t)rand_r(seed) % (max - MIN_SIZE + 1);
+}
+
+int main(int argc, char *argv[])
+{
+    size_t nb_ops = 200000;
+    size_t nb_live = 10000;
+    unsigned int seed0 = 42;
+    long long *alloc_lat;
+    long long *free_lat;
+    void **blocks;
+    size_t p;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:l:s:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'n':
+            nb_ops = strtoul(optarg, NULL, 10);
+            break;
+        case 'l':
+            nb_live = strtoul(optarg, NULL, 10);
+            break;
+        case 's':
+            seed0 = strtoul(optarg, NULL, 10);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-n nb_operations] [-l nb_live_blocks] [-s seed]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    alloc_lat = malloc(nb_ops * sizeof(long long));
+    free_lat = malloc(nb_ops * sizeof(long long));
+    blocks = malloc(nb_live * sizeof(void *));
+    if (alloc_lat == NULL || free_lat == NULL || blocks == NULL || nb_live == 0)
+    {
+        fprintf(stderr, "Invalid parameters\n");
+        return EXIT_FAILURE;
+    }
+
+    printf("%zu operations, %zu slots, sizes %d..%d bytes, latencies in ns\n", nb_ops, nb_live, MIN_SIZE, MAX_SIZE);
+    print_percentiles_header(5, "pol");
+
+    for (p = 0; p < NB_POLICIES; p++)
+    {
+        mem_pool_t pool;
+        unsigned int seed = seed0;
+        size_t nb_alloc = 0;
+        size_t nb_free = 0;
+        size_t i;
+
+        memset(&pool, 0, sizeof(pool));
+        pool.pool_id = 3;
+        pool.pool_type = STANDARD_POOL;
+        std_pool_policy = policies[p].policy;
+        init_standard_pool(&pool, MAX_SIZE * 16, MIN_SIZE, SIZE_MAX);
+
+        // Fragmented initial state
+        for (i = 0; i < nb_live; i++)
+        {
+            blocks[i] = mem_alloc_standard_pool(&pool, random_size(&seed));
+        }
+        for (i = 0; i < nb_live; i += 2)
+        {
+            mem_free_standard_pool(&pool, blocks[i]);
+            blocks[i] = NULL;
+        }
+
+        // Measured sequence: each slot is alternately allocated and freed
+        for (i = 0; i < nb_ops; i++)
+        {
+            size_t k = (size_t)rand_r(&seed) % nb_live;
+            long long start;
+            if (blocks[k] != NULL)
+            {
+                start = now_ns();
+                mem_free_standard_pool(&pool, blocks[k]);
+                free_lat[nb_free++] = now_ns() - start;
+                blocks[k] = NULL;
+            }
+            else
+            {
+                size_t size = random_size(&seed);
+                start = now_ns();
+                blocks[k] = mem_alloc_standard_pool(&pool, size);
+                alloc_lat[nb_alloc++] = now_ns() - start;
+                if (blocks[k] == NULL)
+                {
+                    fprintf(stderr, "%s: allocation failed\n", policies[p].name);
+                    return EXIT_FAILURE;
+                }
+            }
+        }
+
+        print_percentiles(5, policies[p].name, "alloc", alloc_lat, nb_alloc);
+        print_percentiles(5, policies[p].name, "free", free_lat, nb_free);
+
+        // Give back the memory (all the segments but the first one are released)
+        for (i = 0; i < nb_live; i++)
+        {
+            if (blocks[i] != NULL)
+            {
+                mem_free_standard_pool(&pool, blocks[i]);
+                blocks[i] = NULL;
+            }
+        }
+    }
+
+    free(alloc_lat);
+    free(free_lat);
+    free(blocks);
+    return EXIT_SUCCESS;
+}
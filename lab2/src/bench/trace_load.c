@@ -0,0 +1,206 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "../mem_alloc_trace.h"
+#include "trace_load.h"
+
+/* Appends an operation to the trace (the array grows by doubling) */
+static void add_op(trace_t *t, size_t *capacity, int is_alloc, uint32_t handle, size_t size)
+{
+    if (t->nb_ops == *capacity)
+    {
+        *capacity = (*capacity == 0) ? 1 << 20 : *capacity * 2;
+        t->ops = realloc(t->ops, *capacity * sizeof(replay_op_t));
+        if (t->ops == NULL)
+        {
+            fprintf(stderr, "Not enough memory to load the trace\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    t->ops[t->nb_ops].size = size;
+    t->ops[t->nb_ops].handle = handle;
+    t->ops[t->nb_ops].is_alloc = (uint8_t)is_alloc;
+    t->nb_ops++;
+    if (is_alloc)
+    {
+        t->nb_allocs++;
+    }
+}
+
+/* Loads a mem_shell scenario (the frees of blocks that are not allocated are skipped) */
+static void load_text_trace(FILE *f, trace_t *t)
+{
+    char line[128];
+    size_t capacity = 0;
+    uint8_t *live = NULL;
+    size_t live_capacity = 0;
+
+    while (fgets(line, sizeof(line), f) != NULL && line[0] != 'q')
+    {
+        if (line[0] == 'a')
+        {
+            if (t->nb_handles == live_capacity)
+            {
+                live_capacity = (live_capacity == 0) ? 1 << 20 : live_capacity * 2;
+                live = realloc(live, live_capacity);
+            }
+            live[t->nb_handles] = 1;
+            add_op(t, &capacity, 1, (uint32_t)t->nb_handles, strtoul(line + 1, NULL, 10));
+            t->nb_handles++;
+        }
+        else if (line[0] == 'f')
+        {
+            size_t index = strtoul(line + 1, NULL, 10);
+            // The blocks are numbered from 1
+            if (index >= 1 && index <= t->nb_handles && live[index - 1])
+            {
+                live[index - 1] = 0;
+                add_op(t, &capacity, 0, (uint32_t)(index - 1), 0);
+            }
+        }
+    }
+    free(live);
+}
+
+/*
+ * Live blocks of a binary trace, by pool and offset (open addressing): the value is the last
+ * handle allocated at this place (several huge blocks can be live at offset 0), the previous
+ * ones being linked by prev_handle.
+ */
+typedef struct
+{
+    uint64_t *keys; /* pool << 48 | offset, plus one (0: empty entry) */
+    uint32_t *values;
+    size_t size;    /* power of two */
+    size_t nb_keys;
+} live_map_t;
+
+#define NO_HANDLE UINT32_MAX
+
+static uint32_t *live_map_get(live_map_t *m, uint64_t key)
+{
+    size_t i = (size_t)(key * 0x9E3779B97F4A7C15ULL) & (m->size - 1);
+
+    while (m->keys[i] != 0 && m->keys[i] != key)
+    {
+        i = (i + 1) & (m->size - 1);
+    }
+    if (m->keys[i] == 0)
+    {
+        m->keys[i] = key;
+        m->values[i] = NO_HANDLE;
+        m->nb_keys++;
+    }
+    return &(m->values[i]);
+}
+
+static void live_map_grow(live_map_t *m)
+{
+    live_map_t bigger;
+    size_t i;
+
+    bigger.size = (m->size == 0) ? 1 << 16 : m->size * 2;
+    bigger.nb_keys = 0;
+    bigger.keys = calloc(bigger.size, sizeof(uint64_t));
+    bigger.values = malloc(bigger.size * sizeof(uint32_t));
+    if (bigger.keys == NULL || bigger.values == NULL)
+    {
+        fprintf(stderr, "Not enough memory to load the trace\n");
+        exit(EXIT_FAILURE);
+    }
+    for (i = 0; i < m->size; i++)
+    {
+        if (m->keys[i] != 0)
+        {
+            *live_map_get(&bigger, m->keys[i]) = m->values[i];
+        }
+    }
+    free(m->keys);
+    free(m->values);
+    *m = bigger;
+}
+
+/* Loads a binary trace file (the header has been read) */
+static void load_binary_trace(FILE *f, trace_t *t)
+{
+    mem_trace_event_t events[4096];
+    live_map_t map = {NULL, NULL, 0, 0};
+    uint32_t *prev_handle = NULL;
+    size_t prev_capacity = 0;
+    size_t capacity = 0;
+    size_t nb_events;
+    size_t i;
+
+    while ((nb_events = fread(events, sizeof(mem_trace_event_t), 4096, f)) > 0)
+    {
+        for (i = 0; i < nb_events; i++)
+        {
+            mem_trace_event_t *e = &(events[i]);
+            uint32_t *last;
+
+            if (e->op != TRACE_ALLOC && (e->op != TRACE_FREE || e->pool == TRACE_NO_POOL))
+            {
+                continue;
+            }
+            if (2 * (map.nb_keys + 1) > map.size)
+            {
+                live_map_grow(&map);
+            }
+            last = live_map_get(&map, (((uint64_t)e->pool << 48) | e->offset) + 1);
+            if (e->op == TRACE_ALLOC)
+            {
+                if (t->nb_handles == prev_capacity)
+                {
+                    prev_capacity = (prev_capacity == 0) ? 1 << 20 : prev_capacity * 2;
+                    prev_handle = realloc(prev_handle, prev_capacity * sizeof(uint32_t));
+                }
+                prev_handle[t->nb_handles] = *last;
+                *last = (uint32_t)t->nb_handles;
+                add_op(t, &capacity, 1, (uint32_t)t->nb_handles, (size_t)e->size);
+                t->nb_handles++;
+            }
+            else if (*last != NO_HANDLE)
+            {
+                add_op(t, &capacity, 0, *last, 0);
+                *last = prev_handle[*last];
+            }
+        }
+    }
+    free(map.keys);
+    free(map.values);
+    free(prev_handle);
+}
+
+void load_trace(const char *path, trace_t *t)
+{
+    mem_trace_header_t header;
+    FILE *f = fopen(path, "rb");
+
+    memset(t, 0, sizeof(*t));
+    if (f == NULL)
+    {
+        perror(path);
+        exit(EXIT_FAILURE);
+    }
+    if (fread(&header, sizeof(header), 1, f) == 1 && memcmp(header.magic, TRACE_MAGIC, sizeof(header.magic)) == 0)
+    {
+        if (header.version != TRACE_VERSION || header.event_size != sizeof(mem_trace_event_t))
+        {
+            fprintf(stderr, "%s: unsupported trace version %u\n", path, header.version);
+            exit(EXIT_FAILURE);
+        }
+        load_binary_trace(f, t);
+    }
+    else
+    {
+        rewind(f);
+        load_text_trace(f, t);
+    }
+    fclose(f);
+}
+
+void free_trace(trace_t *t)
+{
+    free(t->ops);
+    memset(t, 0, sizeof(*t));
+}
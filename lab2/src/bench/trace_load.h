@@ -0,0 +1,36 @@
+#ifndef _TRACE_LOAD_H_
+#define _TRACE_LOAD_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+
+/*
+ * Traces replayed by the benchmarks: a scenario of mem_shell (aXX: allocation of XX bytes,
+ * fY: free of the block of the Y-th allocation) or a binary trace file (see mem_alloc_trace.h:
+ * a free is matched with the live block allocated at the same offset of the same pool, and
+ * the events of all the threads are replayed in the order of the file).
+ * The frees of blocks that are not allocated are skipped, as well as the failed allocations.
+ */
+
+/* An operation of the trace */
+typedef struct
+{
+    size_t size;     /* allocations: requested size */
+    uint32_t handle; /* index of the block in the table of handles (in the order of the allocations) */
+    uint8_t is_alloc;
+} replay_op_t;
+
+typedef struct
+{
+    replay_op_t *ops;
+    size_t nb_ops;
+    size_t nb_allocs;
+    size_t nb_handles;
+} trace_t;
+
+/* Loads a trace file (exits on error) */
+void load_trace(const char *path, trace_t *t);
+
+void free_trace(trace_t *t);
+
+#endif /* !_TRACE_LOAD_H_ */
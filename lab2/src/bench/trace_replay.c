@@ -0,0 +1,306 @@
+/*
+ * Replay of an allocation trace, with our allocator and with the malloc of the C library.
+ *
+ * The trace (a mem_shell scenario or a binary trace file, see trace_load.h) is first
+ * loaded as an array of operations on handles (indexes in a table of block addresses
+ * allocated beforehand), so the replay loop only calls the allocator.
+ *
+ * Each allocator replays the trace in a child process of its own, twice: the whole loop
+ * is timed in the first run (ns/op, with the peak RSS of the process during the replay,
+ * above its RSS before the replay: the memory of the loaded trace is not counted),
+ * each operation in the second one (percentiles of the latencies, in ns).
+ * The first byte of each allocated block is written (all of them with -t).
+ * With -p, the hardware counters (see perf_counters.h) of the first run are reported per
+ * operation: the difference between a run with -t and a run without it is the cost of
+ * the use of the payloads, the rest being the cost of the allocator (metadata, free lists).
+ *
+ * usage: trace_replay [-a mem_alloc|glibc] [-t] [-p] trace_file
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "../mem_alloc.h"
+#include "../mem_alloc_trace.h"
+#include "trace_load.h"
+#include "perf_counters.h"
+#include "bench_util.h"
+
+typedef struct
+{
+    const char *name;
+    void (*init)(void);
+    void *(*alloc)(size_t);
+    void (*free)(void *);
+} allocator_t;
+
+static void mem_alloc_bench_init(void)
+{
+    trace_mode = TRACE_NONE; // The traces can still be enabled by MEMALLOC_CONF
+    memory_init();
+}
+
+static void glibc_init(void)
+{
+}
+
+static const allocator_t allocators[] = {
+    {"mem_alloc", mem_alloc_bench_init, memory_alloc, memory_free},
+    {"glibc", glibc_init, malloc, free}};
+
+#define NB_ALLOCATORS (sizeof(allocators) / sizeof(allocators[0]))
+
+/* Reads a field of /proc/self/status (in kB, -1 if not available) */
+static long read_status_kb(const char *field)
+{
+    FILE *f = fopen("/proc/self/status", "r");
+    size_t len = strlen(field);
+    char line[256];
+    long res = -1;
+
+    if (f == NULL)
+    {
+        return -1;
+    }
+    while (fgets(line, sizeof(line), f) != NULL)
+    {
+        if (strncmp(line, field, len) == 0 && line[len] == ':')
+        {
+            res = strtol(line + len + 1, NULL, 10);
+            break;
+        }
+    }
+    fclose(f);
+    return res;
+}
+
+/* Resets the peak RSS of the process (VmHWM) to its current RSS; returns 0 on success */
+static int reset_peak_rss(void)
+{
+    FILE *f = fopen("/proc/self/clear_refs", "w");
+    int res;
+
+    if (f == NULL)
+    {
+        return -1;
+    }
+    res = (fputs("5", f) < 0) ? -1 : 0;
+    return (fclose(f) != 0) ? -1 : res;
+}
+
+static inline void touch(void *b, size_t size, int touch_all)
+{
+    if (size > 0)
+    {
+        if (touch_all)
+        {
+            memset(b, 0xa5, size);
+        }
+        else
+        {
+            *(volatile char *)b = 1;
+        }
+    }
+}
+
+/* 1 if the hardware counters of the first run are reported (-p) */
+static int use_counters = 0;
+
+/* Replays the whole trace, timed as a whole */
+static void run_throughput(const allocator_t *a, const trace_t *t, void **handles, int touch_all)
+{
+    perf_counters_t counters;
+    int nb_counters = 0;
+    long long start;
+    long long time;
+    long base = -1;
+    long peak = -1;
+    size_t i;
+
+    a->init();
+    if (reset_peak_rss() == 0)
+    {
+        base = read_status_kb("VmRSS");
+    }
+    if (use_counters)
+    {
+        nb_counters = perf_counters_open(&counters);
+        perf_counters_start(&counters);
+    }
+    start = now_ns();
+    for (i = 0; i < t->nb_ops; i++)
+    {
+        const replay_op_t *op = &(t->ops[i]);
+        if (op->is_alloc)
+        {
+            handles[op->handle] = a->alloc(op->size);
+            touch(handles[op->handle], op->size, touch_all);
+        }
+        else
+        {
+            a->free(handles[op->handle]);
+        }
+    }
+    time = now_ns() - start;
+    if (use_counters)
+    {
+        perf_counters_stop(&counters);
+    }
+    if (base >= 0)
+    {
+        peak = read_status_kb("VmHWM");
+        peak = (peak >= base) ? peak - base : -1;
+    }
+
+    if (peak >= 0)
+    {
+        printf("%-10s %12.1f %10.1f %14.1f\n", a->name, time / 1e6, (double)time / t->nb_ops, peak / 1024.0);
+    }
+    else
+    {
+        printf("%-10s %12.1f %10.1f %14s\n", a->name, time / 1e6, (double)time / t->nb_ops, "n/a");
+    }
+    if (use_counters)
+    {
+        printf("%-10s", "");
+        perf_counters_print(&counters, (double)t->nb_ops);
+        if (nb_counters == 0)
+        {
+            fprintf(stderr, "No hardware counter available (see /proc/sys/kernel/perf_event_paranoid)\n");
+        }
+        perf_counters_close(&counters);
+    }
+}
+
+/* Replays the whole trace, each operation being timed */
+static void run_latency(const allocator_t *a, const trace_t *t, void **handles, int touch_all)
+{
+    long long *alloc_lat = malloc(t->nb_allocs * sizeof(long long));
+    long long *free_lat = malloc((t->nb_ops - t->nb_allocs) * sizeof(long long));
+    size_t nb_alloc = 0;
+    size_t nb_free = 0;
+    size_t i;
+
+    if ((alloc_lat == NULL && t->nb_allocs > 0) || (free_lat == NULL && t->nb_ops > t->nb_allocs))
+    {
+        fprintf(stderr, "Not enough memory for the latencies\n");
+        return;
+    }
+    a->init();
+    for (i = 0; i < t->nb_ops; i++)
+    {
+        const replay_op_t *op = &(t->ops[i]);
+        long long start = now_ns();
+        if (op->is_alloc)
+        {
+            handles[op->handle] = a->alloc(op->size);
+            alloc_lat[nb_alloc++] = now_ns() - start;
+            touch(handles[op->handle], op->size, touch_all);
+        }
+        else
+        {
+            a->free(handles[op->handle]);
+            free_lat[nb_free++] = now_ns() - start;
+        }
+    }
+    print_percentiles(10, a->name, "alloc", alloc_lat, nb_alloc);
+    print_percentiles(10, a->name, "free", free_lat, nb_free);
+}
+
+/* Runs a replay in a child process (the allocators do not share any state) */
+static void run_child(void (*run)(const allocator_t *, const trace_t *, void **, int), const allocator_t *a, const trace_t *t, int touch_all)
+{
+    void **handles = calloc(t->nb_handles + 1, sizeof(void *));
+    int status;
+    pid_t pid;
+
+    fflush(stdout);
+    pid = fork();
+    if (pid == 0)
+    {
+        run(a, t, handles, touch_all);
+        fflush(stdout);
+        // The handlers of exit are skipped (the allocator does not print anything), but a trace file enabled by MEMALLOC_CONF is completed
+        trace_close();
+        _exit(EXIT_SUCCESS);
+    }
+    if (pid < 0 || waitpid(pid, &status, 0) != pid || !WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS)
+    {
+        printf("%-10s failed\n", a->name);
+    }
+    free(handles);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *only = NULL;
+    int touch_all = 0;
+    trace_t t;
+    size_t i;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "a:tp")) != -1)
+    {
+        switch (opt)
+        {
+        case 'a':
+            only = optarg;
+            break;
+        case 't':
+            touch_all = 1;
+            break;
+        case 'p':
+            use_counters = 1;
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-a mem_alloc|glibc] [-t] [-p] trace_file\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (optind != argc - 1)
+    {
+        fprintf(stderr, "usage: %s [-a mem_alloc|glibc] [-t] [-p] trace_file\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    for (i = 0; only != NULL && i < NB_ALLOCATORS && strcmp(only, allocators[i].name) != 0; i++)
+    {
+    }
+    if (i == NB_ALLOCATORS)
+    {
+        fprintf(stderr, "Unknown allocator %s\n", only);
+        return EXIT_FAILURE;
+    }
+
+    load_trace(argv[optind], &t);
+    if (t.nb_ops == 0)
+    {
+        fprintf(stderr, "%s: empty trace\n", argv[optind]);
+        return EXIT_FAILURE;
+    }
+    printf("%s: %zu operations (%zu allocations, %zu frees)\n", argv[optind], t.nb_ops, t.nb_allocs, t.nb_ops - t.nb_allocs);
+
+    printf("%-10s %12s %10s %14s\n", "allocator", "time (ms)", "ns/op", "peak RSS (MB)");
+    for (i = 0; i < NB_ALLOCATORS; i++)
+    {
+        if (only == NULL || strcmp(only, allocators[i].name) == 0)
+        {
+            run_child(run_throughput, &(allocators[i]), &t, touch_all);
+        }
+    }
+
+    printf("\nlatencies in ns\n");
+    print_percentiles_header(10, "allocator");
+    for (i = 0; i < NB_ALLOCATORS; i++)
+    {
+        if (only == NULL || strcmp(only, allocators[i].name) == 0)
+        {
+            run_child(run_latency, &(allocators[i]), &t, touch_all);
+        }
+    }
+
+    free_trace(&t);
+    return EXIT_SUCCESS;
+}
@@ -7,14 +7,40 @@
 #include <unistd.h>
 #include <assert.h>
 #include <dlfcn.h>
+#include <sched.h>
+#include <pthread.h>
+#include <time.h>
+#include <string.h>
+#include <inttypes.h>
 
 #include "mem_alloc.h"
 #include "mem_alloc_types.h"
 #include "mem_alloc_fast_pool.h"
 #include "mem_alloc_standard_pool.h"
+#include "mem_alloc_huge_pool.h"
+#include "mem_alloc_thread_cache.h"
+#include "mem_alloc_page_map.h"
+#include "mem_alloc_conf.h"
+#include "mem_alloc_trace.h"
+#include "mem_alloc_prof.h"
+#include "my_mmap.h"
 
-/* Number of memory pools managed by the allocator */
-#define NB_MEM_POOLS 4
+/* Number of independent standard pools (arenas), each one with its own lock */
+#ifndef NB_STD_ARENAS
+#define NB_STD_ARENAS 8
+#endif
+
+/* Number of memory pools managed by the allocator (the fast pools, the standard arenas and the huge pool) */
+#define NB_MEM_POOLS (NB_FAST_POOLS + NB_STD_ARENAS + 1)
+
+/* Pool id of the first standard arena (the one used by the first thread) */
+#define FIRST_STD_POOL NB_FAST_POOLS
+
+/* Pool id of the huge pool */
+#define HUGE_POOL_ID (FIRST_STD_POOL + NB_STD_ARENAS)
+
+/* The TLS variables must not be allocated lazily by the dynamic loader (see mem_alloc_thread_cache.c) */
+#define TLS_INITIAL_EXEC __attribute__((tls_model("initial-exec")))
 
 #define ULONG(x) ((long unsigned int)(x))
 
@@ -23,99 +49,248 @@ void *(*o_malloc)(size_t) = NULL;
 void (*o_free)(void *) = NULL;
 void *(*o_realloc)(void *, size_t) = NULL;
 void *(*o_calloc)(size_t, size_t) = NULL;
+size_t (*o_malloc_usable_size)(void *) = NULL;
 
 /* Array of memory pool descriptors (indexed by pool id) */
 static mem_pool_t mem_pools[NB_MEM_POOLS];
 
-/* Note: the other fields will be setup by the init procedure */
-static mem_pool_t fast_pool_1_64 = {
-    .pool_id = 0,
-    .pool_name = "pool-0-fast (1_64)",
-    .pool_size = MEM_POOL_0_SIZE,
-    .min_req_size = 1,
-    .max_req_size = 64,
-    .pool_type = FAST_POOL};
+/*
+ * Size classes:
+ * each fast pool serves the requests from the block size of the previous pool (excluded)
+ * to its own block size (included).
+ * The fine-grained classes use 16 bytes steps up to 256 bytes, then 4 classes per doubling
+ * (the internal fragmentation is at most 25%, instead of 75% with the lab layout).
+ */
+#ifdef FINE_SIZE_CLASSES
+static const size_t fast_pool_block_sizes[NB_FAST_POOLS] = {
+    16, 32, 48, 64, 80, 96, 112, 128, 144, 160, 176, 192, 208, 224, 240, 256,
+    320, 384, 448, 512, 640, 768, 896, 1024, 1280, 1536, 1792, 2048,
+    2560, 3072, 3584, 4096, 5120, 6144, 7168, 8192, 10240, 12288, 14336, 16384};
+#else
+static const size_t fast_pool_block_sizes[NB_FAST_POOLS] = {64, 256, 1024};
+static size_t fast_pool_sizes[NB_FAST_POOLS] = {MEM_POOL_0_SIZE, MEM_POOL_1_SIZE, MEM_POOL_2_SIZE};
+#endif
 
-/* Note: the other fields will be setup by the init procedure */
-static mem_pool_t fast_pool_65_256 = {
-    .pool_id = 1,
-    .pool_name = "pool-1-fast (65_256)",
-    .pool_size = MEM_POOL_1_SIZE,
-    .min_req_size = 65,
-    .max_req_size = 256,
-    .pool_type = FAST_POOL};
+/* Fine-grained classes: minimum number of blocks of a slab (the larger classes get larger slabs) */
+#define FAST_SLAB_MIN_BLOCKS 16
 
-/* Note: the other fields will be setup by the init procedure */
-static mem_pool_t fast_pool_257_1024 = {
-    .pool_id = 2,
-    .pool_name = "pool-2-fast (257_1024)",
-    .pool_size = MEM_POOL_2_SIZE,
-    .min_req_size = 257,
-    .max_req_size = 1024,
-    .pool_type = FAST_POOL};
+#ifdef FINE_SIZE_CLASSES
+/* Fine-grained classes: size of the slabs (MEM_POOL_0_SIZE by default) */
+static size_t fast_slab_size = MEM_POOL_0_SIZE;
+#endif
+
+/*
+ * Size to size class lookup table: the request sizes are rounded up to a multiple
+ * of 16 bytes up to 1024 bytes, and to a multiple of 128 bytes above
+ * (all the block sizes are multiples of these steps).
+ */
+#define SIZE_CLASS_SMALL_MAX 1024
+#define SIZE_CLASS_SLOT(size) (((size) <= SIZE_CLASS_SMALL_MAX) ? ((size) + 15) >> 4 : (SIZE_CLASS_SMALL_MAX >> 4) + (((size) - SIZE_CLASS_SMALL_MAX + 127) >> 7))
+#define NB_SIZE_CLASS_SLOTS (SIZE_CLASS_SLOT(FAST_POOL_MAX_SIZE) + 1)
+
+static unsigned char size_class_index[NB_SIZE_CLASS_SLOTS];
+
+/* Names of the fast pools */
+static char fast_pool_names[NB_FAST_POOLS][32];
 
 /* Note: the other fields will be setup by the init procedure */
-static mem_pool_t standard_pool_1025_and_above = {
-    .pool_id = 3,
-    .pool_name = "pool-3-std (1024_Max)",
+static mem_pool_t standard_pool = {
+    .pool_id = FIRST_STD_POOL,
     .pool_size = MEM_POOL_3_SIZE,
-    .min_req_size = 1025,
-    .max_req_size = SIZE_MAX,
+    .min_req_size = FAST_POOL_MAX_SIZE + 1,
+    .max_req_size = HUGE_THRESHOLD - 1,
     .pool_type = STANDARD_POOL};
 
+/* Note: the other fields will be setup by the init procedure */
+static mem_pool_t huge_pool = {
+    .pool_id = HUGE_POOL_ID,
+    .pool_name = "pool-huge (mmap)",
+    .min_req_size = HUGE_THRESHOLD,
+    .max_req_size = SIZE_MAX,
+    .pool_type = HUGE_POOL};
+
+/* Binding of the threads to their home standard arena (see mem_alloc_conf.h) */
+#ifdef STD_ARENA_BINDING
+/* Get the value provided by the Makefile */
+static std_arena_binding_t std_arena_binding = STD_ARENA_BINDING;
+#else
+static std_arena_binding_t std_arena_binding = ARENA_ROUND_ROBIN;
+#endif
+
+/* Names of the standard arenas */
+static char std_arena_names[NB_STD_ARENAS][32];
+
+/* The arenas (except the first one) are only mapped when a thread is bound to them */
+static int std_arena_ready[NB_STD_ARENAS];
+static pthread_mutex_t std_arena_init_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Round-robin binding: home arena of the calling thread (-1 if not bound yet) and next arena to hand out */
+static __thread int my_std_arena TLS_INITIAL_EXEC = -1;
+static int next_std_arena = 0;
+
+/*
+ * Purging:
+ * every PURGE_DECAY_MS milliseconds, one of the threads freeing blocks runs a purge pass over
+ * the pools (see mem_purge_fast_pool and mem_purge_standard_pool). The memory found free by a
+ * pass is given back to the OS by the next one if it is still free, i.e. after PURGE_DECAY_MS
+ * to 2 x PURGE_DECAY_MS milliseconds: memory reused quickly is never purged.
+ * With PURGE_DECAY_MS = 0, memory is only purged by explicit calls to memory_trim.
+ */
+#ifndef PURGE_DECAY_MS
+#define PURGE_DECAY_MS 1000
+#endif
+
+static uint64_t purge_decay_ms = PURGE_DECAY_MS;
+
+/* Number of frees between two reads of the clock by a thread */
+#define PURGE_CHECK_INTERVAL 256
+
+static __thread unsigned int purge_countdown TLS_INITIAL_EXEC = PURGE_CHECK_INTERVAL;
+/* Time (in ms) of the next purge pass (taken by the thread that updates it) */
+static uint64_t next_purge_ms = 0;
+
+/* Statistics printed at exit (see memory_print_stats) */
+static int stats_print = 0;
+
+/* File of the binary traces (empty: TRACE_FILE_DEFAULT) */
+static char trace_file[CONF_MAX_VALUE];
+
+/* Prefix of the heap profiles (empty: PROF_PREFIX_DEFAULT) */
+static char prof_prefix[CONF_MAX_VALUE];
+
 /* This function is automatically called upon the termination of a process. */
 void run_at_exit(void)
 {
+    if (stats_print)
+    {
+        memory_print_stats();
+    }
+    if (prof_sample_interval != 0)
+    {
+        memory_dump_profile(NULL);
+    }
+    trace_close();
     fprintf(stderr, "YEAH B-)\n");
     /* You are encouraged to insert more useful code ... */
 }
 
 /* 
- * Returns the id of the pool in charge of a given block size.
- * Note:
- * We assume that the contents of the pools are consistent
- * (pools covering all possible block sizes,
- * sorted by increasing sizes,
- * no overlap).
+ * Returns the id of the pool in charge of a given block size
+ * (the first standard arena for the sizes between the largest size class and the huge threshold).
  */
 static int find_pool_from_block_size(size_t size)
 {
-    int i;
-    int res = -1;
+    int res;
     debug_printf("size=%lu\n", size);
-    for (i = 0; i < NB_MEM_POOLS; i++)
+    if (size <= FAST_POOL_MAX_SIZE)
     {
-        if ((size >= mem_pools[i].min_req_size) && (size <= mem_pools[i].max_req_size))
-        {
-            res = i;
-            break;
-        }
+        res = size_class_index[SIZE_CLASS_SLOT(size)];
+    }
+    else if (size < HUGE_THRESHOLD)
+    {
+        res = FIRST_STD_POOL;
+    }
+    else
+    {
+        res = HUGE_POOL_ID;
     }
     debug_printf("will return %d\n", res);
-    assert(res >= 0);
     return res;
 }
 
+/* Fills the size to size class lookup table */
+static void init_size_classes(void)
+{
+    size_t size;
+    int i = 0;
+
+    for (size = 0; size <= FAST_POOL_MAX_SIZE; size++)
+    {
+        if (size > fast_pool_block_sizes[i])
+        {
+            i++;
+            /* all the sizes sharing a slot must belong to the same class */
+            assert(SIZE_CLASS_SLOT(size) != SIZE_CLASS_SLOT(size - 1));
+        }
+        size_class_index[SIZE_CLASS_SLOT(size)] = i;
+    }
+}
+
 /*
  * Returns the id of the pool in charge of a given block.
  */
 int find_pool_from_block_address(void *addr)
 {
-    int i;
+    const page_map_entry_t *e;
     int res = -1;
     debug_printf("enter - addr = %p\n", addr);
-    for (i = 0; i < NB_MEM_POOLS; i++)
+    /* the page map knows the pool of every slab and segment */
+    e = page_map_lookup(addr);
+    if (e != NULL)
     {
-        if ((addr >= mem_pools[i].start_addr) && (addr <= mem_pools[i].end_addr))
-        {
-            res = i;
-            break;
-        }
+        res = e->pool->pool_id;
     }
     debug_printf("will return %d\n", res);
     return res;
 }
 
+/* Overrides the properties chosen at build time with the settings of MEMALLOC_CONF (if any) */
+static void load_conf(void)
+{
+    const char *str = getenv(MEMALLOC_CONF_ENV);
+    mem_alloc_conf_t conf;
+    int i;
+#ifdef FINE_SIZE_CLASSES
+    /* All the fine-grained classes have slabs of MEM_POOL_0_SIZE bytes (pool1 and pool2 are not used) */
+    size_t unused_sizes[2] = {MEM_POOL_1_SIZE, MEM_POOL_2_SIZE};
+    size_t *pool_sizes[CONF_NB_POOL_SIZES] = {&fast_slab_size, &unused_sizes[0], &unused_sizes[1], &(standard_pool.pool_size)};
+#else
+    size_t *pool_sizes[CONF_NB_POOL_SIZES] = {&fast_pool_sizes[0], &fast_pool_sizes[1], &fast_pool_sizes[2], &(standard_pool.pool_size)};
+#endif
+
+    if (str == NULL)
+    {
+        return;
+    }
+    for (i = 0; i < CONF_NB_POOL_SIZES; i++)
+    {
+        conf.pool_sizes[i] = *(pool_sizes[i]);
+    }
+    conf.policy = std_pool_policy;
+    conf.align = std_pool_align;
+    conf.purge_decay_ms = purge_decay_ms;
+    conf.arena_binding = std_arena_binding;
+    conf.huge_pages = my_mmap_huge_pages;
+    conf.stats_print = stats_print;
+    conf.trace = trace_mode;
+    conf.trace_file[0] = '\0';
+    conf.prof_sample = prof_sample_interval;
+    conf.prof_prefix[0] = '\0';
+
+    mem_alloc_conf_parse(&conf, str);
+
+    for (i = 0; i < CONF_NB_POOL_SIZES; i++)
+    {
+        *(pool_sizes[i]) = conf.pool_sizes[i];
+    }
+    std_pool_policy = conf.policy;
+    std_pool_align = conf.align;
+    purge_decay_ms = conf.purge_decay_ms;
+    std_arena_binding = conf.arena_binding;
+    my_mmap_huge_pages = conf.huge_pages;
+    stats_print = conf.stats_print;
+    trace_mode = conf.trace;
+    if (conf.trace_file[0] != '\0')
+    {
+        memcpy(trace_file, conf.trace_file, sizeof(trace_file));
+    }
+    prof_sample_interval = conf.prof_sample;
+    if (conf.prof_prefix[0] != '\0')
+    {
+        memcpy(prof_prefix, conf.prof_prefix, sizeof(prof_prefix));
+    }
+}
+
 void memory_init(void)
 {
     int i;
@@ -123,33 +298,260 @@ void memory_init(void)
     /* Register the function that will be called when the process exits. */
     atexit(run_at_exit);
 
+    /* Must be done before the pools are initialized */
+    load_conf();
+    if (trace_mode == TRACE_BINARY && trace_open(trace_file) != 0)
+    {
+        trace_mode = TRACE_TEXT;
+    }
+    if (prof_sample_interval != 0)
+    {
+        prof_open(prof_prefix);
+    }
+
     /* Init all the pools */
-    mem_pools[0] = fast_pool_1_64;
-    mem_pools[1] = fast_pool_65_256;
-    mem_pools[2] = fast_pool_257_1024;
-    mem_pools[3] = standard_pool_1025_and_above;
+    for (i = 0; i < NB_FAST_POOLS; i++)
+    {
+        mem_pools[i].pool_id = i;
+        mem_pools[i].min_req_size = (i == 0) ? 1 : fast_pool_block_sizes[i - 1] + 1;
+        mem_pools[i].max_req_size = fast_pool_block_sizes[i];
+#ifdef FINE_SIZE_CLASSES
+        mem_pools[i].pool_size = fast_slab_size;
+        if (mem_pools[i].pool_size < FAST_SLAB_MIN_BLOCKS * fast_pool_block_sizes[i])
+        {
+            mem_pools[i].pool_size = FAST_SLAB_MIN_BLOCKS * fast_pool_block_sizes[i];
+        }
+#else
+        mem_pools[i].pool_size = fast_pool_sizes[i];
+#endif
+        mem_pools[i].pool_type = FAST_POOL;
+        snprintf(fast_pool_names[i], sizeof(fast_pool_names[i]), "pool-%d-fast (%zu_%zu)", i, mem_pools[i].min_req_size, mem_pools[i].max_req_size);
+        mem_pools[i].pool_name = fast_pool_names[i];
+    }
+    init_size_classes();
+    for (i = 0; i < NB_STD_ARENAS; i++)
+    {
+        mem_pools[FIRST_STD_POOL + i] = standard_pool;
+        mem_pools[FIRST_STD_POOL + i].pool_id = FIRST_STD_POOL + i;
+        snprintf(std_arena_names[i], sizeof(std_arena_names[i]), "pool-%d-std (%d_Max)", FIRST_STD_POOL + i, FAST_POOL_MAX_SIZE);
+        mem_pools[FIRST_STD_POOL + i].pool_name = std_arena_names[i];
+        std_arena_ready[i] = 0;
+    }
 
-    for (i = 0; i < 3; i++)
+    for (i = 0; i < NB_FAST_POOLS; i++)
     {
         init_fast_pool(&(mem_pools[i]), mem_pools[i].pool_size, mem_pools[i].min_req_size, mem_pools[i].max_req_size);
     }
-    init_standard_pool(&(mem_pools[3]), mem_pools[3].pool_size, mem_pools[3].min_req_size, mem_pools[3].max_req_size);
+    init_standard_pool(&(mem_pools[FIRST_STD_POOL]), mem_pools[FIRST_STD_POOL].pool_size, mem_pools[FIRST_STD_POOL].min_req_size, mem_pools[FIRST_STD_POOL].max_req_size);
+    std_arena_ready[0] = 1;
+    mem_pools[HUGE_POOL_ID] = huge_pool;
+    init_huge_pool(&(mem_pools[HUGE_POOL_ID]), mem_pools[HUGE_POOL_ID].min_req_size, mem_pools[HUGE_POOL_ID].max_req_size);
+    thread_cache_init();
 
-    /* checks that the pools request sizes are not overlapping */
+    /* checks that the pools request sizes are not overlapping (the standard arenas all cover the same sizes) */
     assert(mem_pools[0].min_req_size == 1);
-    for (i = 0; i < NB_MEM_POOLS - 1; i++)
+    for (i = 0; i < FIRST_STD_POOL; i++)
     {
         assert(mem_pools[i].max_req_size + 1 == mem_pools[i + 1].min_req_size);
         debug_printf("mem_pools[%d]: size=%lu, min_request_size=%lu, max_request_size=%lu\n", i, mem_pools[i].pool_size, mem_pools[i].min_req_size, mem_pools[i].max_req_size);
     }
-    debug_printf("mem_pools[%d]: size=%lu, min_request_size=%lu, max_request_size=%lu\n", i, mem_pools[i].pool_size, mem_pools[i].min_req_size, mem_pools[i].max_req_size);
-    assert(mem_pools[NB_MEM_POOLS - 1].max_req_size == SIZE_MAX);
+    for (i = FIRST_STD_POOL; i < HUGE_POOL_ID; i++)
+    {
+        assert(mem_pools[i].min_req_size == mem_pools[FIRST_STD_POOL].min_req_size);
+        assert(mem_pools[i].max_req_size + 1 == mem_pools[HUGE_POOL_ID].min_req_size);
+    }
+    assert(mem_pools[HUGE_POOL_ID].max_req_size == SIZE_MAX);
+    debug_printf("mem_pools[%d]: size=%lu, min_request_size=%lu, max_request_size=%lu (x %d arenas)\n", FIRST_STD_POOL, mem_pools[FIRST_STD_POOL].pool_size, mem_pools[FIRST_STD_POOL].min_req_size, mem_pools[FIRST_STD_POOL].max_req_size, NB_STD_ARENAS);
+    debug_printf("mem_pools[%d]: min_request_size=%lu, max_request_size=%lu\n", HUGE_POOL_ID, mem_pools[HUGE_POOL_ID].min_req_size, mem_pools[HUGE_POOL_ID].max_req_size);
 
     /* Init the pointers to the original malloc functions */
     o_malloc = dlsym(RTLD_NEXT, "malloc");
     o_free = dlsym(RTLD_NEXT, "free");
     o_realloc = dlsym(RTLD_NEXT, "realloc");
     o_calloc = dlsym(RTLD_NEXT, "calloc");
+    o_malloc_usable_size = dlsym(RTLD_NEXT, "malloc_usable_size");
+}
+
+/* Returns the descriptor of a standard arena, mapping it upon first use */
+static mem_pool_t *get_std_arena(int arena)
+{
+    mem_pool_t *pool = &(mem_pools[FIRST_STD_POOL + arena]);
+
+    if (!__atomic_load_n(&(std_arena_ready[arena]), __ATOMIC_ACQUIRE))
+    {
+        pthread_mutex_lock(&std_arena_init_lock);
+        if (!std_arena_ready[arena])
+        {
+            init_standard_pool(pool, pool->pool_size, pool->min_req_size, pool->max_req_size);
+            __atomic_store_n(&(std_arena_ready[arena]), 1, __ATOMIC_RELEASE);
+        }
+        pthread_mutex_unlock(&std_arena_init_lock);
+    }
+    return pool;
+}
+
+/* Returns the index of the home arena of the calling thread */
+static int get_home_std_arena(void)
+{
+    if (std_arena_binding == ARENA_PER_CPU)
+    {
+        int cpu = sched_getcpu();
+        if (cpu >= 0)
+        {
+            return cpu % NB_STD_ARENAS;
+        }
+    }
+    if (my_std_arena < 0)
+    {
+        my_std_arena = __atomic_fetch_add(&next_std_arena, 1, __ATOMIC_RELAXED) % NB_STD_ARENAS;
+    }
+    return my_std_arena;
+}
+
+/* Allocation in a standard arena (pool lock held) */
+static void *std_arena_alloc(mem_pool_t *pool, size_t size, size_t alignment, void **zero_start, void **zero_end)
+{
+    if (alignment > 1)
+    {
+        return mem_alloc_standard_pool_aligned(pool, size, alignment);
+    }
+    return mem_alloc_standard_pool_clean(pool, size, zero_start, zero_end);
+}
+
+/*
+ * Allocation in the standard arenas.
+ * The home arena of the thread is tried first. If another thread holds its lock,
+ * the other arenas are tried without blocking before waiting for the home one.
+ * If the home arena is full, all the arenas are tried in turn.
+ * The payload is aligned on alignment bytes, and the part of the block known to hold zeros
+ * is given by zero_start/zero_end (if not NULL; only for the unaligned requests).
+ */
+static void *std_arenas_alloc(size_t size, size_t alignment, void **zero_start, void **zero_end)
+{
+    int home = get_home_std_arena();
+    mem_pool_t *pool = get_std_arena(home);
+    void *res = NULL;
+    int j;
+
+    if (pthread_mutex_trylock(&(pool->lock)) == 0)
+    {
+        res = std_arena_alloc(pool, size, alignment, zero_start, zero_end);
+        pthread_mutex_unlock(&(pool->lock));
+        if (res != NULL)
+        {
+            return res;
+        }
+    }
+    else
+    {
+        for (j = 1; j < NB_STD_ARENAS; j++)
+        {
+            int arena = (home + j) % NB_STD_ARENAS;
+            mem_pool_t *other = &(mem_pools[FIRST_STD_POOL + arena]);
+            if (!__atomic_load_n(&(std_arena_ready[arena]), __ATOMIC_ACQUIRE) || pthread_mutex_trylock(&(other->lock)) != 0)
+            {
+                continue;
+            }
+            res = std_arena_alloc(other, size, alignment, zero_start, zero_end);
+            pthread_mutex_unlock(&(other->lock));
+            if (res != NULL)
+            {
+                /* Stick to the arena that was available */
+                if (std_arena_binding == ARENA_ROUND_ROBIN)
+                {
+                    my_std_arena = arena;
+                }
+                return res;
+            }
+        }
+        pthread_mutex_lock(&(pool->lock));
+        res = std_arena_alloc(pool, size, alignment, zero_start, zero_end);
+        pthread_mutex_unlock(&(pool->lock));
+        if (res != NULL)
+        {
+            return res;
+        }
+    }
+
+    for (j = 1; j < NB_STD_ARENAS && res == NULL; j++)
+    {
+        mem_pool_t *other = get_std_arena((home + j) % NB_STD_ARENAS);
+        pthread_mutex_lock(&(other->lock));
+        res = std_arena_alloc(other, size, alignment, zero_start, zero_end);
+        pthread_mutex_unlock(&(other->lock));
+    }
+    return res;
+}
+
+/* Runs a purge pass over all the pools; if force is 0, the standard arenas in use are skipped */
+static size_t purge_pools(int force)
+{
+    size_t purged = 0;
+    int i;
+
+    for (i = 0; i < NB_FAST_POOLS; i++)
+    {
+        purged += mem_purge_fast_pool(&(mem_pools[i]), force);
+    }
+    for (i = 0; i < NB_STD_ARENAS; i++)
+    {
+        mem_pool_t *pool = &(mem_pools[FIRST_STD_POOL + i]);
+        if (!__atomic_load_n(&(std_arena_ready[i]), __ATOMIC_ACQUIRE))
+        {
+            continue;
+        }
+        if (force)
+        {
+            pthread_mutex_lock(&(pool->lock));
+        }
+        else if (pthread_mutex_trylock(&(pool->lock)) != 0)
+        {
+            continue;
+        }
+        purged += mem_purge_standard_pool(pool, force);
+        pthread_mutex_unlock(&(pool->lock));
+    }
+    return purged;
+}
+
+/* Called upon each free: runs a purge pass if the calling thread is the first one to notice it is due */
+static void purge_tick(void)
+{
+    struct timespec ts;
+    uint64_t now;
+    uint64_t next;
+
+    if (purge_decay_ms == 0 || --purge_countdown > 0)
+    {
+        return;
+    }
+    purge_countdown = PURGE_CHECK_INTERVAL;
+
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    now = (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+    next = __atomic_load_n(&next_purge_ms, __ATOMIC_RELAXED);
+    if (now < next || !__atomic_compare_exchange_n(&next_purge_ms, &next, now + purge_decay_ms, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+    {
+        return;
+    }
+    purge_pools(0);
+}
+
+size_t memory_trim(void)
+{
+    size_t purged;
+
+    // The blocks cached by this thread can be purged too
+    thread_cache_flush();
+    purged = purge_pools(1);
+    debug_printf("%zu bytes purged\n", purged);
+    return purged;
+}
+
+/* Counts a failed request in the statistics of a pool */
+static void count_failure(int i)
+{
+    __atomic_fetch_add(&(mem_pools[i].counters.nb_failures), 1, __ATOMIC_RELAXED);
 }
 
 /* 
@@ -165,22 +567,75 @@ void *memory_alloc(size_t size)
     switch (mem_pools[i].pool_type)
     {
     case FAST_POOL:
-        alloc_addr = mem_alloc_fast_pool(&(mem_pools[i]), size);
+        alloc_addr = thread_cache_alloc(&(mem_pools[i]), size);
+        break;
+    case STANDARD_POOL:
+        alloc_addr = std_arenas_alloc(size, 1, NULL, NULL);
+        break;
+    case HUGE_POOL:
+        alloc_addr = mem_alloc_huge_pool(&(mem_pools[i]), size);
+        break;
+    default: /* we should never reach this case */
+        assert(0);
+    }
+    if (alloc_addr == NULL)
+    {
+        count_failure(i);
+        print_alloc_error(size);
+        exit(0);
+    }
+    else
+    {
+        print_alloc_info(alloc_addr, size);
+        prof_alloc(alloc_addr, size);
+    }
+    debug_printf("return %p\n", alloc_addr);
+    return alloc_addr;
+}
+
+/*
+ * Entry point for aligned allocation requests.
+ * The blocks of a fast pool are aligned on the largest power of two dividing their size
+ * (up to the page size, the slabs being aligned on pages): the request is served by the first
+ * pool of its size class or above whose blocks are aligned. The standard and huge pools place
+ * the payload at an aligned address inside a larger free block (or mapping).
+ */
+void *memory_alloc_aligned(size_t alignment, size_t size)
+{
+    int i;
+    void *alloc_addr = NULL;
+
+    debug_printf("enter alignment = %lu, size = %lu\n", alignment, size);
+    assert(alignment != 0 && (alignment & (alignment - 1)) == 0);
+    i = find_pool_from_block_size(size);
+    while (mem_pools[i].pool_type == FAST_POOL && (alignment > OS_BASE_PAGE_SIZE || mem_pools[i].max_req_size % alignment != 0))
+    {
+        i++; // The pool following the last fast pool is the first standard arena
+    }
+    switch (mem_pools[i].pool_type)
+    {
+    case FAST_POOL:
+        alloc_addr = thread_cache_alloc(&(mem_pools[i]), size);
         break;
     case STANDARD_POOL:
-        alloc_addr = mem_alloc_standard_pool(&(mem_pools[i]), size);
+        alloc_addr = std_arenas_alloc(size, alignment, NULL, NULL);
+        break;
+    case HUGE_POOL:
+        alloc_addr = mem_alloc_huge_pool_aligned(&(mem_pools[i]), size, alignment);
         break;
     default: /* we should never reach this case */
         assert(0);
     }
     if (alloc_addr == NULL)
     {
+        count_failure(i);
         print_alloc_error(size);
         exit(0);
     }
     else
     {
         print_alloc_info(alloc_addr, size);
+        prof_alloc(alloc_addr, size);
     }
     debug_printf("return %p\n", alloc_addr);
     return alloc_addr;
@@ -196,22 +651,158 @@ void memory_free(void *p)
 
     debug_printf("enter p = %p\n", p);
     i = find_pool_from_block_address(p);
+    /* printed before the block is freed (its segment may be released) */
+    print_free_info(p);
+    prof_free(p);
 
     switch (mem_pools[i].pool_type)
     {
     case FAST_POOL:
-        mem_free_fast_pool(&(mem_pools[i]), p);
+        thread_cache_free(&(mem_pools[i]), p);
         break;
     case STANDARD_POOL:
+        pthread_mutex_lock(&(mem_pools[i].lock));
         mem_free_standard_pool(&(mem_pools[i]), p);
+        pthread_mutex_unlock(&(mem_pools[i].lock));
+        break;
+    case HUGE_POOL:
+        mem_free_huge_pool(&(mem_pools[i]), p);
         break;
     default: /* we should never reach this case */
         assert(0);
     }
-    print_free_info(p);
+    purge_tick();
     debug_printf("exit\n");
 }
 
+/*
+ * Entry point for zeroed allocation requests (calloc).
+ * Only the parts of the block that may not hold zeros are cleared: the never used
+ * blocks of the fast pools, the never touched (or purged) pages of the standard pools
+ * and the huge blocks (fresh mappings) are known to hold zeros.
+ */
+void *memory_calloc(size_t nmemb, size_t size)
+{
+    int i;
+    size_t total;
+    void *alloc_addr = NULL;
+    void *zero_start;
+    void *zero_end;
+
+    debug_printf("enter nmemb = %lu, size = %lu\n", nmemb, size);
+    if (__builtin_mul_overflow(nmemb, size, &total))
+    {
+        debug_printf("return NULL (overflow)\n");
+        return NULL;
+    }
+    i = find_pool_from_block_size(total);
+    switch (mem_pools[i].pool_type)
+    {
+    case FAST_POOL:
+        alloc_addr = thread_cache_calloc(&(mem_pools[i]), total);
+        break;
+    case STANDARD_POOL:
+        alloc_addr = std_arenas_alloc(total, 1, &zero_start, &zero_end);
+        if (alloc_addr != NULL)
+        {
+            /* memset selects the fastest implementation (vector or non-temporal stores) according to the size */
+            memset(alloc_addr, 0, (size_t)((char *)zero_start - (char *)alloc_addr));
+            memset(zero_end, 0, (size_t)((char *)alloc_addr + total - (char *)zero_end));
+        }
+        break;
+    case HUGE_POOL:
+        alloc_addr = mem_alloc_huge_pool(&(mem_pools[i]), total);
+        break;
+    default: /* we should never reach this case */
+        assert(0);
+    }
+    if (alloc_addr == NULL)
+    {
+        count_failure(i);
+        print_alloc_error(total);
+        exit(0);
+    }
+    else
+    {
+        print_alloc_info(alloc_addr, total);
+        prof_alloc(alloc_addr, total);
+    }
+    debug_printf("return %p\n", alloc_addr);
+    return alloc_addr;
+}
+
+/*
+ * Entry point for reallocation requests.
+ * The block is resized in place when its pool allows it (see below),
+ * otherwise it is moved to a new block of the appropriate pool.
+ */
+void *memory_realloc(void *p, size_t size)
+{
+    int i;
+    int j;
+    void *res = NULL;
+    size_t old_size;
+
+    debug_printf("enter p = %p, size = %lu\n", p, size);
+    i = find_pool_from_block_address(p);
+    j = find_pool_from_block_size(size);
+
+    switch (mem_pools[i].pool_type)
+    {
+    case FAST_POOL:
+        // Same size class: the block is already large enough
+        if (i == j)
+        {
+            res = p;
+        }
+        break;
+    case STANDARD_POOL:
+        if (mem_pools[j].pool_type == STANDARD_POOL)
+        {
+            pthread_mutex_lock(&(mem_pools[i].lock));
+            res = mem_realloc_standard_pool(&(mem_pools[i]), p, size);
+            pthread_mutex_unlock(&(mem_pools[i].lock));
+        }
+        break;
+    case HUGE_POOL:
+        if (i == j)
+        {
+            res = mem_realloc_huge_pool(&(mem_pools[i]), p, size);
+        }
+        break;
+    default: /* we should never reach this case */
+        assert(0);
+    }
+
+    if (res != NULL)
+    {
+        /* traced as a deallocation followed by an allocation (the huge blocks are traced at offset 0 whatever their address) */
+        print_free_info(res);
+        print_alloc_info(res, size);
+        prof_free(p);
+        prof_alloc(res, size);
+        debug_printf("return %p (in place)\n", res);
+        return res;
+    }
+
+    res = memory_alloc(size);
+    if (res == NULL)
+    {
+        /* The original block is left untouched */
+        return NULL;
+    }
+    old_size = memory_get_allocated_block_size(p);
+    memcpy(res, p, (old_size < size) ? old_size : size);
+    memory_free(p);
+    debug_printf("return %p\n", res);
+    return res;
+}
+
+int memory_dump_profile(const char *path)
+{
+    return prof_dump(path);
+}
+
 /* Returns the payload size of an allocated block */
 size_t memory_get_allocated_block_size(void *addr)
 {
@@ -228,67 +819,248 @@ size_t memory_get_allocated_block_size(void *addr)
     case STANDARD_POOL:
         res = mem_get_allocated_block_size_standard_pool(&(mem_pools[i]), addr);
         break;
+    case HUGE_POOL:
+        res = mem_get_allocated_block_size_huge_pool(&(mem_pools[i]), addr);
+        break;
     default: /* we should never reach this case */
         assert(0);
     }
     return res;
 }
 
+/*
+ * Statistics:
+ * the pools count their allocations and frees (see mem_alloc_stats.h), except the requests
+ * served by the thread caches, which are counted by the caches. All the blocks of a fast
+ * pool have the same size, so the counts are enough to compute the memory in use.
+ */
+
+/*
+ * Sets the fragmentation ratios of the statistics of a pool, from the cumulative requested
+ * and allocated sizes, and the size of the free memory outside the largest free block(s)
+ */
+static void set_fragmentation(mem_pool_stats_t *ps, uint64_t requested, uint64_t allocated, uint64_t unusable)
+{
+    ps->internal_fragmentation = (allocated > 0) ? 1.0 - (double)requested / (double)allocated : 0.0;
+    ps->external_fragmentation = (ps->free_bytes > 0) ? (double)unusable / (double)ps->free_bytes : 0.0;
+}
+
+/* Statistics of a fast pool */
+static void get_fast_pool_stats(mem_pool_t *pool, mem_pool_stats_t *ps, uint64_t *requested, uint64_t *allocated)
+{
+    uint64_t cache_allocs;
+    uint64_t cache_frees;
+    uint64_t cache_requested;
+    uint64_t in_use_blocks;
+    size_t nb_blocks;
+
+    thread_cache_get_counters(pool->pool_id, &cache_allocs, &cache_frees, &cache_requested);
+    nb_blocks = mem_get_nb_blocks_fast_pool(pool);
+    pthread_mutex_lock(&(pool->lock));
+    ps->nb_allocs = pool->counters.nb_allocs + cache_allocs;
+    ps->nb_frees = __atomic_load_n(&(pool->counters.nb_frees), __ATOMIC_RELAXED) + cache_frees;
+    ps->nb_failures = __atomic_load_n(&(pool->counters.nb_failures), __ATOMIC_RELAXED);
+    // The counters are read one after the other: a free may be seen before its allocation
+    in_use_blocks = (ps->nb_allocs > ps->nb_frees) ? ps->nb_allocs - ps->nb_frees : 0;
+    ps->in_use_bytes = in_use_blocks * pool->block_size;
+    if (ps->in_use_bytes > pool->counters.peak_bytes)
+    {
+        pool->counters.peak_bytes = ps->in_use_bytes;
+    }
+    ps->peak_bytes = pool->counters.peak_bytes;
+    ps->mapped_bytes = pool->counters.mapped_bytes;
+    *requested = pool->counters.requested_bytes + cache_requested;
+    pthread_mutex_unlock(&(pool->lock));
+
+    ps->nb_free_blocks = (nb_blocks > in_use_blocks) ? nb_blocks - in_use_blocks : 0;
+    ps->free_bytes = ps->nb_free_blocks * pool->block_size;
+    ps->largest_free_block = (ps->nb_free_blocks > 0) ? pool->block_size : 0;
+    *allocated = ps->nb_allocs * pool->block_size;
+}
+
+/* Statistics of a standard arena (pool lock held) */
+static void get_std_pool_stats(mem_pool_t *pool, mem_pool_stats_t *ps, uint64_t *requested, uint64_t *allocated)
+{
+    size_t nb_free_blocks;
+    size_t largest;
+    size_t total;
+
+    mem_get_free_blocks_standard_pool(pool, &nb_free_blocks, &largest, &total);
+    ps->nb_allocs = pool->counters.nb_allocs;
+    ps->nb_frees = pool->counters.nb_frees;
+    ps->nb_failures = __atomic_load_n(&(pool->counters.nb_failures), __ATOMIC_RELAXED);
+    ps->in_use_bytes = pool->counters.allocated_bytes - pool->counters.freed_bytes;
+    ps->peak_bytes = pool->counters.peak_bytes;
+    ps->mapped_bytes = pool->counters.mapped_bytes;
+    ps->nb_free_blocks = nb_free_blocks;
+    ps->free_bytes = total;
+    ps->largest_free_block = largest;
+    *requested = pool->counters.requested_bytes;
+    *allocated = pool->counters.allocated_bytes;
+}
+
+/* Statistics of the huge pool (its counters are updated atomically) */
+static void get_huge_pool_stats(mem_pool_t *pool, mem_pool_stats_t *ps, uint64_t *requested, uint64_t *allocated)
+{
+    uint64_t freed = __atomic_load_n(&(pool->counters.freed_bytes), __ATOMIC_RELAXED);
+
+    ps->nb_frees = __atomic_load_n(&(pool->counters.nb_frees), __ATOMIC_RELAXED);
+    ps->nb_allocs = __atomic_load_n(&(pool->counters.nb_allocs), __ATOMIC_RELAXED);
+    ps->nb_failures = __atomic_load_n(&(pool->counters.nb_failures), __ATOMIC_RELAXED);
+    *requested = __atomic_load_n(&(pool->counters.requested_bytes), __ATOMIC_RELAXED);
+    *allocated = __atomic_load_n(&(pool->counters.allocated_bytes), __ATOMIC_RELAXED);
+    ps->in_use_bytes = (*allocated > freed) ? *allocated - freed : 0;
+    ps->peak_bytes = __atomic_load_n(&(pool->counters.peak_bytes), __ATOMIC_RELAXED);
+    ps->mapped_bytes = __atomic_load_n(&(pool->counters.mapped_bytes), __ATOMIC_RELAXED);
+    // Each block has its own mapping: there is no free block
+    ps->nb_free_blocks = 0;
+    ps->free_bytes = 0;
+    ps->largest_free_block = 0;
+}
+
+void memory_get_stats(mem_stats_t *stats)
+{
+    mem_pool_stats_t *total = &(stats->total);
+    uint64_t total_requested = 0;
+    uint64_t total_allocated = 0;
+    uint64_t total_unusable = 0;
+    int i;
+
+    memset(stats, 0, sizeof(*stats));
+    total->name = "total";
+    total->pool_id = -1;
+    for (i = 0; i < NB_MEM_POOLS; i++)
+    {
+        mem_pool_t *pool = &(mem_pools[i]);
+        mem_pool_stats_t *ps = &(stats->pools[stats->nb_pools]);
+        uint64_t requested;
+        uint64_t allocated;
+        uint64_t unusable = 0;
+
+        switch (pool->pool_type)
+        {
+        case FAST_POOL:
+            get_fast_pool_stats(pool, ps, &requested, &allocated);
+            break;
+        case STANDARD_POOL:
+            if (!__atomic_load_n(&(std_arena_ready[i - FIRST_STD_POOL]), __ATOMIC_ACQUIRE))
+            {
+                continue;
+            }
+            pthread_mutex_lock(&(pool->lock));
+            get_std_pool_stats(pool, ps, &requested, &allocated);
+            pthread_mutex_unlock(&(pool->lock));
+            unusable = ps->free_bytes - ps->largest_free_block;
+            break;
+        case HUGE_POOL:
+            get_huge_pool_stats(pool, ps, &requested, &allocated);
+            break;
+        default: /* we should never reach this case */
+            assert(0);
+        }
+        ps->name = pool->pool_name;
+        ps->pool_id = pool->pool_id;
+        ps->pool_type = pool->pool_type;
+        // Any free block of a fast pool can serve any request of the pool
+        set_fragmentation(ps, requested, allocated, unusable);
+        stats->nb_pools++;
+
+        total->nb_allocs += ps->nb_allocs;
+        total->nb_frees += ps->nb_frees;
+        total->nb_failures += ps->nb_failures;
+        total->in_use_bytes += ps->in_use_bytes;
+        total->peak_bytes += ps->peak_bytes;
+        total->mapped_bytes += ps->mapped_bytes;
+        total->nb_free_blocks += ps->nb_free_blocks;
+        total->free_bytes += ps->free_bytes;
+        if (ps->largest_free_block > total->largest_free_block)
+        {
+            total->largest_free_block = ps->largest_free_block;
+        }
+        total_requested += requested;
+        total_allocated += allocated;
+        total_unusable += unusable;
+    }
+    set_fragmentation(total, total_requested, total_allocated, total_unusable);
+}
+
+void memory_print_stats(void)
+{
+    mem_stats_t stats;
+    int i;
+
+    memory_get_stats(&stats);
+    fprintf(stderr, "%-28s %12s %12s %8s %14s %14s %14s %10s %14s %14s %7s %7s\n",
+            "pool", "allocs", "frees", "failures", "in use", "peak", "mapped", "free blks", "free", "largest free", "int fr", "ext fr");
+    for (i = 0; i <= stats.nb_pools; i++)
+    {
+        mem_pool_stats_t *ps = (i < stats.nb_pools) ? &(stats.pools[i]) : &(stats.total);
+        fprintf(stderr, "%-28s %12" PRIu64 " %12" PRIu64 " %8" PRIu64 " %14" PRIu64 " %14" PRIu64 " %14" PRIu64 " %10" PRIu64 " %14" PRIu64 " %14" PRIu64 " %6.1f%% %6.1f%%\n",
+                ps->name, ps->nb_allocs, ps->nb_frees, ps->nb_failures, ps->in_use_bytes, ps->peak_bytes, ps->mapped_bytes,
+                ps->nb_free_blocks, ps->free_bytes, ps->largest_free_block, ps->internal_fragmentation * 100.0, ps->external_fragmentation * 100.0);
+    }
+}
+
 void print_mem_state(void){
+    //the blocks kept in the cache of this thread must be displayed as free
+    thread_cache_flush();
     //for each fast pool
-    for(int poolid=0; poolid<3;poolid++){
+    for(int poolid=0; poolid<NB_FAST_POOLS;poolid++){
+        mem_drain_remote_free_fast_pool(&(mem_pools[poolid]));
         printf("content of %s [",mem_pools[poolid].pool_name);
-        //initialize a char array to visualize the content of the pool
-        int memstatesize=mem_pools[poolid].pool_size/mem_pools[poolid].max_req_size;
-        char memstate[memstatesize];
-        //this pointer purpose is to read the pointers to the next block within the free blocks
-        long int *pointer_to_the_next_mem_block=mem_pools[poolid].first_free;
-        //fill the array as if each bock was allocated
-        for(int i=0; i<memstatesize; i++ ){ memstate[i]='#';}
-        //while the are free blocks
-        while(pointer_to_the_next_mem_block!=NULL){
-            //convert the adress read from pointer_to_the_next_mem_block into a index for mem
-            long int real_place_in_the_virtual_memory = (pointer_to_the_next_mem_block-(long int*)mem_pools[poolid].first_free)/(mem_pools[poolid].max_req_size/sizeof(long int)) ;
-            //mark the block as free in the representation
-            memstate[real_place_in_the_virtual_memory]='.';
-            //go to the next memory block (the adress contained in the current memory block)
-            pointer_to_the_next_mem_block=(long int*)*(long int*)pointer_to_the_next_mem_block;
-        }
-        //print the representation
-        for(int i=0; i<memstatesize;i++){
-            printf("%c",memstate[i]);
+        //display the slabs in the order in which they were mapped (the list starts with the most recent one)
+        int nb_slabs=0;
+        for(mem_fast_slab_t *slab=mem_pools[poolid].slabs; slab!=NULL; slab=slab->next){ nb_slabs++; }
+        for(int s=nb_slabs-1; s>=0; s--){
+            mem_fast_slab_t *slab=mem_pools[poolid].slabs;
+            for(int k=0; k<s; k++){ slab=slab->next; }
+            //initialize a char array to visualize the content of the slab
+            int memstatesize=(slab->end-slab->start)/mem_pools[poolid].block_size;
+            char memstate[memstatesize];
+            //fill the array as if each carved block was allocated (the other ones have never been used)
+            for(int i=0; i<memstatesize; i++ ){ memstate[i]=(slab->start+i*mem_pools[poolid].block_size < slab->carve)?'#':'.';}
+            //this pointer purpose is to read the pointers to the next block within the free blocks
+            mem_fast_free_block_t *pointer_to_the_next_mem_block=mem_pools[poolid].first_free;
+            //while the are free blocks
+            while(pointer_to_the_next_mem_block!=NULL){
+                //convert the adress of the free block into a index for mem (if it is in this slab)
+                char *block=(char*)pointer_to_the_next_mem_block;
+                if(block>=slab->start && block<slab->end){
+                    //mark the block as free in the representation
+                    memstate[(block-slab->start)/mem_pools[poolid].block_size]='.';
+                }
+                //go to the next memory block (the adress contained in the current memory block)
+                pointer_to_the_next_mem_block=pointer_to_the_next_mem_block->next;
+            }
+            //print the representation (slabs are separated by '|')
+            for(int i=0; i<memstatesize;i++){
+                printf("%c",memstate[i]);
+            }
+            if(s>0){ printf("|"); }
         }
         printf("]\n");
     } 
-    /*
-    9 is the maximum length to reprent a allocated block and the next free one in case of maximum usage
-    #1057#.1.
-    */
-    // string to store the display of the memory state
-    char memstate[9*mem_pools[3].pool_size/mem_pools[3].min_req_size];
-    int idx=0;
-    //pointer to the current block free and allocated
-    mem_std_free_block_t *current= (mem_std_free_block_t *) mem_pools[3].start_addr;
-    //while we didn't reach the end of the heap
-    while ((char*)current < (char*)mem_pools[3].end_addr){
-        if (is_block_free(&(current->header))){
-        // we display free memory blocks as ".size_of_the_free_block."
-        memstate[idx++]='.';
-        idx=write_int(get_block_size(&(current->header)),memstate,idx);
-        memstate[idx++]='.';
-        }else{
-        // we display allocated memory blocks as "#size_of_the_allocated_block#"
-        memstate[idx++]='#';
-        idx=write_int(get_block_size(&(current->header)),memstate,idx);
-        memstate[idx++]='#';
-        }
-        //we go to the next block wether the current one is free or allocated
-        current = (mem_std_free_block_t *)((char*)current+(get_block_size(&(current->header))+sizeof(mem_std_block_header_footer_t) * 2));
-    }
-    //print the representation
     printf("\ncontent of standard pool \n[");
-    for(int i=0; i<idx;i++){
-        printf("%c",memstate[i]);
+    //go to the first mapped segment (the list starts with the most recent one)
+    mem_std_segment_t *segment=mem_pools[FIRST_STD_POOL].segments;
+    while(segment!=NULL && segment->next!=NULL){ segment=segment->next; }
+    for(; segment!=NULL; segment=segment->prev){
+        //pointer to the current block free and allocated
+        mem_std_free_block_t *current= (mem_std_free_block_t *) segment->start;
+        //while we didn't reach the end of the segment
+        while ((char*)current < segment->end){
+            if (is_block_free(&(current->header))){
+            // we display free memory blocks as ".size_of_the_free_block."
+            printf(".%zu.",get_block_size(&(current->header)));
+            }else{
+            // we display allocated memory blocks as "#size_of_the_allocated_block#"
+            printf("#%zu#",get_block_size(&(current->header)));
+            }
+            //we go to the next block wether the current one is free or allocated
+            current = (mem_std_free_block_t *)get_next_block(&(current->header));
+        }
+        //segments are separated by '|'
+        if(segment->prev!=NULL){ printf("|"); }
     }
     printf("]\n");        
 }
@@ -312,14 +1084,45 @@ int write_int(size_t n, char str[], int idx){
     return idx;
 }
 
+/* Returns the offset of a block in its pool (the slabs or segments of a pool are numbered as if they were contiguous, huge blocks are at offset 0) */
+static size_t get_block_offset(int i, void *addr)
+{
+    const page_map_entry_t *e = page_map_lookup(addr);
+    if (mem_pools[i].pool_type == HUGE_POOL)
+    {
+        return 0; // Each huge block has its own mapping
+    }
+    if (mem_pools[i].pool_type == FAST_POOL)
+    {
+        mem_fast_slab_t *slab = (mem_fast_slab_t *)e->span;
+        return slab->offset + (size_t)((char *)addr - slab->start);
+    }
+    mem_std_segment_t *segment = (mem_std_segment_t *)e->span;
+    return segment->offset + (size_t)((char *)addr - segment->start);
+}
+
+/* The traces are printed on stderr, or logged in binary form (see mem_alloc_trace.h) */
 void print_free_info(void *addr)
 {
+    if (trace_mode == TRACE_NONE)
+    {
+        return;
+    }
     if (addr)
     {
         int i;
         i = find_pool_from_block_address(addr);
 
-        fprintf(stderr, "FREE  at : %lu -- pool %d\n", ULONG((char*)addr - (char*)mem_pools[i].start_addr), mem_pools[i].pool_id);
+        if (trace_mode == TRACE_BINARY)
+        {
+            trace_log(TRACE_FREE, mem_pools[i].pool_id, get_block_offset(i, addr), 0);
+            return;
+        }
+        fprintf(stderr, "FREE  at : %lu -- pool %d\n", ULONG(get_block_offset(i, addr)), mem_pools[i].pool_id);
+    }
+    else if (trace_mode == TRACE_BINARY)
+    {
+        trace_log(TRACE_FREE, TRACE_NO_POOL, 0, 0);
     }
     else
     {
@@ -329,13 +1132,22 @@ void print_free_info(void *addr)
 
 void print_alloc_info(void *addr, int size)
 {
+    if (trace_mode == TRACE_NONE)
+    {
+        return;
+    }
     if (addr)
     {
         int i;
         i = find_pool_from_block_address(addr);
 
+        if (trace_mode == TRACE_BINARY)
+        {
+            trace_log(TRACE_ALLOC, mem_pools[i].pool_id, get_block_offset(i, addr), size);
+            return;
+        }
         fprintf(stderr, "ALLOC at : %lu (%d byte(s)) -- pool %d\n",
-                ULONG((char*)addr - (char*)mem_pools[i].start_addr), size, mem_pools[i].pool_id);
+                ULONG(get_block_offset(i, addr)), size, mem_pools[i].pool_id);
     }
     else
     {
@@ -343,8 +1155,13 @@ void print_alloc_info(void *addr, int size)
     }
 }
 
+/* The errors are always printed (they end the process) */
 void print_alloc_error(int size)
 {
+    if (trace_mode == TRACE_BINARY)
+    {
+        trace_log(TRACE_ALLOC_ERROR, 0, 0, size);
+    }
     fprintf(stderr, "ALLOC error : can't allocate %d bytes\n", size);
 }
 
@@ -1,6 +1,7 @@
 #ifndef   	_MEM_ALLOC_H_
 #define   	_MEM_ALLOC_H_
 
+#include <stdint.h>
 #include <stdlib.h>
 
 
@@ -12,6 +13,79 @@ void *memory_alloc(size_t size);
 void memory_free(void *p);
 size_t memory_get_allocated_block_size(void *addr);
 
+/* Allocates a block whose payload is aligned on alignment bytes (a non-zero power of two, checked by an assertion) */
+void *memory_alloc_aligned(size_t alignment, size_t size);
+
+/*
+ * Allocates a block of nmemb * size bytes holding zeros (or returns NULL if the
+ * product overflows). Only the memory that may not hold zeros is cleared.
+ */
+void *memory_calloc(size_t nmemb, size_t size);
+
+/*
+ * Resizes an allocated block, in place if possible (otherwise, its contents are copied
+ * to a new block). Returns the address of the block, or NULL if there is not enough memory
+ * (the block is then left untouched).
+ */
+void *memory_realloc(void *p, size_t size);
+
+/*
+ * Gives back to the OS the free memory of all the pools (the pages located inside the free
+ * blocks of the standard pools, and the slabs of the fast pools whose blocks are all free),
+ * without waiting for the periodic purge passes. Returns the number of bytes purged.
+ */
+size_t memory_trim(void);
+
+/* Returns the id of the pool in charge of a given block (or -1 if the block does not belong to any pool) */
+int find_pool_from_block_address(void *addr);
+
+/*
+ * Statistics of a pool. The sizes are payload sizes (the headers are not counted),
+ * except mapped_bytes. A reallocation in place counts as a free followed by an allocation.
+ */
+typedef struct mem_pool_stats {
+    const char *name;
+    int pool_id;
+    int pool_type;               /* FAST_POOL, STANDARD_POOL or HUGE_POOL */
+    uint64_t nb_allocs;
+    uint64_t nb_frees;
+    uint64_t nb_failures;
+    uint64_t in_use_bytes;       /* size of the allocated blocks */
+    uint64_t peak_bytes;         /* largest in_use_bytes (fast pools: sampled when the statistics are read) */
+    uint64_t mapped_bytes;       /* memory mapped by the pool, metadata and purged pages included */
+    uint64_t nb_free_blocks;     /* fast pools: the blocks kept by the thread caches and never carved count as free */
+    uint64_t free_bytes;
+    uint64_t largest_free_block;
+    double internal_fragmentation; /* 1 - requested size / allocated size (cumulative, over all the allocations) */
+    double external_fragmentation; /* share of the free memory that is not in the largest free block (0 for the fast and huge pools) */
+} mem_pool_stats_t;
+
+/* Maximum number of pools described by memory_get_stats */
+#define MEM_STATS_MAX_POOLS 64
+
+typedef struct mem_stats {
+    int nb_pools;                                 /* pools in use (the standard arenas never used are skipped) */
+    mem_pool_stats_t pools[MEM_STATS_MAX_POOLS];
+    mem_pool_stats_t total;                       /* sums (peak_bytes: sum of the peaks), fragmentation of the whole allocator */
+} mem_stats_t;
+
+/*
+ * Fills stats with the statistics of all the pools. The counters are always kept up to date
+ * (by the thread caches, or under the pool locks): reading them takes the locks of the
+ * standard arenas to walk their free lists. Does not allocate memory.
+ */
+void memory_get_stats(mem_stats_t *stats);
+
+/* Prints the statistics of all the pools on stderr (done at exit with MEMALLOC_CONF=stats_print=1) */
+void memory_print_stats(void);
+
+/*
+ * Writes the profile of the sampled allocations (MEMALLOC_CONF=prof_sample=..., see mem_alloc_prof.h)
+ * to path, or to <prefix>.<pid>.<number of the dump>.heap if path is NULL (done at exit).
+ * Returns 0 on success, -1 otherwise (the profiler is off, or the file cannot be written).
+ */
+int memory_dump_profile(const char *path);
+
 
 /////////////////////////////////////////////////////////
 /* Functions for testing and debugging: */
@@ -54,6 +128,7 @@ extern void* (*o_malloc)(size_t);
 extern void (*o_free)(void *);
 extern void* (*o_realloc)(void*, size_t);
 extern void* (*o_calloc)(size_t, size_t);
+extern size_t (*o_malloc_usable_size)(void *);
 
 /////////////////////////////////////////////////////////
 
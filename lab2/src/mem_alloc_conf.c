@@ -0,0 +1,262 @@
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <strings.h>
+
+#include "mem_alloc_conf.h"
+#include "my_mmap.h"
+
+/* Parses a size (with an optional K, M or G suffix); returns 0 on success */
+static int parse_size(const char *value, size_t *res)
+{
+    char *end;
+    unsigned long long n;
+    int shift = 0;
+
+    // strtoull saturates on overflow
+    errno = 0;
+    n = strtoull(value, &end, 10);
+    if (end == value || value[0] == '-' || errno == ERANGE)
+    {
+        return -1;
+    }
+    if (*end == 'K' || *end == 'k')
+    {
+        shift = 10;
+        end++;
+    }
+    else if (*end == 'M' || *end == 'm')
+    {
+        shift = 20;
+        end++;
+    }
+    else if (*end == 'G' || *end == 'g')
+    {
+        shift = 30;
+        end++;
+    }
+    if (*end != '\0' || n > (SIZE_MAX >> shift))
+    {
+        return -1;
+    }
+    *res = (size_t)n << shift;
+    return 0;
+}
+
+/* Parses a duration in milliseconds (with an optional ms or s suffix); returns 0 on success */
+static int parse_duration_ms(const char *value, uint64_t *res)
+{
+    char *end;
+    unsigned long long n;
+
+    // strtoull saturates on overflow
+    errno = 0;
+    n = strtoull(value, &end, 10);
+    if (end == value || value[0] == '-' || errno == ERANGE)
+    {
+        return -1;
+    }
+    if (strcmp(end, "s") == 0)
+    {
+        if (n > UINT64_MAX / 1000)
+        {
+            return -1;
+        }
+        n *= 1000;
+    }
+    else if (*end != '\0' && strcmp(end, "ms") != 0)
+    {
+        return -1;
+    }
+    *res = n;
+    return 0;
+}
+
+/* Applies one setting; returns 0 on success */
+static int apply_setting(mem_alloc_conf_t *conf, const char *key, size_t key_len, const char *value)
+{
+    size_t n;
+
+    if (key_len == 5 && strncmp(key, "pool", 4) == 0 && key[4] >= '0' && key[4] < '0' + CONF_NB_POOL_SIZES)
+    {
+        if (parse_size(value, &n) != 0 || n < OS_BASE_PAGE_SIZE)
+        {
+            return -1;
+        }
+        conf->pool_sizes[key[4] - '0'] = n;
+        return 0;
+    }
+    if (key_len == 6 && strncmp(key, "policy", key_len) == 0)
+    {
+        if (strcasecmp(value, "FF") == 0)
+        {
+            conf->policy = FIRST_FIT;
+        }
+        else if (strcasecmp(value, "BF") == 0)
+        {
+            conf->policy = BEST_FIT;
+        }
+        else if (strcasecmp(value, "NF") == 0)
+        {
+            conf->policy = NEXT_FIT;
+        }
+        else if (strcasecmp(value, "SF") == 0)
+        {
+            conf->policy = SEGREGATED_FIT;
+        }
+        else if (strcasecmp(value, "TLSF") == 0)
+        {
+            conf->policy = TLSF;
+        }
+        else
+        {
+            return -1;
+        }
+        return 0;
+    }
+    if (key_len == 5 && strncmp(key, "align", key_len) == 0)
+    {
+        if (parse_size(value, &n) != 0 || n == 0 || n > STD_MAX_ALIGN || (n & (n - 1)) != 0)
+        {
+            return -1;
+        }
+        conf->align = n;
+        return 0;
+    }
+    if (key_len == 11 && strncmp(key, "purge_decay", key_len) == 0)
+    {
+        return parse_duration_ms(value, &(conf->purge_decay_ms));
+    }
+    if (key_len == 13 && strncmp(key, "arena_binding", key_len) == 0)
+    {
+        if (strcasecmp(value, "RR") == 0)
+        {
+            conf->arena_binding = ARENA_ROUND_ROBIN;
+        }
+        else if (strcasecmp(value, "CPU") == 0)
+        {
+            conf->arena_binding = ARENA_PER_CPU;
+        }
+        else
+        {
+            return -1;
+        }
+        return 0;
+    }
+    if (key_len == 10 && strncmp(key, "huge_pages", key_len) == 0)
+    {
+        if (strcasecmp(value, "NONE") == 0)
+        {
+            conf->huge_pages = HUGE_PAGES_NONE;
+        }
+        else if (strcasecmp(value, "THP") == 0)
+        {
+            conf->huge_pages = HUGE_PAGES_THP;
+        }
+        else if (strcasecmp(value, "HUGETLB") == 0)
+        {
+            conf->huge_pages = HUGE_PAGES_HUGETLB;
+        }
+        else
+        {
+            return -1;
+        }
+        return 0;
+    }
+    if (key_len == 11 && strncmp(key, "stats_print", key_len) == 0)
+    {
+        if (strcmp(value, "0") != 0 && strcmp(value, "1") != 0)
+        {
+            return -1;
+        }
+        conf->stats_print = (value[0] == '1');
+        return 0;
+    }
+    if (key_len == 5 && strncmp(key, "trace", key_len) == 0)
+    {
+        if (strcasecmp(value, "TEXT") == 0)
+        {
+            conf->trace = TRACE_TEXT;
+        }
+        else if (strcasecmp(value, "BINARY") == 0)
+        {
+            conf->trace = TRACE_BINARY;
+        }
+        else if (strcasecmp(value, "NONE") == 0)
+        {
+            conf->trace = TRACE_NONE;
+        }
+        else
+        {
+            return -1;
+        }
+        return 0;
+    }
+    if (key_len == 10 && strncmp(key, "trace_file", key_len) == 0)
+    {
+        if (value[0] == '\0')
+        {
+            return -1;
+        }
+        strcpy(conf->trace_file, value); // Shorter than CONF_MAX_VALUE
+        return 0;
+    }
+    if (key_len == 11 && strncmp(key, "prof_sample", key_len) == 0)
+    {
+        return parse_size(value, &(conf->prof_sample));
+    }
+    if (key_len == 11 && strncmp(key, "prof_prefix", key_len) == 0)
+    {
+        if (value[0] == '\0')
+        {
+            return -1;
+        }
+        strcpy(conf->prof_prefix, value); // Shorter than CONF_MAX_VALUE
+        return 0;
+    }
+    return -1; // Unknown key
+}
+
+int mem_alloc_conf_parse(mem_alloc_conf_t *conf, const char *str)
+{
+    int nb_errors = 0;
+    int saved_errno = errno; // Called from malloc, which must not modify errno on success
+
+    while (*str != '\0')
+    {
+        const char *end = strchr(str, ',');
+        const char *eq;
+        char value[CONF_MAX_VALUE];
+        size_t len;
+
+        if (end == NULL)
+        {
+            end = str + strlen(str);
+        }
+        len = (size_t)(end - str);
+        eq = memchr(str, '=', len);
+
+        // The settings are parsed without allocating memory: the value is copied to the stack
+        if (len > 0)
+        {
+            if (eq == NULL || (size_t)(end - eq - 1) >= CONF_MAX_VALUE)
+            {
+                nb_errors++;
+                fprintf(stderr, "%s: invalid setting '%.*s' (ignored)\n", MEMALLOC_CONF_ENV, (int)len, str);
+            }
+            else
+            {
+                memcpy(value, eq + 1, (size_t)(end - eq - 1));
+                value[end - eq - 1] = '\0';
+                if (apply_setting(conf, str, (size_t)(eq - str), value) != 0)
+                {
+                    nb_errors++;
+                    fprintf(stderr, "%s: invalid setting '%.*s' (ignored)\n", MEMALLOC_CONF_ENV, (int)len, str);
+                }
+            }
+        }
+        str = (*end == ',') ? end + 1 : end;
+    }
+    errno = saved_errno;
+    return nb_errors;
+}
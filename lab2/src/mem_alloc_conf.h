@@ -0,0 +1,77 @@
+#ifndef   	_MEM_ALLOC_CONF_H_
+#define   	_MEM_ALLOC_CONF_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "mem_alloc_standard_pool.h"
+#include "mem_alloc_trace.h"
+
+/*
+ * Runtime configuration.
+ *
+ * The properties chosen at build time (see Makefile.config) are the defaults.
+ * They can be overridden when the allocator is initialized by the environment
+ * variable MEMALLOC_CONF: a comma-separated list of key=value settings, e.g.
+ *     MEMALLOC_CONF=pool3=64M,policy=BF,align=16,purge_decay=10s
+ *
+ *   pool0 .. pool3   size of the pools (MEM_POOL_0_SIZE .. MEM_POOL_3_SIZE),
+ *                    in bytes, with an optional K, M or G suffix
+ *   policy           placement policy of the standard pools: FF, BF, NF, SF or TLSF
+ *   align            alignment of the standard payloads: 1, 2, 4, 8 or 16
+ *   purge_decay      PURGE_DECAY_MS, in milliseconds, with an optional ms or s suffix
+ *   arena_binding    STD_ARENA_BINDING: RR or CPU
+ *   huge_pages       HUGE_PAGES: NONE, THP or HUGETLB
+ *   stats_print      1 to print the statistics of the pools at exit (see memory_print_stats), 0 otherwise
+ *   trace            TRACE_MODE: TEXT, BINARY or NONE (see mem_alloc_trace.h)
+ *   trace_file       file of the binary traces (memalloc.<pid>.trace by default)
+ *   prof_sample      PROF_SAMPLE: mean number of bytes between two samples of the heap profiler
+ *                    (see mem_alloc_prof.h), with an optional K, M or G suffix, 0 to disable it
+ *   prof_prefix      prefix of the heap profiles (memalloc by default)
+ *
+ * The invalid settings are reported on stderr and ignored.
+ */
+
+/* Name of the environment variable */
+#define MEMALLOC_CONF_ENV "MEMALLOC_CONF"
+
+/* Longest value accepted in a setting (the trace file name and profile prefix included) */
+#define CONF_MAX_VALUE 256
+
+/* Number of pool sizes that can be set (fast pools 0 to 2 and standard pools) */
+#define CONF_NB_POOL_SIZES 4
+
+/*
+ * Each thread is bound to a home standard arena, either once and for all
+ * (round-robin, in the order in which the threads first use a standard pool)
+ * or according to the CPU it is running on.
+ */
+typedef enum
+{
+    ARENA_ROUND_ROBIN = 1,
+    ARENA_PER_CPU = 2
+} std_arena_binding_t;
+
+typedef struct mem_alloc_conf
+{
+    size_t pool_sizes[CONF_NB_POOL_SIZES];
+    std_pool_placement_policy_t policy;
+    size_t align;
+    uint64_t purge_decay_ms;
+    std_arena_binding_t arena_binding;
+    int huge_pages; /* HUGE_PAGES_NONE, HUGE_PAGES_THP or HUGE_PAGES_HUGETLB */
+    int stats_print;
+    trace_mode_t trace;
+    char trace_file[CONF_MAX_VALUE];
+    size_t prof_sample;
+    char prof_prefix[CONF_MAX_VALUE];
+} mem_alloc_conf_t;
+
+/*
+ * Applies the settings of a configuration string to conf (the properties that are not set
+ * keep their value). Does not allocate memory (called by memory_init).
+ * Returns the number of invalid settings.
+ */
+int mem_alloc_conf_parse(mem_alloc_conf_t *conf, const char *str);
+
+#endif      /* !_MEM_ALLOC_CONF_H_ */
@@ -2,91 +2,375 @@
 #include <stdio.h>
 
 #include "mem_alloc_fast_pool.h"
+#include "mem_alloc_page_map.h"
+#include "mem_alloc_stats.h"
 #include "mem_alloc.h"
 #include "my_mmap.h"
 
-void init_fast_pool(mem_pool_t *p, size_t size, size_t min_request_size, size_t max_request_size)
-{
-    size_t block_size;
-    size_t nb_blocks;
-
-    switch (p->pool_id)
-    {
-    case 0:
-        block_size = 64; // Pool 0 block size is 64 bytes
-        break;
-    case 1:
-        block_size = 256; // Pool 1 block size is 256 bytes
-        break;
-    case 2:
-        block_size = 1024; // Pool 2 block size is 1024 bytes
-        break;
-    default:
-        printf("Error: Unsupported pool id\n");
-        return;
-    }
+/*
+ * Slabs:
+ * a fast pool is made of slabs of pool_size bytes, mapped one at a time
+ * (the first one by init_fast_pool, the other ones when the pool is exhausted).
+ * Each slab is described by a trailer located right after its last block, so that
+ * the blocks of the first slab start at the beginning of the pool (start_addr).
+ * The blocks of a slab are carved lazily, in address order: the free list only
+ * holds blocks that have already been used once. Slabs are carved from the newest
+ * to the oldest one (a purged slab can be carved again, see mem_purge_fast_pool).
+ */
 
-    // Calculate the number of blocks in the pool
-    nb_blocks = size / block_size;
+/* Maps a new slab and puts it at the head of the list of slabs of the pool (pool lock held) */
+static mem_fast_slab_t *add_fast_slab(mem_pool_t *p)
+{
+    mem_fast_slab_t *newest = (mem_fast_slab_t *)p->slabs;
+    size_t nb_blocks = p->pool_size / p->block_size;
+    size_t span = nb_blocks * p->block_size;
+    mem_fast_slab_t *slab;
 
-    // Allocate memory for the pool using my_mmap
-    void *address = my_mmap(size);
+    // Allocate memory for the slab (and its trailer) using my_mmap
+    char *address = my_mmap(span + sizeof(mem_fast_slab_t));
     if (address == NULL)
     {
         perror("Memory allocation failed");
-        return;
+        return NULL;
+    }
+
+    slab = (mem_fast_slab_t *)(address + span);
+    slab->start = address;
+    slab->end = address + span;
+    slab->carve = address;
+    // The pages of a new mapping hold zeros
+    slab->zero_start = PURGED_PAGES_ARE_ZERO ? slab->start : slab->end;
+    slab->zero_end = slab->end;
+    slab->offset = (newest != NULL) ? newest->offset + (size_t)(newest->end - newest->start) : 0;
+    slab->nb_free = 0;
+    slab->aged = 0;
+    slab->next = newest;
+    if (page_map_register(slab->start, slab->end, p, slab) != 0)
+    {
+        my_munmap(address, span + sizeof(mem_fast_slab_t));
+        return NULL;
+    }
+    // print_mem_state reads the list without the lock
+    __atomic_store_n(&(p->slabs), slab, __ATOMIC_RELEASE);
+    p->carve_slab = slab;
+    p->counters.mapped_bytes += span + sizeof(mem_fast_slab_t);
+
+    debug_printf("Fast pool %d: new slab with %zu blocks of size %zu bytes\n", p->pool_id, nb_blocks, p->block_size);
+    return slab;
+}
+
+/*
+ * Returns a never used block, from the newest slab having one or from a new slab if they are all exhausted (pool lock held).
+ * *fresh (if not NULL) is set to 1 if the block holds zeros.
+ */
+static void *carve_fast_block(mem_pool_t *p, int *fresh)
+{
+    mem_fast_slab_t *slab = (mem_fast_slab_t *)p->carve_slab;
+    void *b;
+
+    while (slab != NULL && slab->carve >= slab->end)
+    {
+        slab = slab->next;
     }
+    p->carve_slab = slab;
+    if (slab == NULL)
+    {
+        slab = add_fast_slab(p);
+        if (slab == NULL)
+        {
+            return NULL;
+        }
+    }
+    b = slab->carve;
+    slab->carve += p->block_size;
+    if (fresh != NULL)
+    {
+        *fresh = ((char *)b >= slab->zero_start && slab->carve <= slab->zero_end);
+    }
+    return b;
+}
+
+void init_fast_pool(mem_pool_t *p, size_t size, size_t min_request_size, size_t max_request_size)
+{
+    mem_fast_slab_t *slab;
+
+    // The blocks have the size of the largest request served by the pool (see the size classes in mem_alloc.c)
+    p->block_size = max_request_size;
 
-    // Initialize the pool
-    p->start_addr = address;                        // Start of the memory region
-    p->end_addr = (void *)((char *)address + size); // End of the memory region
     p->pool_size = size;
     p->min_req_size = min_request_size;
     p->max_req_size = max_request_size;
-    p->first_free = address; // Initialize the free list with the first block
+    p->first_free = NULL; // The blocks are carved from the slabs when needed
+    p->remote_free = NULL;
+    p->slabs = NULL;
+    p->carve_slab = NULL;
+    pthread_mutex_init(&(p->lock), NULL);
 
-    // Link each block in the pool to form the free list
-    for (size_t i = 0; i < nb_blocks - 1; i++)
+    slab = add_fast_slab(p);
+    if (slab == NULL)
     {
-        void *current_block = (void *)((char *)address + (i * block_size));
-        void *next_block = (void *)((char *)current_block + block_size);
-
-        // Store the pointer to the next free block inside the current block
-        *(void **)current_block = next_block;
+        return;
     }
 
-    // The last block points to NULL
-    void *last_block = (void *)((char *)address + ((nb_blocks - 1) * block_size));
-    *(void **)last_block = NULL;
+    // The first slab defines the pool bounds (used as a reference for the traces)
+    p->start_addr = slab->start;
+    p->end_addr = slab->end;
+}
+
+/*
+ * Remote frees:
+ * blocks are freed without taking the pool lock, by pushing them (or whole chains of blocks)
+ * onto a lock-free stack (pool->remote_free). The owner of the lock (i.e., the thread allocating
+ * from the pool) takes the whole stack at once with an atomic exchange and puts it on top of
+ * the free list. As blocks are never popped individually from the lock-free stack, a push can
+ * not suffer from the ABA problem: if the head has been taken and pushed again in the meantime,
+ * linking the chain in front of it is still correct.
+ */
 
-    printf("Fast pool initialized with %zu blocks of size %zu bytes\n", nb_blocks, block_size);
+/* Pushes the chain first..last onto the remote free stack of the pool */
+static void push_remote_free(mem_pool_t *pool, mem_fast_free_block_t *first, mem_fast_free_block_t *last)
+{
+    void *head = __atomic_load_n(&(pool->remote_free), __ATOMIC_RELAXED);
+    do
+    {
+        last->next = head;
+    } while (!__atomic_compare_exchange_n(&(pool->remote_free), &head, first, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
 }
 
-void *mem_alloc_fast_pool(mem_pool_t *pool, size_t size)
+/*
+ * Moves the blocks of the remote free stack on top of the free list.
+ * The pool lock must be held.
+ * Note: the remote stack holds the most recently freed blocks, so the LIFO order is preserved.
+ */
+static void drain_remote_free(mem_pool_t *pool)
 {
-    // Check the requested size
-    if (size > pool->max_req_size || size < pool->min_req_size)
+    mem_fast_free_block_t *first;
+    mem_fast_free_block_t *last;
+
+    if (__atomic_load_n(&(pool->remote_free), __ATOMIC_RELAXED) == NULL)
     {
-        printf("Error: Requested size out of bounds for this pool\n");
-        return NULL;
+        return;
+    }
+    first = __atomic_exchange_n(&(pool->remote_free), NULL, __ATOMIC_ACQUIRE);
+    if (first == NULL)
+    {
+        return;
     }
-    // Check if the free list is empty
-    if (pool->first_free == NULL)
+    last = first;
+    while (last->next != NULL)
     {
-        return NULL; // No free blocks available in this pool
+        last = last->next;
+    }
+    last->next = pool->first_free;
+    pool->first_free = first;
+}
+
+void *mem_alloc_fast_pool(mem_pool_t *pool, size_t size)
+{
+    // Check the requested size (an aligned request may be smaller, served by a pool of a larger size class)
+    if (size > pool->max_req_size)
+    {
+        debug_printf("Error: Requested size out of bounds for this pool\n");
+        return NULL;
     }
 
+    pthread_mutex_lock(&(pool->lock));
+    drain_remote_free(pool);
     // Allocate the first block from the free list and update it
+    // (or a new block if the free list is empty, NULL if no more memory can be mapped)
     void *allocated_block = pool->first_free;
-    pool->first_free = *(void **)allocated_block;
+    if (allocated_block != NULL)
+    {
+        pool->first_free = *(void **)allocated_block;
+    }
+    else
+    {
+        allocated_block = carve_fast_block(pool, NULL);
+    }
+    if (allocated_block != NULL)
+    {
+        stats_count_alloc(&(pool->counters), size, pool->block_size);
+    }
+    pthread_mutex_unlock(&(pool->lock));
 
     return allocated_block;
 }
 
 void mem_free_fast_pool(mem_pool_t *pool, void *b)
 {
-    *(void **)b = pool->first_free; // The current first free block is now after this one
-    pool->first_free = b;           // The freed block becomes the new first free block
+    // The freed block will be the first one of the free list after the next drain
+    stats_count_free_atomic(&(pool->counters), pool->block_size);
+    push_remote_free(pool, b, b);
+}
+
+size_t mem_alloc_fast_pool_batch(mem_pool_t *pool, void **chain, size_t n, size_t *nb_fresh)
+{
+    mem_fast_free_block_t *head;
+    mem_fast_free_block_t *last = NULL;
+    size_t count = 0;
+    int fresh;
+
+    pthread_mutex_lock(&(pool->lock));
+    drain_remote_free(pool);
+    // Detach the n first blocks of the free list, keeping their order
+    head = (mem_fast_free_block_t *)pool->first_free;
+    mem_fast_free_block_t *b = head;
+    while (b != NULL && count < n)
+    {
+        last = b;
+        b = b->next;
+        count++;
+    }
+    pool->first_free = b;
+    *nb_fresh = 0;
+    // Complete the batch with new blocks (they come after the free ones, in address order)
+    while (count < n)
+    {
+        b = carve_fast_block(pool, &fresh);
+        if (b == NULL)
+        {
+            break;
+        }
+        // Only the blocks at the end of the chain are counted (those of a partially purged page are not fresh)
+        *nb_fresh = fresh ? *nb_fresh + 1 : 0;
+        if (last != NULL)
+        {
+            last->next = b;
+        }
+        else
+        {
+            head = b;
+        }
+        last = b;
+        count++;
+    }
+    if (last != NULL)
+    {
+        last->next = NULL;
+    }
+    pthread_mutex_unlock(&(pool->lock));
+
+    *chain = (count > 0) ? head : NULL;
+    return count;
+}
+
+void mem_free_fast_pool_batch(mem_pool_t *pool, void *first, void *last)
+{
+    // The chain is put back on top of the free list (at the next drain), as if its blocks had been freed one by one
+    push_remote_free(pool, first, last);
+}
+
+void mem_drain_remote_free_fast_pool(mem_pool_t *pool)
+{
+    pthread_mutex_lock(&(pool->lock));
+    drain_remote_free(pool);
+    pthread_mutex_unlock(&(pool->lock));
+}
+
+/*
+ * Purging:
+ * the free blocks are counted per slab (the remote free stack is drained first, the blocks
+ * kept by the thread caches count as used). A slab whose carved blocks are all in the free
+ * list is purged: its blocks are removed from the list, its pages (but the one of the trailer)
+ * are given back to the OS and it is carved again from its first block.
+ */
+size_t mem_purge_fast_pool(mem_pool_t *pool, int force)
+{
+    mem_fast_slab_t *slab;
+    mem_fast_free_block_t **link;
+    size_t nb_purged_slabs = 0;
+    size_t purged = 0;
+
+    pthread_mutex_lock(&(pool->lock));
+    drain_remote_free(pool);
+
+    for (slab = (mem_fast_slab_t *)pool->slabs; slab != NULL; slab = slab->next)
+    {
+        slab->nb_free = 0;
+    }
+    for (mem_fast_free_block_t *b = (mem_fast_free_block_t *)pool->first_free; b != NULL; b = b->next)
+    {
+        ((mem_fast_slab_t *)page_map_lookup(b)->span)->nb_free++;
+    }
+
+    // Select the slabs to purge (marked with nb_free == 0 and aged == 1)
+    for (slab = (mem_fast_slab_t *)pool->slabs; slab != NULL; slab = slab->next)
+    {
+        size_t nb_carved = (size_t)(slab->carve - slab->start) / pool->block_size;
+        if (nb_carved == 0 || slab->nb_free != nb_carved)
+        {
+            slab->aged = 0;
+            slab->nb_free = 1;
+        }
+        else if (!force && !slab->aged)
+        {
+            slab->aged = 1;
+            slab->nb_free = 1;
+        }
+        else
+        {
+            slab->nb_free = 0;
+            nb_purged_slabs++;
+        }
+    }
+
+    if (nb_purged_slabs > 0)
+    {
+        // Unlink the blocks of the purged slabs, keeping the order of the other ones
+        link = (mem_fast_free_block_t **)&(pool->first_free);
+        while (*link != NULL)
+        {
+            slab = (mem_fast_slab_t *)page_map_lookup(*link)->span;
+            if (slab->nb_free == 0)
+            {
+                *link = (*link)->next;
+            }
+            else
+            {
+                link = &((*link)->next);
+            }
+        }
+        for (slab = (mem_fast_slab_t *)pool->slabs; slab != NULL; slab = slab->next)
+        {
+            if (slab->nb_free == 0)
+            {
+                size_t span = (size_t)(slab->end - slab->start);
+                size_t n = my_madvise_free(slab->start, span, span + sizeof(mem_fast_slab_t));
+                // Only the whole pages purged hold zeros (the blocks at both ends may share a page with the trailer, or with nothing purged)
+                if (PURGED_PAGES_ARE_ZERO && n > 0)
+                {
+                    my_madvise_range(slab->start, span, span + sizeof(mem_fast_slab_t), &(slab->zero_start), &(slab->zero_end));
+                }
+                else
+                {
+                    slab->zero_start = slab->end;
+                    slab->zero_end = slab->end;
+                }
+                purged += n;
+                slab->carve = slab->start;
+                slab->aged = 0;
+            }
+        }
+        // The purged slabs may be older than the one being carved
+        pool->carve_slab = pool->slabs;
+    }
+    pthread_mutex_unlock(&(pool->lock));
+
+    debug_printf("Fast pool %d: %zu slabs purged (%zu bytes)\n", pool->pool_id, nb_purged_slabs, purged);
+    return purged;
+}
+
+size_t mem_get_nb_blocks_fast_pool(mem_pool_t *pool)
+{
+    mem_fast_slab_t *slab;
+    size_t nb_blocks = 0;
+
+    // The slabs are never unmapped, their list can be read without the lock
+    for (slab = __atomic_load_n(&(pool->slabs), __ATOMIC_ACQUIRE); slab != NULL; slab = slab->next)
+    {
+        nb_blocks += (size_t)(slab->end - slab->start) / pool->block_size;
+    }
+    return nb_blocks;
 }
 
 size_t mem_get_allocated_block_size_fast_pool(mem_pool_t *pool, void *addr)
@@ -95,3 +379,4 @@ size_t mem_get_allocated_block_size_fast_pool(mem_pool_t *pool, void *addr)
     res = pool->max_req_size;
     return res;
 }
+
@@ -11,10 +11,49 @@ typedef struct mem_fast_free_block{
 } mem_fast_free_block_t;
 
 
+/* Structure declaration for the trailer of a slab (located right after its last block) */
+typedef struct mem_fast_slab{
+    struct mem_fast_slab *next; /* previously mapped slab of the pool */
+    char *start;                /* first block */
+    char *end;                  /* end of the last block */
+    char *carve;                /* first never used block */
+    char *zero_start;           /* the blocks carved inside [zero_start, zero_end) hold zeros */
+    char *zero_end;             /* (never touched, or purged pages) */
+    size_t offset;              /* position of the slab in the pool (sum of the sizes of the previous slabs) */
+    size_t nb_free;             /* number of blocks in the free list (computed by the purge passes) */
+    int aged;                   /* 1 if the slab was entirely free at the previous purge pass */
+} mem_fast_slab_t;
+
+
 /* Functions for the management of a fast pool */
 void init_fast_pool(mem_pool_t *p, size_t size, size_t min_request_size, size_t max_request_size);
 void *mem_alloc_fast_pool(mem_pool_t *pool, size_t size);
 void mem_free_fast_pool(mem_pool_t *pool, void *b);
 size_t mem_get_allocated_block_size_fast_pool(mem_pool_t *pool, void *addr);
 
+/*
+ * Batched transfers used by the per-thread caches.
+ * mem_alloc_fast_pool_batch detaches up to n blocks from the head of the free list
+ * (one lock acquisition), stores them as a NULL-terminated chain in *chain and returns
+ * how many were taken. The last *nb_fresh blocks of the chain have never been used since
+ * their pages were mapped or purged: they hold zeros, except their link to the next block.
+ * mem_free_fast_pool_batch puts back the chain first..last on top of the free list
+ * (lock-free, like mem_free_fast_pool: see the remote free stack in mem_alloc_fast_pool.c).
+ */
+size_t mem_alloc_fast_pool_batch(mem_pool_t *pool, void **chain, size_t n, size_t *nb_fresh);
+void mem_free_fast_pool_batch(mem_pool_t *pool, void *first, void *last);
+
+/* Moves the blocks freed without the pool lock to the free list (done anyway by the next allocation) */
+void mem_drain_remote_free_fast_pool(mem_pool_t *pool);
+
+/*
+ * Gives back to the OS the pages of the slabs whose blocks are all free (takes the pool lock).
+ * Their blocks leave the free list and are carved again when needed. If force is 0, a slab is
+ * only purged if it was already entirely free at the previous pass. Returns the number of bytes purged.
+ */
+size_t mem_purge_fast_pool(mem_pool_t *pool, int force);
+
+/* Returns the number of blocks of the slabs of the pool (used, free or never carved) */
+size_t mem_get_nb_blocks_fast_pool(mem_pool_t *pool);
+
 #endif      /* !_MEM_ALLOC_FAST_POOL_H_ */
@@ -0,0 +1,195 @@
+#include <stdio.h>
+#include <stdint.h>
+
+#include "mem_alloc_huge_pool.h"
+#include "mem_alloc_page_map.h"
+#include "mem_alloc_stats.h"
+#include "my_mmap.h"
+
+/* Returns the header of a huge block given its payload */
+static mem_huge_block_t *get_huge_block(void *addr)
+{
+    return (mem_huge_block_t *)addr - 1;
+}
+
+void init_huge_pool(mem_pool_t *p, size_t min_request_size, size_t max_request_size)
+{
+    // There is no memory mapped in advance: each block has its own mapping
+    p->pool_size = 0;
+    p->min_req_size = min_request_size;
+    p->max_req_size = max_request_size;
+    p->first_free = NULL;
+    p->start_addr = NULL;
+    p->end_addr = NULL;
+    pthread_mutex_init(&(p->lock), NULL);
+}
+
+/* Returns the start of the mapping of a huge block */
+static void *get_huge_mapping(mem_huge_block_t *block)
+{
+    return (char *)block - block->offset;
+}
+
+/*
+ * Statistics: the huge pool has no lock, its counters are updated atomically
+ * (the cost of the system calls is much higher anyway).
+ */
+
+/* Maps a new block (without counting it in the statistics of the pool) */
+static void *map_block(mem_pool_t *pool, size_t size, size_t alignment)
+{
+    // Room to move the payload to an aligned address
+    size_t mapped_size = sizeof(mem_huge_block_t) + (alignment - 1) + size;
+    char *mapping;
+    char *payload;
+    mem_huge_block_t *block;
+
+    if (mapped_size < size)
+    {
+        return NULL; // Overflow
+    }
+    mapping = my_mmap(mapped_size);
+    if (mapping == NULL)
+    {
+        return NULL;
+    }
+    payload = (char *)(((uintptr_t)mapping + sizeof(mem_huge_block_t) + alignment - 1) & ~(uintptr_t)(alignment - 1));
+    block = get_huge_block(payload);
+    block->size = size;
+    block->mapped_size = mapped_size;
+    block->offset = (size_t)((char *)block - mapping);
+
+    // The page map gives the pool of the block (and its header) to memory_free
+    if (page_map_register(payload, payload + size, pool, block) != 0)
+    {
+        my_munmap(mapping, mapped_size);
+        return NULL;
+    }
+    debug_printf("Huge pool: new block of %zu bytes at %p\n", size, (void *)payload);
+    return payload;
+}
+
+/* Unmaps a block (without counting it in the statistics of the pool) */
+static void unmap_block(mem_pool_t *pool, void *addr)
+{
+    mem_huge_block_t *block = get_huge_block(addr);
+
+    page_map_unregister(addr, (char *)addr + block->size);
+    debug_printf("Huge pool: release block of %zu bytes at %p\n", block->size, addr);
+    my_munmap(get_huge_mapping(block), block->mapped_size);
+}
+
+void *mem_alloc_huge_pool(mem_pool_t *pool, size_t size)
+{
+    return mem_alloc_huge_pool_aligned(pool, size, 1);
+}
+
+void *mem_alloc_huge_pool_aligned(mem_pool_t *pool, size_t size, size_t alignment)
+{
+    void *payload = map_block(pool, size, alignment);
+
+    if (payload != NULL)
+    {
+        stats_count_alloc_atomic(&(pool->counters), size, size);
+        __atomic_fetch_add(&(pool->counters.mapped_bytes), get_huge_block(payload)->mapped_size, __ATOMIC_RELAXED);
+    }
+    return payload;
+}
+
+void mem_free_huge_pool(mem_pool_t *pool, void *addr)
+{
+    mem_huge_block_t *block = get_huge_block(addr);
+
+    stats_count_free_atomic(&(pool->counters), block->size);
+    __atomic_fetch_sub(&(pool->counters.mapped_bytes), block->mapped_size, __ATOMIC_RELAXED);
+    unmap_block(pool, addr);
+}
+
+/* Counts a reallocation in the statistics of the pool (as a free followed by an allocation) */
+static void count_realloc(mem_pool_t *pool, size_t old_size, size_t old_mapped_size, mem_huge_block_t *block)
+{
+    stats_count_free_atomic(&(pool->counters), old_size);
+    stats_count_alloc_atomic(&(pool->counters), block->size, block->size);
+    __atomic_fetch_add(&(pool->counters.mapped_bytes), block->mapped_size - old_mapped_size, __ATOMIC_RELAXED);
+}
+
+size_t mem_get_allocated_block_size_huge_pool(mem_pool_t *pool, void *addr)
+{
+    return get_huge_block(addr)->size;
+}
+
+void *mem_realloc_huge_pool(mem_pool_t *pool, void *addr, size_t size)
+{
+    mem_huge_block_t *block = get_huge_block(addr);
+    void *mapping = get_huge_mapping(block);
+    size_t mapped_size = block->offset + sizeof(mem_huge_block_t) + size;
+    size_t old_size = block->size;
+    size_t old_mapped_size = block->mapped_size;
+    mem_huge_block_t *moved;
+
+    if (mapped_size < size)
+    {
+        return NULL; // Overflow
+    }
+
+    // Shrink in place (the pages given back must not be found in the page map any more)
+    if (size <= block->size)
+    {
+        page_map_unregister(addr, (char *)addr + block->size);
+        if (my_mremap(mapping, block->mapped_size, mapped_size) == 0)
+        {
+            block->size = size;
+            block->mapped_size = mapped_size;
+        }
+        // The pages of the block are known by the page map (it does not map new nodes)
+        page_map_register(addr, (char *)addr + block->size, pool, block);
+        if (block->size != size)
+        {
+            return NULL;
+        }
+        count_realloc(pool, old_size, old_mapped_size, block);
+        return addr;
+    }
+
+    // Grow in place if the following pages are available
+    if (my_mremap(mapping, block->mapped_size, mapped_size) == 0)
+    {
+        if (page_map_register(addr, (char *)addr + size, pool, block) == 0)
+        {
+            block->size = size;
+            block->mapped_size = mapped_size;
+            count_realloc(pool, old_size, old_mapped_size, block);
+            return addr;
+        }
+        page_map_register(addr, (char *)addr + block->size, pool, block);
+        my_mremap(mapping, mapped_size, block->mapped_size);
+        return NULL;
+    }
+
+    // The pages of an aligned block are not moved (the new block would not have the same layout)
+    if (block->offset != 0)
+    {
+        return NULL;
+    }
+
+    // Otherwise, map the block at its new place and move the pages there
+    moved = (mem_huge_block_t *)map_block(pool, size, 1);
+    if (moved == NULL)
+    {
+        return NULL;
+    }
+    moved--;
+    page_map_unregister(addr, (char *)addr + block->size);
+    if (my_mremap_to(block, block->mapped_size, moved, mapped_size) != 0)
+    {
+        page_map_register(addr, (char *)addr + block->size, pool, block);
+        unmap_block(pool, moved + 1);
+        return NULL;
+    }
+    // The header has been moved with the pages
+    moved->size = size;
+    moved->mapped_size = mapped_size;
+    count_realloc(pool, old_size, old_mapped_size, moved);
+    debug_printf("Huge pool: block of %zu bytes moved from %p to %p\n", size, addr, (void *)(moved + 1));
+    return moved + 1;
+}
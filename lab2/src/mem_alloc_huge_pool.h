@@ -0,0 +1,43 @@
+#ifndef   	_MEM_ALLOC_HUGE_POOL_H_
+#define   	_MEM_ALLOC_HUGE_POOL_H_
+
+#include "mem_alloc.h"
+#include "mem_alloc_types.h"
+
+/*
+ * Huge pool:
+ * the requests of at least HUGE_THRESHOLD bytes get their own mapping (my_mmap),
+ * given back to the OS (my_munmap) as soon as the block is freed.
+ */
+
+/* Smallest request size served by the huge pool */
+#ifndef HUGE_THRESHOLD
+#define HUGE_THRESHOLD (1024 * 1024)
+#endif
+
+/*
+ * Structure declaration for the header of a huge block (located at the beginning of its mapping,
+ * or further for the aligned blocks). Its size keeps the payloads aligned on 16 bytes.
+ */
+typedef struct mem_huge_block{
+    size_t size;        /* payload size */
+    size_t mapped_size; /* size of the mapping (header included) */
+    size_t offset;      /* position of the header in the mapping */
+} __attribute__((aligned(16))) mem_huge_block_t;
+
+
+/* Functions for the management of the huge pool */
+void init_huge_pool(mem_pool_t *p, size_t min_request_size, size_t max_request_size);
+void *mem_alloc_huge_pool(mem_pool_t *pool, size_t size);
+void *mem_alloc_huge_pool_aligned(mem_pool_t *pool, size_t size, size_t alignment);
+void mem_free_huge_pool(mem_pool_t *pool, void *addr);
+size_t mem_get_allocated_block_size_huge_pool(mem_pool_t *pool, void *addr);
+
+/*
+ * Resizes a huge block by resizing its mapping (in place if possible, otherwise its pages
+ * are moved to a new mapping without being copied). Returns the new address of the block,
+ * or NULL if the mapping could not be resized (the block is then left untouched).
+ */
+void *mem_realloc_huge_pool(mem_pool_t *pool, void *addr, size_t size);
+
+#endif      /* !_MEM_ALLOC_HUGE_POOL_H_ */
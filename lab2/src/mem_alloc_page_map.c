@@ -0,0 +1,136 @@
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <pthread.h>
+
+#include "mem_alloc_page_map.h"
+#include "mem_alloc.h"
+#include "my_mmap.h"
+
+/* log2(OS_BASE_PAGE_SIZE) */
+#define PAGE_MAP_PAGE_SHIFT 12
+
+#if (1 << PAGE_MAP_PAGE_SHIFT) != OS_BASE_PAGE_SIZE
+#error "PAGE_MAP_PAGE_SHIFT does not match OS_BASE_PAGE_SIZE"
+#endif
+
+/* Indexes of a page number in the 3 levels of the tree */
+#define PAGE_MAP_LEVELS 3
+#define PAGE_MAP_INDEX(page, level) (((page) >> (PAGE_MAP_BITS_PER_LEVEL * (PAGE_MAP_LEVELS - 1 - (level)))) & (PAGE_MAP_NODE_SIZE - 1))
+
+typedef struct page_map_leaf {
+    page_map_entry_t entries[PAGE_MAP_NODE_SIZE];
+} page_map_leaf_t;
+
+typedef struct page_map_node {
+    page_map_leaf_t *leaves[PAGE_MAP_NODE_SIZE];
+} page_map_node_t;
+
+static page_map_node_t *page_map_root[PAGE_MAP_NODE_SIZE];
+
+/* Serializes the updates (the lookups only read the tree) */
+static pthread_mutex_t page_map_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Returns the entry of a page, mapping the missing nodes (page_map_lock held) */
+static page_map_entry_t *get_entry(uintptr_t page)
+{
+    page_map_node_t **node = &(page_map_root[PAGE_MAP_INDEX(page, 0)]);
+    page_map_leaf_t **leaf;
+
+    if (*node == NULL)
+    {
+        page_map_node_t *n = my_mmap(sizeof(page_map_node_t));
+        if (n == NULL)
+        {
+            return NULL;
+        }
+        __atomic_store_n(node, n, __ATOMIC_RELEASE);
+    }
+    leaf = &((*node)->leaves[PAGE_MAP_INDEX(page, 1)]);
+    if (*leaf == NULL)
+    {
+        page_map_leaf_t *l = my_mmap(sizeof(page_map_leaf_t));
+        if (l == NULL)
+        {
+            return NULL;
+        }
+        __atomic_store_n(leaf, l, __ATOMIC_RELEASE);
+    }
+    return &((*leaf)->entries[PAGE_MAP_INDEX(page, 2)]);
+}
+
+int page_map_register(void *start, void *end, mem_pool_t *pool, void *span)
+{
+    uintptr_t page;
+    uintptr_t last = ((uintptr_t)end - 1) >> PAGE_MAP_PAGE_SHIFT;
+    int res = 0;
+
+    assert((last >> (PAGE_MAP_BITS_PER_LEVEL * PAGE_MAP_LEVELS)) == 0);
+
+    pthread_mutex_lock(&page_map_lock);
+    for (page = (uintptr_t)start >> PAGE_MAP_PAGE_SHIFT; page <= last; page++)
+    {
+        page_map_entry_t *e = get_entry(page);
+        if (e == NULL)
+        {
+            perror("Memory allocation failed for the page map");
+            res = -1;
+            break;
+        }
+        e->span = span;
+        __atomic_store_n(&(e->pool), pool, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&page_map_lock);
+
+    if (res != 0)
+    {
+        page_map_unregister(start, (void *)(page << PAGE_MAP_PAGE_SHIFT));
+    }
+    return res;
+}
+
+void page_map_unregister(void *start, void *end)
+{
+    uintptr_t page;
+    uintptr_t last = ((uintptr_t)end - 1) >> PAGE_MAP_PAGE_SHIFT;
+
+    pthread_mutex_lock(&page_map_lock);
+    for (page = (uintptr_t)start >> PAGE_MAP_PAGE_SHIFT; page <= last; page++)
+    {
+        page_map_entry_t *e = get_entry(page);
+        if (e != NULL)
+        {
+            __atomic_store_n(&(e->pool), NULL, __ATOMIC_RELEASE);
+        }
+    }
+    pthread_mutex_unlock(&page_map_lock);
+}
+
+const page_map_entry_t *page_map_lookup(void *addr)
+{
+    uintptr_t page = (uintptr_t)addr >> PAGE_MAP_PAGE_SHIFT;
+    page_map_node_t *node;
+    page_map_leaf_t *leaf;
+    page_map_entry_t *e;
+
+    if ((page >> (PAGE_MAP_BITS_PER_LEVEL * PAGE_MAP_LEVELS)) != 0)
+    {
+        return NULL; // Not a user space address
+    }
+    node = __atomic_load_n(&(page_map_root[PAGE_MAP_INDEX(page, 0)]), __ATOMIC_ACQUIRE);
+    if (node == NULL)
+    {
+        return NULL;
+    }
+    leaf = __atomic_load_n(&(node->leaves[PAGE_MAP_INDEX(page, 1)]), __ATOMIC_ACQUIRE);
+    if (leaf == NULL)
+    {
+        return NULL;
+    }
+    e = &(leaf->entries[PAGE_MAP_INDEX(page, 2)]);
+    if (__atomic_load_n(&(e->pool), __ATOMIC_ACQUIRE) == NULL)
+    {
+        return NULL;
+    }
+    return e;
+}
@@ -0,0 +1,36 @@
+#ifndef   	_MEM_ALLOC_PAGE_MAP_H_
+#define   	_MEM_ALLOC_PAGE_MAP_H_
+
+#include <stdlib.h>
+
+#include "mem_alloc_types.h"
+
+/*
+ * Page map: gives, in constant time, the pool owning any address and the
+ * span (slab of a fast pool, segment of a standard pool) it belongs to.
+ *
+ * It is a 3-level radix tree indexed by the page number of the address
+ * (3 x 12 bits, i.e. 48 bits virtual addresses with 4KB pages). The nodes
+ * are mapped when a span is registered and never released, so lookups
+ * do not take any lock.
+ */
+
+#define PAGE_MAP_BITS_PER_LEVEL 12
+#define PAGE_MAP_NODE_SIZE (1 << PAGE_MAP_BITS_PER_LEVEL)
+
+/* Information stored for each page of a span */
+typedef struct page_map_entry {
+    mem_pool_t *pool; /* NULL if the page is not managed by the allocator */
+    void *span;       /* mem_fast_slab_t or mem_std_segment_t, depending on the pool type */
+} page_map_entry_t;
+
+/* Records that the pages covering [start, end) belong to a span of a pool (returns 0 on success) */
+int page_map_register(void *start, void *end, mem_pool_t *pool, void *span);
+
+/* Forgets the pages covering [start, end) (before the span is unmapped) */
+void page_map_unregister(void *start, void *end);
+
+/* Returns the entry of the page containing an address (NULL if it is not managed by the allocator) */
+const page_map_entry_t *page_map_lookup(void *addr);
+
+#endif      /* !_MEM_ALLOC_PAGE_MAP_H_ */
@@ -0,0 +1,373 @@
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include <execinfo.h>
+
+#include "mem_alloc_prof.h"
+#include "my_mmap.h"
+
+size_t prof_sample_interval = PROF_SAMPLE;
+
+__thread int64_t prof_bytes_until_sample __attribute__((tls_model("initial-exec"))) = 0;
+uint64_t prof_nb_live = 0;
+uint16_t prof_filter[PROF_FILTER_SIZE];
+
+/* State of the random generator of the calling thread (0: not seeded yet) */
+static __thread uint64_t prof_rng __attribute__((tls_model("initial-exec"))) = 0;
+/* Set while the calling thread records a sample (the allocations of backtrace are not sampled) */
+static __thread int prof_in_sample __attribute__((tls_model("initial-exec"))) = 0;
+
+/* Samples of a call stack: live ones, and all of them since the start */
+typedef struct
+{
+    uint64_t hash; /* 0: free slot */
+    uint32_t depth;
+    void *frames[PROF_MAX_DEPTH];
+    uint64_t live_count;
+    uint64_t live_bytes;
+    uint64_t total_count;
+    uint64_t total_bytes;
+} prof_stack_t;
+
+/* Sampled block not freed yet */
+typedef struct
+{
+    void *addr; /* NULL: free slot */
+    uint32_t stack;
+    size_t size;
+} prof_live_t;
+
+/* Open addressing tables (linear probing), protected by prof_lock */
+static prof_stack_t *prof_stacks = NULL;
+static prof_live_t *prof_live = NULL;
+static uint32_t prof_nb_stacks = 0;
+static uint64_t prof_nb_dropped = 0;
+static pthread_mutex_t prof_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static char prof_prefix[256] = PROF_PREFIX_DEFAULT;
+static uint32_t prof_nb_dumps = 0;
+
+int prof_open(const char *prefix)
+{
+    if (prefix != NULL && prefix[0] != '\0')
+    {
+        strncpy(prof_prefix, prefix, sizeof(prof_prefix) - 1);
+    }
+    prof_stacks = my_mmap(PROF_MAX_STACKS * sizeof(prof_stack_t));
+    prof_live = my_mmap(PROF_MAX_LIVE * sizeof(prof_live_t));
+    if (prof_stacks == NULL || prof_live == NULL)
+    {
+        fprintf(stderr, "Cannot map the tables of the heap profiler\n");
+        prof_sample_interval = 0;
+        return -1;
+    }
+    return 0;
+}
+
+/* xorshift64* */
+static inline uint64_t prof_random(void)
+{
+    prof_rng ^= prof_rng >> 12;
+    prof_rng ^= prof_rng << 25;
+    prof_rng ^= prof_rng >> 27;
+    return prof_rng * 0x2545F4914F6CDD1DULL;
+}
+
+/* Approximation of ln(x) for x in (0, 1] (error below 2e-5, without the math library) */
+static inline double prof_log(double x)
+{
+    union
+    {
+        double d;
+        uint64_t u;
+    } v = {.d = x};
+    int e = (int)((v.u >> 52) & 0x7ff) - 1023;
+    double t;
+    double t2;
+
+    v.u = (v.u & ((1ULL << 52) - 1)) | (1023ULL << 52); // Mantissa m, in [1, 2)
+    // ln(m) = 2 atanh(t) with t = (m - 1) / (m + 1) in [0, 1/3)
+    t = (v.d - 1.0) / (v.d + 1.0);
+    t2 = t * t;
+    return e * 0.69314718055994531 + 2.0 * t * (1.0 + t2 * (1.0 / 3 + t2 * (1.0 / 5 + t2 * (1.0 / 7))));
+}
+
+/* Bytes before the next sample: exponential distribution of mean prof_sample_interval */
+static int64_t prof_next_interval(void)
+{
+    double u = (double)((prof_random() >> 11) + 1) * 0x1.0p-53; // In (0, 1]
+
+    return (int64_t)(-prof_log(u) * (double)prof_sample_interval) + 1;
+}
+
+static inline uint32_t prof_live_index(void *addr)
+{
+    return (uint32_t)((((uintptr_t)addr >> 4) * 0x9E3779B97F4A7C15ULL) >> 32) & (PROF_MAX_LIVE - 1);
+}
+
+/* Returns the slot of a call stack (added if needed), or -1 if the table is full (lock held) */
+static int prof_find_stack(void **frames, int depth)
+{
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    uint32_t i;
+    uint32_t n;
+    int k;
+
+    for (k = 0; k < depth; k++)
+    {
+        hash = (hash ^ (uintptr_t)frames[k]) * 0x100000001b3ULL;
+    }
+    hash |= 1; // 0 marks the free slots
+    i = (uint32_t)(hash >> 32) & (PROF_MAX_STACKS - 1);
+    for (n = 0; n < PROF_MAX_STACKS; n++, i = (i + 1) & (PROF_MAX_STACKS - 1))
+    {
+        prof_stack_t *s = &(prof_stacks[i]);
+        if (s->hash == 0)
+        {
+            // Keep some room: the probe sequences get long once the table is nearly full
+            if (prof_nb_stacks >= PROF_MAX_STACKS - PROF_MAX_STACKS / 8)
+            {
+                return -1;
+            }
+            s->hash = hash;
+            s->depth = (uint32_t)depth;
+            memcpy(s->frames, frames, depth * sizeof(void *));
+            prof_nb_stacks++;
+            return (int)i;
+        }
+        if (s->hash == hash && s->depth == (uint32_t)depth && memcmp(s->frames, frames, depth * sizeof(void *)) == 0)
+        {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+void prof_sample_alloc(void *addr, size_t size)
+{
+    void *frames[PROF_MAX_DEPTH + 1];
+    uint32_t i;
+    int depth;
+    int stack;
+
+    if (prof_sample_interval == 0 || prof_stacks == NULL)
+    {
+        prof_bytes_until_sample = INT64_MAX; // Profiler off: never sampled again
+        return;
+    }
+    if (prof_rng == 0)
+    {
+        // First allocation of the thread (its count starts at 0): only draws the first interval
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        prof_rng = ((uintptr_t)&prof_rng ^ (uint64_t)ts.tv_nsec) * 0x9E3779B97F4A7C15ULL | 1;
+        prof_bytes_until_sample = prof_next_interval();
+        return;
+    }
+    prof_bytes_until_sample = prof_next_interval();
+    if (prof_in_sample)
+    {
+        return;
+    }
+
+    prof_in_sample = 1;
+    depth = backtrace(frames, PROF_MAX_DEPTH + 1) - 1; // Without prof_sample_alloc
+    prof_in_sample = 0;
+    if (depth <= 0)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&prof_lock);
+    stack = prof_find_stack(frames + 1, depth);
+    if (stack < 0 || prof_nb_live >= PROF_MAX_LIVE / 2)
+    {
+        prof_nb_dropped++;
+        pthread_mutex_unlock(&prof_lock);
+        return;
+    }
+    prof_stacks[stack].live_count++;
+    prof_stacks[stack].live_bytes += size;
+    prof_stacks[stack].total_count++;
+    prof_stacks[stack].total_bytes += size;
+    for (i = prof_live_index(addr); prof_live[i].addr != NULL; i = (i + 1) & (PROF_MAX_LIVE - 1))
+        ;
+    prof_live[i].addr = addr;
+    prof_live[i].stack = (uint32_t)stack;
+    prof_live[i].size = size;
+    __atomic_add_fetch(&(prof_filter[PROF_FILTER_INDEX(addr)]), 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&prof_nb_live, 1, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&prof_lock);
+}
+
+void prof_free_sampled(void *addr)
+{
+    uint32_t i;
+    uint32_t j;
+
+    pthread_mutex_lock(&prof_lock);
+    for (i = prof_live_index(addr); prof_live[i].addr != addr; i = (i + 1) & (PROF_MAX_LIVE - 1))
+    {
+        if (prof_live[i].addr == NULL)
+        {
+            pthread_mutex_unlock(&prof_lock); // Not sampled (collision in the filter)
+            return;
+        }
+    }
+    prof_stacks[prof_live[i].stack].live_count--;
+    prof_stacks[prof_live[i].stack].live_bytes -= prof_live[i].size;
+    __atomic_sub_fetch(&(prof_filter[PROF_FILTER_INDEX(addr)]), 1, __ATOMIC_RELAXED);
+    __atomic_sub_fetch(&prof_nb_live, 1, __ATOMIC_RELAXED);
+
+    // Backward shift: the following entries of the cluster are moved up if their home slot allows it
+    for (j = (i + 1) & (PROF_MAX_LIVE - 1); prof_live[j].addr != NULL; j = (j + 1) & (PROF_MAX_LIVE - 1))
+    {
+        uint32_t home = prof_live_index(prof_live[j].addr);
+        if (((j - home) & (PROF_MAX_LIVE - 1)) >= ((j - i) & (PROF_MAX_LIVE - 1)))
+        {
+            prof_live[i] = prof_live[j];
+            i = j;
+        }
+    }
+    prof_live[i].addr = NULL;
+    pthread_mutex_unlock(&prof_lock);
+}
+
+/* Writes size bytes to fd; returns 0 on success */
+static int write_all(int fd, const char *p, size_t size)
+{
+    while (size > 0)
+    {
+        ssize_t n = write(fd, p, size);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return -1;
+        }
+        p += n;
+        size -= (size_t)n;
+    }
+    return 0;
+}
+
+/* Copies /proc/self/maps (pprof symbolizes the addresses with the mapped objects) */
+static int write_maps(int fd)
+{
+    char buf[4096];
+    int maps = open("/proc/self/maps", O_RDONLY);
+    ssize_t n;
+    int res = 0;
+
+    if (maps < 0)
+    {
+        return -1;
+    }
+    while (res == 0 && ((n = read(maps, buf, sizeof(buf))) > 0 || (n < 0 && errno == EINTR)))
+    {
+        if (n > 0)
+        {
+            res = write_all(fd, buf, (size_t)n);
+        }
+    }
+    close(maps);
+    return (n < 0) ? -1 : res;
+}
+
+/*
+ * The profile is written without allocating memory, in the legacy heap profile format of gperftools:
+ *     heap profile: <live count>: <live bytes> [<total count>: <total bytes>] @ heap_v2/<interval>
+ * then a line of the same form per call stack, followed by " @ <return addresses>", and the
+ * mappings of the process after a MAPPED_LIBRARIES line.
+ */
+int prof_dump(const char *path)
+{
+    char default_path[512];
+    /* Longest line: 4 counters of 20 digits and their separators, " 0x" and 16 digits per frame, '\n' and '\0' */
+    char line[4 * 20 + 9 + 19 * PROF_MAX_DEPTH + 2];
+    uint64_t live_count = 0;
+    uint64_t live_bytes = 0;
+    uint64_t total_count = 0;
+    uint64_t total_bytes = 0;
+    uint32_t i;
+    int res = 0;
+    int fd;
+    int len;
+
+    if (prof_stacks == NULL)
+    {
+        return -1;
+    }
+    if (path == NULL)
+    {
+        snprintf(default_path, sizeof(default_path), "%s.%d.%u.heap", prof_prefix, (int)getpid(),
+                 __atomic_fetch_add(&prof_nb_dumps, 1, __ATOMIC_RELAXED));
+        path = default_path;
+    }
+    fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+    {
+        perror("cannot open the heap profile");
+        return -1;
+    }
+
+    pthread_mutex_lock(&prof_lock);
+    for (i = 0; i < PROF_MAX_STACKS; i++)
+    {
+        live_count += prof_stacks[i].live_count;
+        live_bytes += prof_stacks[i].live_bytes;
+        total_count += prof_stacks[i].total_count;
+        total_bytes += prof_stacks[i].total_bytes;
+    }
+    len = snprintf(line, sizeof(line), "heap profile: %lu: %lu [%lu: %lu] @ heap_v2/%lu\n",
+                   live_count, live_bytes, total_count, total_bytes, prof_sample_interval);
+    res = write_all(fd, line, (size_t)len);
+    for (i = 0; i < PROF_MAX_STACKS && res == 0; i++)
+    {
+        prof_stack_t *s = &(prof_stacks[i]);
+        uint32_t k;
+
+        if (s->total_count == 0)
+        {
+            continue;
+        }
+        len = snprintf(line, sizeof(line), "%lu: %lu [%lu: %lu] @", s->live_count, s->live_bytes, s->total_count, s->total_bytes);
+        for (k = 0; k < s->depth && len < (int)sizeof(line) - 1; k++)
+        {
+            len += snprintf(line + len, sizeof(line) - len, " %p", s->frames[k]);
+        }
+        // snprintf returns the untruncated length: keep room for the newline whatever happens
+        if (len > (int)sizeof(line) - 2)
+        {
+            len = (int)sizeof(line) - 2;
+        }
+        line[len++] = '\n';
+        res = write_all(fd, line, (size_t)len);
+    }
+    if (prof_nb_dropped > 0)
+    {
+        fprintf(stderr, "heap profile: %lu samples dropped (tables full)\n", prof_nb_dropped);
+    }
+    pthread_mutex_unlock(&prof_lock);
+
+    if (res == 0)
+    {
+        res = write_all(fd, "\nMAPPED_LIBRARIES:\n", 19);
+    }
+    if (res == 0)
+    {
+        res = write_maps(fd);
+    }
+    if (close(fd) != 0 || res != 0)
+    {
+        perror("cannot write the heap profile");
+        return -1;
+    }
+    return 0;
+}
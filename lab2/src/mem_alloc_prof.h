@@ -0,0 +1,81 @@
+#ifndef   	_MEM_ALLOC_PROF_H_
+#define   	_MEM_ALLOC_PROF_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+
+/*
+ * Sampling heap profiler.
+ *
+ * Each thread counts down the bytes it allocates: when the count goes below zero, the
+ * allocation is sampled (its call stack is recorded, and the block is tracked until it is
+ * freed) and the next count is drawn from an exponential distribution whose mean is the
+ * sampling interval, so that every allocated byte has the same probability to be sampled.
+ * With the profiler off, the count never goes below zero: an allocation only costs a
+ * decrement and a branch, a free a load and a branch.
+ *
+ * The profile (live and cumulative sampled allocations, per call stack) is written in the
+ * heap profile format of gperftools (heap_v2, read by pprof, which scales the samples back
+ * to estimates of the allocated memory) by memory_dump_profile and at exit:
+ *     MEMALLOC_CONF=prof_sample=512K LD_PRELOAD=./libmalloc.so app
+ *     pprof --text app memalloc.<pid>.0.heap
+ * The call stacks are captured by backtrace(3): the first sample loads the unwinder
+ * (allocating memory, which is not sampled).
+ */
+
+/* Mean number of bytes between two samples (PROF_SAMPLE in Makefile.config, 0: profiler off) */
+#ifndef PROF_SAMPLE
+#define PROF_SAMPLE 0
+#endif
+extern size_t prof_sample_interval;
+
+/* Prefix of the profile files: <prefix>.<pid>.<number of the dump>.heap */
+#define PROF_PREFIX_DEFAULT "memalloc"
+
+/* Deepest call stack recorded, and number of distinct call stacks / live samples tracked */
+#define PROF_MAX_DEPTH 32
+#define PROF_MAX_STACKS (1 << 13)
+#define PROF_MAX_LIVE (1 << 16)
+
+/* Counting filter of the addresses of the live samples (checked by the frees without lock) */
+#define PROF_FILTER_SIZE (1 << 16)
+#define PROF_FILTER_INDEX(addr) ((((uintptr_t)(addr) >> 4) ^ ((uintptr_t)(addr) >> 20)) & (PROF_FILTER_SIZE - 1))
+
+/* Bytes the calling thread can allocate before its next sample */
+extern __thread int64_t prof_bytes_until_sample __attribute__((tls_model("initial-exec")));
+extern uint64_t prof_nb_live;
+extern uint16_t prof_filter[PROF_FILTER_SIZE];
+
+/*
+ * Maps the tables of the profiler (called by memory_init if prof_sample_interval is not 0).
+ * Returns 0 on success, -1 otherwise (the profiler is then off).
+ */
+int prof_open(const char *prefix);
+
+/* Slow paths of prof_alloc and prof_free */
+void prof_sample_alloc(void *addr, size_t size);
+void prof_free_sampled(void *addr);
+
+/* Counts an allocation (sampled if the count of the thread goes below zero) */
+static inline void prof_alloc(void *addr, size_t size)
+{
+    if (__builtin_expect((prof_bytes_until_sample -= (int64_t)size) < 0, 0))
+    {
+        prof_sample_alloc(addr, size);
+    }
+}
+
+/* Stops tracking a block if it was sampled (called before the block is freed) */
+static inline void prof_free(void *addr)
+{
+    if (__builtin_expect(__atomic_load_n(&prof_nb_live, __ATOMIC_RELAXED) != 0, 0) &&
+        __atomic_load_n(&(prof_filter[PROF_FILTER_INDEX(addr)]), __ATOMIC_RELAXED) != 0)
+    {
+        prof_free_sampled(addr);
+    }
+}
+
+/* Writes the profile to path (<prefix>.<pid>.<number>.heap if path is NULL); returns 0 on success */
+int prof_dump(const char *path);
+
+#endif      /* !_MEM_ALLOC_PROF_H_ */
@@ -3,6 +3,8 @@
 
 #include "mem_alloc_types.h"
 #include "mem_alloc_standard_pool.h"
+#include "mem_alloc_page_map.h"
+#include "mem_alloc_stats.h"
 #include "my_mmap.h"
 #include "mem_alloc.h"
 
@@ -15,53 +17,513 @@ std_pool_placement_policy_t std_pool_policy = STDPOOL_POLICY;
 std_pool_placement_policy_t std_pool_policy = DEFAULT_STDPOOL_POLICY;
 #endif
 
+size_t std_pool_align = ((MEM_ALIGN) < STD_MAX_ALIGN) ? (MEM_ALIGN) : STD_MAX_ALIGN;
+
 /////////////////////////////////////////////////////////////////////////////
 
-mem_std_free_block_t *current = NULL;
+/*
+ * Segments:
+ * a standard pool is made of segments mapped with my_mmap: the first one by init_standard_pool,
+ * the next ones when no free block is large enough for a request. Each new segment is twice as
+ * large as the newest one (up to STD_MAX_SEGMENT_SIZE), so that a growing heap maps few segments.
+ * A segment entirely free stays in the free list, and is released by the purge passes like the
+ * pages of the other free blocks (see mem_purge_standard_pool), except the first one.
+ * The blocks of a segment are enclosed between two sentinels: a used footer of size 0 (prologue)
+ * before the first block, and a used header of size 0 (epilogue) after the last one. Thus,
+ * coalescing never crosses the bounds of a segment. The descriptor of the segment is located before
+ * the prologue, so that the first block of the first segment starts at the beginning of the pool.
+ */
 
-void init_standard_pool(mem_pool_t *p, size_t size, size_t min_request_size, size_t max_request_size)
+/* Largest size of the segments mapped by the growth of a pool (unless the pool size or a request is larger) */
+#define STD_MAX_SEGMENT_SIZE (16UL << 20)
+
+/* Size of the metadata located before the first block of a segment */
+#define SEGMENT_HEAD_SIZE (sizeof(mem_std_segment_t) + sizeof(mem_std_block_header_footer_t))
+
+/*
+ * Alignment of the payloads: the payload sizes are rounded up to a multiple of std_pool_align
+ * (at most 16 bytes, the size of a header and a footer), so that all the payloads of a
+ * segment are aligned like the first one (which is aligned on 64 bytes).
+ * Larger alignments are obtained with mem_alloc_standard_pool_aligned.
+ */
+#define STD_ALIGN_SIZE(size) (((size) + std_pool_align - 1) & ~(std_pool_align - 1))
+
+/* Smallest free block (header and footer included) */
+#define STD_MIN_BLOCK_SIZE (sizeof(mem_std_free_block_t) + sizeof(mem_std_block_header_footer_t))
+
+static void insert_free_block(mem_pool_t *pool, mem_std_free_block_t *b);
+
+/* Returns 1 if a header (or footer) is one of the sentinels of a segment */
+static int is_sentinel(mem_std_block_header_footer_t *m)
 {
-    void *address = my_mmap(size);
+    return is_block_used(m) && get_block_size(m) == 0;
+}
+
+/* Maps a new segment with room for a block of (at least) size bytes, headers included, and inserts this block in the free list */
+static mem_std_segment_t *add_segment(mem_pool_t *p, size_t size)
+{
+    mem_std_segment_t *newest = (mem_std_segment_t *)p->segments;
+    size_t mapped_size;
+    mem_std_segment_t *segment;
+    mem_std_block_header_footer_t *prologue;
+    mem_std_block_header_footer_t *epilogue;
+    mem_std_free_block_t *first_block;
+    char *address;
+
+    size = STD_ALIGN_SIZE(size);
+    mapped_size = SEGMENT_HEAD_SIZE + size + sizeof(mem_std_block_header_footer_t);
+    address = my_mmap(mapped_size);
     if (address == NULL)
     {
         perror("Memory allocation failed for the standard pool");
-        return;
+        return NULL;
+    }
+
+    segment = (mem_std_segment_t *)address;
+    segment->start = address + SEGMENT_HEAD_SIZE;
+    segment->end = segment->start + size;
+    segment->mapped_size = mapped_size;
+    segment->offset = (newest != NULL) ? newest->offset + (size_t)(newest->end - newest->start) : 0;
+    if (page_map_register(segment->start, segment->end, p, segment) != 0)
+    {
+        my_munmap(address, mapped_size);
+        return NULL;
+    }
+
+    // Sentinels
+    prologue = (mem_std_block_header_footer_t *)(segment->start - sizeof(mem_std_block_header_footer_t));
+    epilogue = (mem_std_block_header_footer_t *)segment->end;
+    prologue->flag_and_size = 0;
+    set_block_used(prologue);
+    *epilogue = *prologue;
+
+    // A single free block covers the whole segment
+    first_block = (mem_std_free_block_t *)segment->start;
+    first_block->header.flag_and_size = 0;
+    set_block_size(&(first_block->header), size - sizeof(mem_std_block_header_footer_t) * 2); // Remove header and footer
+    set_block_free(&(first_block->header));
+    set_block_purged(&(first_block->header)); // Its pages have never been touched
+    set_block_footer(&(first_block->header));
+    insert_free_block(p, first_block);
+
+    segment->prev = NULL;
+    segment->next = newest;
+    if (newest != NULL)
+    {
+        newest->prev = segment;
+    }
+    p->segments = segment;
+    p->counters.mapped_bytes += mapped_size;
+
+    debug_printf("Standard pool %d: new segment of %zu bytes\n", p->pool_id, size);
+    return segment;
+}
+
+/* Releases a segment (which must only contain a single free block, already removed from the free list) */
+static void release_segment(mem_pool_t *p, mem_std_segment_t *segment)
+{
+    if (segment->prev != NULL)
+    {
+        segment->prev->next = segment->next;
     }
+    else
+    {
+        p->segments = segment->next;
+    }
+    if (segment->next != NULL)
+    {
+        segment->next->prev = segment->prev;
+    }
+    page_map_unregister(segment->start, segment->end);
+    p->counters.mapped_bytes -= segment->mapped_size;
+    debug_printf("Standard pool %d: release segment of %zu bytes\n", p->pool_id, (size_t)(segment->end - segment->start));
+    my_munmap(segment, segment->mapped_size);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+void init_standard_pool(mem_pool_t *p, size_t size, size_t min_request_size, size_t max_request_size)
+{
+    mem_std_segment_t *segment;
 
     // Initialize the pool
-    p->start_addr = address;
-    p->end_addr = (void *)((char *)address + size);
     p->pool_size = size;
     p->min_req_size = min_request_size;
     p->max_req_size = max_request_size;
-    p->first_free = address;
+    p->first_free = NULL;
+    p->segments = NULL;
+    p->bins = NULL;
+    p->skip_list = NULL;
+    pthread_mutex_init(&(p->lock), NULL);
 
-    // First free block
-    mem_std_free_block_t *first_block = (mem_std_free_block_t *)address;
+    // The segregated policies spread the free blocks over size bins, the other ones index the address-ordered list
+    if (std_pool_policy == SEGREGATED_FIT || std_pool_policy == TLSF)
+    {
+        p->bins = my_mmap(sizeof(mem_std_bins_t));
+        if (p->bins == NULL)
+        {
+            perror("Memory allocation failed for the bins of the standard pool");
+            return;
+        }
+    }
+    else
+    {
+        p->skip_list = my_mmap(sizeof(mem_std_free_block_t *) * STD_SKIP_LEVELS);
+        if (p->skip_list == NULL)
+        {
+            perror("Memory allocation failed for the skip list of the standard pool");
+            return;
+        }
+    }
 
-    /*
-    Variable used in mem_alloc_standard_pool() as a reference to the last looked at free block
-    It is initialized there so that it can be accessed staticly by the fuction
-    Be careful may be prone to bugs
-    */
-    current = first_block;
+    segment = add_segment(p, size);
+    if (segment == NULL)
+    {
+        return;
+    }
 
-    // Set the block size and mark it as free
-    set_block_size(&(first_block->header), size - sizeof(mem_std_block_header_footer_t) * 2); // Remove header and footer
-    set_block_free(&(first_block->header));
+    // The first segment defines the pool bounds (used as a reference for the traces)
+    p->start_addr = segment->start;
+    p->end_addr = segment->end;
 
-    first_block->next = NULL; // No next free block yet
-    first_block->prev = NULL; // No previous free block yet
+    // The first next fit search starts from the beginning of the pool
+    p->next_fit = segment->start;
 
-    // Footer matches the header
-    mem_std_block_header_footer_t *first_footer = (mem_std_block_header_footer_t *)((char *)address + size - sizeof(mem_std_block_header_footer_t));
-    *first_footer = first_block->header;
+    debug_printf("Standard pool initialized with a block of size %zu bytes\n", get_block_size((mem_std_block_header_footer_t *)segment->start));
+}
 
-    printf("Standard pool initialized with a block of size %zu bytes\n", get_block_size(&(first_block->header)));
+/////////////////////////////////////////////////////////////////////////////
+
+/*
+ * Free blocks:
+ * with the FF, BF and NF policies, the free blocks are kept in a single list sorted by address
+ * (pool->first_free). With the segregated policies, they are spread over size bins (pool->bins),
+ * each bin being a LIFO list. In both cases, the blocks are linked through their prev/next fields.
+ *
+ * The address-ordered list is the bottom level of a skip list (pool->skip_list holds the upper
+ * levels of its head), so that a block is inserted without walking the list. The forward
+ * pointers of the upper levels of a block are stored in its payload, after prev/next. The
+ * height of a block depends on its address (a block gets level l + 1 with probability 1/4
+ * once it has level l) and is bounded by the room available in its payload.
+ */
+
+/*
+ * Returns the bin of a free block of a given size.
+ * SF: 16 bytes wide bins below 1024 bytes, then one bin per power of 2.
+ * TLSF: the first level is the power of 2 (fl), the second level splits it in 64 ranges
+ * (the sizes below 64 bytes have their own bin).
+ */
+static int get_bin_index(size_t size)
+{
+    int fl = 63 - __builtin_clzl(size | 1);
+
+    if (std_pool_policy == TLSF)
+    {
+        if (fl < TLSF_SL_LOG2)
+        {
+            return (int)size;
+        }
+        return (fl << TLSF_SL_LOG2) + (int)((size >> (fl - TLSF_SL_LOG2)) & ((1 << TLSF_SL_LOG2) - 1));
+    }
+    if (size < 1024)
+    {
+        return (int)(size >> 4);
+    }
+    return 64 + fl - 10;
 }
 
-void *mem_alloc_standard_pool(mem_pool_t *pool, size_t requested_size)
+/* TLSF: rounds a size up to the next second-level range (all the blocks of its bin are large enough) */
+static size_t tlsf_round_size(size_t size)
+{
+    int fl = 63 - __builtin_clzl(size | 1);
+
+    if (fl >= TLSF_SL_LOG2)
+    {
+        size += (1UL << (fl - TLSF_SL_LOG2)) - 1;
+    }
+    return size;
+}
+
+static void set_bin_bit(mem_std_bins_t *bins, int b)
+{
+    bins->bitmap[b / 64] |= 1UL << (b % 64);
+    bins->summary |= 1UL << (b / 64);
+}
+
+static void clear_bin_bit(mem_std_bins_t *bins, int b)
+{
+    bins->bitmap[b / 64] &= ~(1UL << (b % 64));
+    if (bins->bitmap[b / 64] == 0)
+    {
+        bins->summary &= ~(1UL << (b / 64));
+    }
+}
+
+/* Returns the first non-empty bin starting from bin b (-1 if none) */
+static int find_next_bin(mem_std_bins_t *bins, int b)
+{
+    int w = b / 64;
+    uint64_t m;
+
+    if (b >= STD_NB_BINS)
+    {
+        return -1;
+    }
+    m = bins->bitmap[w] & (~0UL << (b % 64));
+    if (m == 0)
+    {
+        // Look for the next non-empty word of the bitmap
+        m = (w + 1 < STD_NB_BINS / 64) ? bins->summary & (~0UL << (w + 1)) : 0;
+        if (m == 0)
+        {
+            return -1;
+        }
+        w = __builtin_ctzl(m);
+        m = bins->bitmap[w];
+    }
+    return w * 64 + __builtin_ctzl(m);
+}
+
+/* Returns the forward pointers of a block in the skip list (only the entries from 1 to its height - 1 exist) */
+static mem_std_free_block_t **skip_forward(mem_std_free_block_t *b)
+{
+    return (mem_std_free_block_t **)(b + 1) - 1;
+}
+
+/* Returns the height of a block in the skip list (an upper bound if its size has grown since its insertion) */
+static int get_skip_height(mem_std_free_block_t *b)
+{
+    uint64_t hash = ((uint64_t)(uintptr_t)b * 0x9E3779B97F4A7C15UL) >> 32;
+    size_t room = get_block_size(&(b->header)) - (sizeof(mem_std_free_block_t) - sizeof(mem_std_block_header_footer_t));
+    int height = 1 + __builtin_ctzl(hash | (1UL << (2 * (STD_SKIP_LEVELS - 1)))) / 2;
+
+    if ((size_t)height > 1 + room / sizeof(mem_std_free_block_t *))
+    {
+        height = 1 + room / sizeof(mem_std_free_block_t *);
+    }
+    return height;
+}
+
+/*
+ * Sets update[l] (for 1 <= l < height) to the forward pointers of the last node of level l located
+ * before block b, and returns the last block of level 1 located before b (NULL if none)
+ */
+static mem_std_free_block_t *skip_find(mem_pool_t *pool, mem_std_free_block_t *b, mem_std_free_block_t ***update, int height)
+{
+    mem_std_free_block_t **forward = (mem_std_free_block_t **)pool->skip_list;
+    mem_std_free_block_t *last = NULL;
+    int l;
+
+    for (l = STD_SKIP_LEVELS - 1; l >= 1; l--)
+    {
+        while (forward[l] != NULL && (char *)forward[l] < (char *)b)
+        {
+            last = forward[l];
+            forward = skip_forward(last);
+        }
+        if (l < height)
+        {
+            update[l] = forward;
+        }
+    }
+    return last;
+}
+
+/* Links the upper levels of a block in the skip list, and returns the last block of level 1 located before it (NULL if none) */
+static mem_std_free_block_t *skip_link(mem_pool_t *pool, mem_std_free_block_t *b)
+{
+    mem_std_free_block_t **update[STD_SKIP_LEVELS];
+    int height = get_skip_height(b);
+    mem_std_free_block_t *last = skip_find(pool, b, update, height);
+    int l;
+
+    for (l = 1; l < height; l++)
+    {
+        skip_forward(b)[l] = update[l][l];
+        update[l][l] = b;
+    }
+    return last;
+}
+
+/* Unlinks the upper levels of a block from the skip list */
+static void skip_unlink(mem_pool_t *pool, mem_std_free_block_t *b)
+{
+    mem_std_free_block_t **update[STD_SKIP_LEVELS];
+    int height = get_skip_height(b);
+    int l;
+
+    if (height == 1)
+    {
+        return; // Only linked at the bottom level
+    }
+    skip_find(pool, b, update, height);
+    for (l = 1; l < height; l++)
+    {
+        if (update[l][l] == b)
+        {
+            update[l][l] = skip_forward(b)[l];
+        }
+    }
+}
+
+/* Removes a block from the free list (or from its bin) */
+static void remove_free_block(mem_pool_t *pool, mem_std_free_block_t *b)
+{
+    if (b->prev != NULL)
+    {
+        b->prev->next = b->next;
+    }
+    else if (pool->bins != NULL)
+    {
+        mem_std_bins_t *bins = (mem_std_bins_t *)pool->bins;
+        int index = get_bin_index(get_block_size(&(b->header)));
+        bins->bins[index] = b->next;
+        if (b->next == NULL)
+        {
+            clear_bin_bit(bins, index);
+        }
+    }
+    else
+    {
+        pool->first_free = b->next;
+    }
+    if (b->next != NULL)
+    {
+        b->next->prev = b->prev;
+    }
+    if (pool->skip_list != NULL)
+    {
+        skip_unlink(pool, b);
+    }
+}
+
+/* Inserts a free block at its place (according to its address) in the free list, or at the head of its bin */
+static void insert_free_block(mem_pool_t *pool, mem_std_free_block_t *b)
+{
+    mem_std_free_block_t *will_be_next = (mem_std_free_block_t *)pool->first_free;
+    mem_std_free_block_t *prev_will_be = NULL;
+
+    if (pool->bins != NULL)
+    {
+        mem_std_bins_t *bins = (mem_std_bins_t *)pool->bins;
+        int index = get_bin_index(get_block_size(&(b->header)));
+        b->prev = NULL;
+        b->next = bins->bins[index];
+        if (b->next != NULL)
+        {
+            b->next->prev = b;
+        }
+        bins->bins[index] = b;
+        set_bin_bit(bins, index);
+        return;
+    }
+
+    // The skip list gives a block located shortly before the position of the block
+    prev_will_be = skip_link(pool, b);
+    if (prev_will_be != NULL)
+    {
+        will_be_next = prev_will_be->next;
+    }
+
+    // Go to through the free list to set will_be_next to the position next to block
+    while (will_be_next != NULL && (char *)will_be_next < (char *)b)
+    {
+        prev_will_be = will_be_next;
+        will_be_next = will_be_next->next;
+    }
+
+    b->next = will_be_next;
+    b->prev = prev_will_be;
+    if (will_be_next != NULL)
+    {
+        will_be_next->prev = b;
+    }
+    if (prev_will_be != NULL)
+    {
+        prev_will_be->next = b;
+    }
+    else
+    {
+        pool->first_free = b; // This is the new head of the free list
+    }
+}
+
+/* Puts a free block (with its final size) at the place of another one, which is removed from the list */
+static void replace_free_block(mem_pool_t *pool, mem_std_free_block_t *old, mem_std_free_block_t *b)
+{
+    if (pool->bins != NULL)
+    {
+        // The blocks may not belong to the same bin
+        remove_free_block(pool, old);
+        insert_free_block(pool, b);
+        return;
+    }
+
+    // Both blocks have the same position in the address order (the forward pointers of b may overwrite old)
+    mem_std_free_block_t *prev = old->prev;
+    mem_std_free_block_t *next = old->next;
+    skip_unlink(pool, old);
+    skip_link(pool, b);
+    b->prev = prev;
+    b->next = next;
+    if (b->prev != NULL)
+    {
+        b->prev->next = b;
+    }
+    else
+    {
+        pool->first_free = b;
+    }
+    if (b->next != NULL)
+    {
+        b->next->prev = b;
+    }
+    if (pool->next_fit == old)
+    {
+        pool->next_fit = b;
+    }
+}
+
+/* Changes the size of a block of the free list (it keeps its place in an address-ordered list) */
+static void resize_free_block(mem_pool_t *pool, mem_std_free_block_t *b, size_t size)
+{
+    if (pool->bins != NULL)
+    {
+        remove_free_block(pool, b);
+    }
+    set_block_size(&(b->header), size);
+    set_block_footer(&(b->header));
+    if (pool->bins != NULL)
+    {
+        insert_free_block(pool, b);
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+/* Part of a free block whose pages can be purged: after its list links and skip list tower, before its footer */
+#define PURGE_HEAD_SIZE (sizeof(mem_std_free_block_t) + sizeof(mem_std_free_block_t *) * (STD_SKIP_LEVELS - 1))
+
+static void get_purge_range(mem_std_free_block_t *b, char **start, char **end)
 {
+    *start = (char *)b + PURGE_HEAD_SIZE;
+    *end = (char *)b + sizeof(mem_std_block_header_footer_t) + get_block_size(&(b->header));
+}
+
+/* Size of the mapping of the segment holding a block (the pages are purged by huge pages if it is mapped with them) */
+static size_t get_segment_mapped_size(mem_std_free_block_t *b)
+{
+    return ((mem_std_segment_t *)page_map_lookup(b)->span)->mapped_size;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+/* Returns a free block of at least requested_size bytes, chosen according to the placement policy (NULL if none) */
+static mem_std_free_block_t *find_free_block(mem_pool_t *pool, size_t requested_size)
+{
+    mem_std_free_block_t *current = NULL;
+    uint64_t steps = 0; // Free blocks examined
+    int bin;
 
     // this switch is used to defin which is the best block according to the chosen placement policie and assign it to current
     switch (std_pool_policy)
@@ -73,6 +535,7 @@ void *mem_alloc_standard_pool(mem_pool_t *pool, size_t requested_size)
         {
             char is_free = is_block_free(&(current->header));
             char is_sufficently_big = get_block_size(&(current->header)) >= requested_size;
+            steps++;
             if (is_free && is_sufficently_big)
             {
                 break; // Found a suitable block
@@ -85,13 +548,14 @@ void *mem_alloc_standard_pool(mem_pool_t *pool, size_t requested_size)
 
         // Traverse the free list to find the block whose size is closest to the allocated size
         current = (mem_std_free_block_t *)pool->first_free;
-        mem_std_free_block_t *best = current;
+        mem_std_free_block_t *best = NULL;
         while (current != NULL)
         {
             char is_free = is_block_free(&(current->header));
             char is_sufficently_big = get_block_size(&(current->header)) >= requested_size;
             // evaluating if the current block is closer to the desired size than the precedent best (considering that it is already big enough)
-            char is_best_fit = get_block_size(&(current->header)) < get_block_size(&(best->header));
+            char is_best_fit = (best == NULL) || (get_block_size(&(current->header)) < get_block_size(&(best->header)));
+            steps++;
             if (is_free && is_sufficently_big && is_best_fit)
             {
                 best = current;
@@ -103,10 +567,18 @@ void *mem_alloc_standard_pool(mem_pool_t *pool, size_t requested_size)
 
     case NEXT_FIT:
 
+        // Traverse the free list from the block following the last allocated one, wrapping around once
+        current = (mem_std_free_block_t *)pool->next_fit;
+        if (current == NULL)
+        {
+            current = (mem_std_free_block_t *)pool->first_free;
+        }
+        mem_std_free_block_t *start = current;
         while (current != NULL)
         {
             char is_free = is_block_free(&(current->header));
             char is_sufficently_big = get_block_size(&(current->header)) >= requested_size;
+            steps++;
             if (is_free && is_sufficently_big)
             {
                 break; // Found a suitable block
@@ -116,6 +588,46 @@ void *mem_alloc_standard_pool(mem_pool_t *pool, size_t requested_size)
             {
                 current = (mem_std_free_block_t *)pool->first_free;
             }
+            if (current == start)
+            {
+                current = NULL; // Went through the whole list
+            }
+        }
+        break;
+
+    case SEGREGATED_FIT:
+
+        // First fit in the bin of the requested size (its blocks may be too small)
+        bin = get_bin_index(requested_size);
+        current = ((mem_std_bins_t *)pool->bins)->bins[bin];
+        while (current != NULL && get_block_size(&(current->header)) < requested_size)
+        {
+            steps++;
+            current = current->next;
+        }
+        // Otherwise, any block of the next non-empty bin is large enough
+        if (current == NULL)
+        {
+            bin = find_next_bin((mem_std_bins_t *)pool->bins, bin + 1);
+            if (bin >= 0)
+            {
+                current = ((mem_std_bins_t *)pool->bins)->bins[bin];
+            }
+        }
+        if (current != NULL)
+        {
+            steps++;
+        }
+        break;
+
+    case TLSF:
+
+        // All the blocks of the bin of the rounded size (and above) are large enough
+        bin = find_next_bin((mem_std_bins_t *)pool->bins, get_bin_index(tlsf_round_size(requested_size)));
+        if (bin >= 0)
+        {
+            current = ((mem_std_bins_t *)pool->bins)->bins[bin];
+            steps++;
         }
         break;
 
@@ -123,160 +635,512 @@ void *mem_alloc_standard_pool(mem_pool_t *pool, size_t requested_size)
         break;
     }
 
+    pool->counters.search_steps += steps;
+    return current;
+}
+
+void *mem_alloc_standard_pool(mem_pool_t *pool, size_t requested_size)
+{
+    return mem_alloc_standard_pool_clean(pool, requested_size, NULL, NULL);
+}
+
+/* Returns a free block of at least requested_size bytes, mapping a new segment if needed (NULL if none) */
+static mem_std_free_block_t *get_free_block(mem_pool_t *pool, size_t requested_size)
+{
+    mem_std_free_block_t *current = find_free_block(pool, requested_size);
+
+    // No suitable block found: map a new segment (large enough for the request)
+    if (current == NULL)
+    {
+        // With TLSF, the block must be in the bin searched for the request (see tlsf_round_size)
+        size_t block_size = (std_pool_policy == TLSF) ? tlsf_round_size(requested_size) : requested_size;
+        size_t segment_size = block_size + sizeof(mem_std_block_header_footer_t) * 2;
+        mem_std_segment_t *newest = (mem_std_segment_t *)pool->segments;
+        size_t growth_size = pool->pool_size;
+
+        // Geometric growth: twice the size of the newest segment, within [pool size, STD_MAX_SEGMENT_SIZE]
+        if (newest != NULL)
+        {
+            growth_size = (size_t)(newest->end - newest->start) * 2;
+            if (growth_size > STD_MAX_SEGMENT_SIZE)
+            {
+                growth_size = STD_MAX_SEGMENT_SIZE;
+            }
+            if (growth_size < pool->pool_size)
+            {
+                growth_size = pool->pool_size;
+            }
+        }
+        if (segment_size < growth_size)
+        {
+            segment_size = growth_size;
+        }
+        if (add_segment(pool, segment_size) != NULL)
+        {
+            current = find_free_block(pool, requested_size);
+        }
+    }
+
     // No suitable block found
     if (current == NULL)
     {
-        printf("Error: No suitable block found in the standard pool\n");
-        return NULL;
+        debug_printf("Error: No suitable block found in the standard pool\n");
+    }
+    return current;
+}
+
+/* Allocates the beginning of a free block (large enough), and returns its payload */
+static void *allocate_block(mem_pool_t *pool, mem_std_free_block_t *current, size_t requested_size, void **zero_start, void **zero_end)
+{
+    // The whole pages purged (or never touched) in the block hold zeros
+    if (zero_start != NULL)
+    {
+        char *payload = (char *)current + sizeof(mem_std_block_header_footer_t);
+        char *first = payload;
+        char *last = payload;
+        if (PURGED_PAGES_ARE_ZERO && is_block_purged(&(current->header)))
+        {
+            char *start;
+            char *end;
+            get_purge_range(current, &start, &end);
+            if (end > start)
+            {
+                my_madvise_range(start, (size_t)(end - start), get_segment_mapped_size(current), &first, &last);
+            }
+            // Empty or beyond the end of the payload: nothing is known
+            if (last > payload + requested_size)
+            {
+                last = payload + requested_size;
+            }
+            if (last <= first)
+            {
+                first = payload;
+                last = payload;
+            }
+        }
+        *zero_start = first;
+        *zero_end = last;
     }
 
     // the total size we need to alocate a block of size requested_size
     size_t total_allocated_size = requested_size + sizeof(mem_std_block_header_footer_t) * 2;
-    // the size that the new block would have in case of split (without header and footers)
-    size_t remaining_size = get_block_size(&(current->header)) - total_allocated_size;
-    // If the remaining size allows for a new free block then we split
-    if (remaining_size + sizeof(mem_std_block_header_footer_t) * 2 > sizeof(mem_std_free_block_t) + sizeof(mem_std_block_header_footer_t))
+    // If the remaining space allows for a new free block then we split
+    if (get_block_size(&(current->header)) > total_allocated_size + sizeof(mem_std_free_block_t) - sizeof(mem_std_block_header_footer_t))
     {
+        // the size of the new block (without header and footer)
+        size_t remaining_size = get_block_size(&(current->header)) - total_allocated_size;
+
         // There is enough space for a new block, so split
         mem_std_free_block_t *new_free_block = (mem_std_free_block_t *)((char *)current + total_allocated_size);
+        mem_std_block_header_footer_t header = current->header;
 
-        // Set the size and mark the new block as free
+        // A small allocated block may not cover the skip list tower of the current block: it leaves the list first
+        if (requested_size < PURGE_HEAD_SIZE)
+        {
+            remove_free_block(pool, current);
+        }
+
+        // Set the size and mark the new block as free (its footer is the one of the current block)
+        // The purge flags are inherited: the pages of the new block are in the same state as before the split
+        new_free_block->header = header;
         set_block_size(&(new_free_block->header), remaining_size);
         set_block_free(&(new_free_block->header));
+        set_block_footer(&(new_free_block->header));
 
-        // Update the next and prev pointers for the new block
-        new_free_block->next = current->next;
-        new_free_block->prev = current;
-        if (current->next != NULL)
+        // The new block takes the place of the current one in the free list
+        if (requested_size < PURGE_HEAD_SIZE)
         {
-            current->next->prev = new_free_block;
+            insert_free_block(pool, new_free_block);
         }
-        current->next = new_free_block;
-
-        // Set the footer for the new free block
-        mem_std_block_header_footer_t *new_footer = (mem_std_block_header_footer_t *)((char *)new_free_block + remaining_size);
-        *new_footer = new_free_block->header;
+        else
+        {
+            replace_free_block(pool, current, new_free_block);
+        }
+        // The next search starts from the free block following the allocated one
+        pool->next_fit = new_free_block;
 
         // Adjust the current block size
         set_block_size(&(current->header), requested_size);
     }
+    else
+    {
+        // The whole block is used: the next search starts from the following free block
+        pool->next_fit = current->next;
+        remove_free_block(pool, current);
+    }
+
+    // Mark the block as used (its pages will be touched)
+    set_block_dirty(&(current->header));
+    set_block_used(&(current->header));
+    set_block_footer(&(current->header));
+
+    // Return the memory address after the header
+    return (void *)((char *)current + sizeof(mem_std_block_header_footer_t));
+}
+
+/* Counts an allocation in the statistics of the pool, and returns its payload */
+static void *count_alloc(mem_pool_t *pool, void *payload, size_t requested_size)
+{
+    mem_std_allocated_block_t *block = (mem_std_allocated_block_t *)((char *)payload - sizeof(mem_std_block_header_footer_t));
+    stats_count_alloc(&(pool->counters), requested_size, get_block_size(&(block->header)));
+    return payload;
+}
 
-    // removing the allocated block from the free list
-    if (current->prev != NULL)
+void *mem_alloc_standard_pool_clean(mem_pool_t *pool, size_t requested_size, void **zero_start, void **zero_end)
+{
+    mem_std_free_block_t *current;
+    size_t size = STD_ALIGN_SIZE(requested_size);
+    void *payload;
+
+    // Room for the links of the block once it is freed
+    if (size < STD_MIN_BLOCK_SIZE - sizeof(mem_std_block_header_footer_t) * 2)
     {
-        current->prev->next = current->next;
+        size = STD_MIN_BLOCK_SIZE - sizeof(mem_std_block_header_footer_t) * 2;
     }
-    if (current->next != NULL)
+    current = get_free_block(pool, size);
+    if (current == NULL)
     {
-        current->next->prev = current->prev;
+        return NULL;
     }
-    if (current == pool->first_free)
+    payload = allocate_block(pool, current, size, zero_start, zero_end);
+    // The zero range is known for the rounded size: the caller only clears the requested bytes
+    if (zero_end != NULL && (char *)*zero_end > (char *)payload + requested_size)
     {
-        pool->first_free = current->next;
+        *zero_end = (char *)payload + requested_size;
+        if (*zero_start > *zero_end)
+        {
+            *zero_start = *zero_end;
+        }
     }
+    return count_alloc(pool, payload, requested_size);
+}
 
-    // Mark the block as used
-    set_block_used(&(current->header));
-    mem_std_block_header_footer_t *footer = (mem_std_block_header_footer_t *)((char *)current + sizeof(mem_std_block_header_footer_t) + get_block_size(&(current->header)));
-    *footer = current->header;
+/*
+ * Aligned allocation: the free block is chosen large enough for the payload to be aligned
+ * anywhere in it, and the part located before the aligned payload is split off as a free
+ * block of its own (instead of being wasted in the allocated block).
+ */
+void *mem_alloc_standard_pool_aligned(mem_pool_t *pool, size_t requested_size, size_t alignment)
+{
+    mem_std_free_block_t *current;
+    size_t size = requested_size;
+    char *payload;
+    char *aligned;
 
-    // Return the memory address after the header
-    return (void *)((char *)current + sizeof(mem_std_block_header_footer_t));
+    if (alignment <= std_pool_align)
+    {
+        return mem_alloc_standard_pool_clean(pool, requested_size, NULL, NULL);
+    }
+    size = STD_ALIGN_SIZE(size);
+    if (size < STD_MIN_BLOCK_SIZE - sizeof(mem_std_block_header_footer_t) * 2)
+    {
+        size = STD_MIN_BLOCK_SIZE - sizeof(mem_std_block_header_footer_t) * 2;
+    }
+
+    current = get_free_block(pool, size + alignment + STD_MIN_BLOCK_SIZE);
+    if (current == NULL)
+    {
+        return NULL;
+    }
+
+    payload = (char *)current + sizeof(mem_std_block_header_footer_t);
+    aligned = (char *)(((uintptr_t)payload + alignment - 1) & ~(uintptr_t)(alignment - 1));
+    if (aligned != payload)
+    {
+        mem_std_free_block_t *b;
+        char *end = payload + get_block_size(&(current->header));
+
+        // The leading fragment must be large enough to be a free block
+        if ((size_t)(aligned - payload) < STD_MIN_BLOCK_SIZE)
+        {
+            aligned += (STD_MIN_BLOCK_SIZE - (size_t)(aligned - payload) + alignment - 1) & ~(alignment - 1);
+        }
+        b = (mem_std_free_block_t *)(aligned - sizeof(mem_std_block_header_footer_t));
+
+        // The block leaves the list first: its skip list tower may be overwritten by the header of b
+        remove_free_block(pool, current);
+
+        // Both parts are in the same state regarding the purges as the whole block
+        b->header = current->header;
+        set_block_size(&(b->header), (size_t)(end - aligned));
+        set_block_footer(&(b->header));
+        set_block_size(&(current->header), (size_t)((char *)b - payload) - sizeof(mem_std_block_header_footer_t));
+        set_block_footer(&(current->header));
+        insert_free_block(pool, current);
+        insert_free_block(pool, b);
+        current = b;
+    }
+    return count_alloc(pool, allocate_block(pool, current, size, NULL, NULL), requested_size);
 }
 
-void mem_free_standard_pool(mem_pool_t *pool, void *addr)
+/* Frees a block (without counting it in the statistics of the pool) */
+static void free_block(mem_pool_t *pool, void *addr)
 {
     // Get the address of the header of the block being freed by subtracting the size of the header
     mem_std_free_block_t *freed_block = (mem_std_free_block_t *)((char *)addr - sizeof(mem_std_block_header_footer_t));
+    mem_std_free_block_t *next_block = (mem_std_free_block_t *)get_next_block(&(freed_block->header));
+    mem_std_free_block_t *prev_block = NULL;
 
     // Mark the block as free
     set_block_free(&(freed_block->header));
+    set_block_footer(&(freed_block->header));
 
-    // Get the block footer
-    mem_std_block_header_footer_t *freed_block_footer = (mem_std_block_header_footer_t *)((char *)freed_block + sizeof(mem_std_block_header_footer_t) + get_block_size(&(freed_block->header)));
-    *freed_block_footer = freed_block->header; // Update the footer to match the header
+    // Note: the sentinels of the segment are marked as used
+    mem_std_block_header_footer_t *prev_footer = (mem_std_block_header_footer_t *)((char *)freed_block - sizeof(mem_std_block_header_footer_t));
+    if (is_block_free(prev_footer))
+    {
+        prev_block = (mem_std_free_block_t *)get_previous_block(&(freed_block->header));
+    }
+    if (is_block_used(&(next_block->header)))
+    {
+        next_block = NULL;
+    }
 
-    // Coalesce with the next block if it's free
-    mem_std_free_block_t *next_block = (mem_std_free_block_t *)((char *)freed_block_footer + sizeof(mem_std_block_header_footer_t));
-    if ((char *)next_block < (char *)pool->end_addr && is_block_free(&(next_block->header)))
+    // Coalesce with the next block if it's free: the freed block takes its place in the free list
+    if (next_block != NULL)
     {
-        // Merge current block with the next free block
-        size_t new_size = get_block_size(&(freed_block->header)) + sizeof(mem_std_block_header_footer_t) * 2 + get_block_size(&(next_block->header));
-        set_block_size(&(freed_block->header), new_size);
-        set_block_free(&(freed_block->header));
+        set_block_size(&(freed_block->header), get_block_size(&(freed_block->header)) + sizeof(mem_std_block_header_footer_t) * 2 + get_block_size(&(next_block->header)));
+        set_block_footer(&(freed_block->header));
+        replace_free_block(pool, next_block, freed_block);
+    }
 
-        // Update footer to match the new size
-        freed_block_footer = (mem_std_block_header_footer_t *)((char *)freed_block + sizeof(mem_std_block_header_footer_t) + get_block_size(&(freed_block->header)));
-        *freed_block_footer = freed_block->header;
+    // Coalesce with the previous block if it's free: it stays at its place in the free list
+    if (prev_block != NULL)
+    {
+        if (next_block != NULL)
+        {
+            remove_free_block(pool, freed_block);
+        }
+        set_block_dirty(&(prev_block->header));
+        resize_free_block(pool, prev_block, get_block_size(&(prev_block->header)) + sizeof(mem_std_block_header_footer_t) * 2 + get_block_size(&(freed_block->header)));
 
-        // Remove next block from the free list
-        if (next_block->next)
+        // The next fit search was to start from the absorbed block: it starts from the coalesced one
+        if (pool->next_fit == freed_block)
         {
-            next_block->next->prev = freed_block;
+            pool->next_fit = prev_block;
         }
-        freed_block->next = next_block->next;
+        freed_block = prev_block;
     }
 
-    // Coalesce with the previous block if it's free
-    mem_std_block_header_footer_t *prev_footer = (mem_std_block_header_footer_t *)((char *)freed_block - sizeof(mem_std_block_header_footer_t));
-
-    mem_std_free_block_t *prev_block;
-    if ((char *)freed_block > (char *)(pool->start_addr))
+    // No coalescing: insert the freed block into the free list
+    if (prev_block == NULL && next_block == NULL)
     {
-        // Get the previous block header
-        prev_block = (mem_std_free_block_t *)((char *)prev_footer - get_block_size(prev_footer) - sizeof(mem_std_block_header_footer_t));
+        insert_free_block(pool, freed_block);
     }
-    else
+}
+
+void mem_free_standard_pool(mem_pool_t *pool, void *addr)
+{
+    mem_std_allocated_block_t *block = (mem_std_allocated_block_t *)((char *)addr - sizeof(mem_std_block_header_footer_t));
+
+    stats_count_free(&(pool->counters), get_block_size(&(block->header)));
+    free_block(pool, addr);
+}
+
+/* Counts a reallocation in place in the statistics of the pool (as a free followed by an allocation) */
+static void *count_realloc(mem_pool_t *pool, void *addr, size_t old_size, size_t requested_size)
+{
+    stats_count_free(&(pool->counters), old_size);
+    return count_alloc(pool, addr, requested_size);
+}
+
+void *mem_realloc_standard_pool(mem_pool_t *pool, void *addr, size_t requested_size)
+{
+    mem_std_allocated_block_t *block = (mem_std_allocated_block_t *)((char *)addr - sizeof(mem_std_block_header_footer_t));
+    mem_std_free_block_t *next_block = (mem_std_free_block_t *)get_next_block(&(block->header));
+    size_t block_size = get_block_size(&(block->header));
+    size_t size = STD_ALIGN_SIZE(requested_size);
+    size_t min_split_size;
+
+    min_split_size = size + sizeof(mem_std_block_header_footer_t) * 2 + sizeof(mem_std_free_block_t) - sizeof(mem_std_block_header_footer_t);
+
+    if (size > block_size)
     {
-        prev_block = NULL;
+        // Grow: the following block must be free, and large enough once merged
+        size_t merged_size = block_size + sizeof(mem_std_block_header_footer_t) * 2 + get_block_size(&(next_block->header));
+        mem_std_block_header_footer_t next_header = next_block->header;
+        mem_std_free_block_t *after_next = next_block->next;
+
+        if (is_block_used(&(next_block->header)) || merged_size < size)
+        {
+            return NULL;
+        }
+
+        // The free block is removed before its metadata may be overwritten by the grown block
+        remove_free_block(pool, next_block);
+        if (merged_size > min_split_size)
+        {
+            // The rest of the free block stays free (in the same state regarding the purges)
+            mem_std_free_block_t *rest = (mem_std_free_block_t *)((char *)addr + size + sizeof(mem_std_block_header_footer_t));
+            rest->header = next_header;
+            set_block_size(&(rest->header), merged_size - size - sizeof(mem_std_block_header_footer_t) * 2);
+            set_block_footer(&(rest->header));
+            insert_free_block(pool, rest);
+            merged_size = size;
+            if (pool->next_fit == next_block)
+            {
+                pool->next_fit = rest;
+            }
+        }
+        else if (pool->next_fit == next_block)
+        {
+            pool->next_fit = after_next;
+        }
+        set_block_size(&(block->header), merged_size);
+        set_block_footer(&(block->header));
+        return count_realloc(pool, addr, block_size, requested_size);
     }
 
-    if ((char *)prev_block >= (char *)pool->start_addr && is_block_free(prev_footer))
+    // Shrink: the tail is freed as a block of its own (coalesced with the following block if it is free)
+    if (block_size > min_split_size)
     {
-        // Merge the previous block with the current block
-        size_t new_size = get_block_size(&(prev_block->header)) + sizeof(mem_std_block_header_footer_t) * 2 + get_block_size(&(freed_block->header));
-        set_block_size(&(prev_block->header), new_size);
-        set_block_free(&(prev_block->header));
+        mem_std_allocated_block_t *tail = (mem_std_allocated_block_t *)((char *)addr + size + sizeof(mem_std_block_header_footer_t));
+        tail->header.flag_and_size = 0;
+        set_block_size(&(tail->header), block_size - size - sizeof(mem_std_block_header_footer_t) * 2);
+        set_block_used(&(tail->header));
+        set_block_footer(&(tail->header));
+        set_block_size(&(block->header), size);
+        set_block_footer(&(block->header));
+        free_block(pool, (char *)tail + sizeof(mem_std_block_header_footer_t));
+    }
+    return count_realloc(pool, addr, block_size, requested_size);
+}
 
-        // Update footer of the merged block
-        freed_block_footer = (mem_std_block_header_footer_t *)((char *)prev_block + sizeof(mem_std_block_header_footer_t) + get_block_size(&(prev_block->header)));
-        *freed_block_footer = prev_block->header;
+void mem_get_free_blocks_standard_pool(mem_pool_t *pool, size_t *nb_blocks, size_t *largest, size_t *total)
+{
+    mem_std_free_block_t *b = (mem_std_free_block_t *)pool->first_free;
+    int bin = 0;
 
-        // Remove current block from the free list
-        if (freed_block->next)
+    *nb_blocks = 0;
+    *largest = 0;
+    *total = 0;
+    while (1)
+    {
+        // The segregated policies have one list per bin
+        if (pool->bins != NULL)
+        {
+            while (b == NULL && bin < STD_NB_BINS)
+            {
+                b = ((mem_std_bins_t *)pool->bins)->bins[bin++];
+            }
+        }
+        if (b == NULL)
         {
-            freed_block->next->prev = prev_block;
+            break;
         }
-        prev_block->next = freed_block->next;
-
-        freed_block = prev_block; // Continue coalescing from the previous block
+        (*nb_blocks)++;
+        *total += get_block_size(&(b->header));
+        if (get_block_size(&(b->header)) > *largest)
+        {
+            *largest = get_block_size(&(b->header));
+        }
+        b = b->next;
     }
+}
 
-    // Insert the freed (or coalesced) block back into the free list
-    mem_std_free_block_t *will_be_next = (mem_std_free_block_t *)pool->first_free;
-    mem_std_free_block_t *prev_will_be = NULL;
+/////////////////////////////////////////////////////////////////////////////
 
-    // Go to through the free list to set will_be_next to the position next to block
-    while (will_be_next != NULL && (char *)will_be_next < (char *)freed_block)
+/*
+ * Purging:
+ * the whole pages located inside a free block are given back to the OS (the block stays
+ * mapped and in the free list). The beginning of the block (header, list links and skip
+ * list tower) and its footer are kept, so the metadata pages remain resident.
+ * A free block covering a whole segment (other than the first one) is released with its
+ * segment instead, under the same rule: an empty segment is kept for reuse for at least a
+ * purge period, so alternately allocating and freeing a block does not map and unmap it.
+ * With MADV_DONTNEED, the purged pages hold zeros until the block is allocated (see
+ * mem_alloc_standard_pool_clean).
+ * The purge flags of a block (see mem_alloc_standard_pool_types.c) are cleared as soon as
+ * its pages may be touched again, i.e. when it is allocated or coalesced with a freed block.
+ * Note: a block only becomes eligible once it has been seen free by two passes, so a block
+ * freed and reallocated in between is not purged (avoiding page faults on a hot block).
+ */
+
+/* Returns 1 if a free block covers a whole segment, other than the first one of the pool */
+static int is_segment_free(mem_pool_t *pool, mem_std_free_block_t *b)
+{
+    mem_std_block_header_footer_t *prev_footer = (mem_std_block_header_footer_t *)((char *)b - sizeof(mem_std_block_header_footer_t));
+    return is_sentinel(prev_footer) && is_sentinel(get_next_block(&(b->header))) && (void *)b != pool->start_addr;
+}
+
+/* Purges a free block (or marks it as aged), and returns the number of bytes purged (or released) */
+static size_t purge_free_block(mem_pool_t *pool, mem_std_free_block_t *b, int force)
+{
+    char *first;
+    char *footer;
+    size_t purged = 0;
+
+    // An empty segment is released once aged, even if its pages were never touched
+    if (is_segment_free(pool, b))
     {
-        prev_will_be = will_be_next;
-        will_be_next = will_be_next->next;
+        mem_std_segment_t *segment = (mem_std_segment_t *)((char *)b - SEGMENT_HEAD_SIZE);
+
+        if (!force && !is_block_aged(&(b->header)))
+        {
+            set_block_aged(&(b->header));
+            set_block_footer(&(b->header));
+            return 0;
+        }
+        purged = segment->mapped_size;
+        remove_free_block(pool, b);
+        if (pool->next_fit == b)
+        {
+            pool->next_fit = NULL;
+        }
+        release_segment(pool, segment);
+        return purged;
     }
 
-    freed_block->next = will_be_next;
-    freed_block->prev = prev_will_be;
-    if (will_be_next != NULL)
+    get_purge_range(b, &first, &footer);
+    if (is_block_purged(&(b->header)))
     {
-        will_be_next->prev = freed_block;
+        return 0;
     }
-    if (prev_will_be != NULL)
+    if (!force && !is_block_aged(&(b->header)))
+    {
+        set_block_aged(&(b->header));
+        set_block_footer(&(b->header));
+        return 0;
+    }
+    if (footer > first)
     {
-        prev_will_be->next = freed_block;
+        purged = my_madvise_free(first, (size_t)(footer - first), get_segment_mapped_size(b));
+    }
+    set_block_purged(&(b->header));
+    set_block_footer(&(b->header));
+    return purged;
+}
+
+size_t mem_purge_standard_pool(mem_pool_t *pool, int force)
+{
+    mem_std_free_block_t *b;
+    mem_std_free_block_t *next;
+    size_t purged = 0;
+    int bin;
+
+    // The next block is read first: the block may leave the free list (with its segment)
+    if (pool->bins != NULL)
+    {
+        mem_std_bins_t *bins = (mem_std_bins_t *)pool->bins;
+        for (bin = find_next_bin(bins, 0); bin >= 0; bin = find_next_bin(bins, bin + 1))
+        {
+            for (b = bins->bins[bin]; b != NULL; b = next)
+            {
+                next = b->next;
+                purged += purge_free_block(pool, b, force);
+            }
+        }
     }
     else
     {
-        pool->first_free = freed_block; // This is the new head of the free list
+        for (b = (mem_std_free_block_t *)pool->first_free; b != NULL; b = next)
+        {
+            next = b->next;
+            purged += purge_free_block(pool, b, force);
+        }
     }
+    debug_printf("Standard pool %d: %zu bytes purged\n", pool->pool_id, purged);
+    return purged;
 }
 
 size_t mem_get_allocated_block_size_standard_pool(mem_pool_t *pool, void *addr)
@@ -14,17 +14,26 @@ typedef enum
 {
     FIRST_FIT = 1,
     BEST_FIT = 2,
-    NEXT_FIT = 3
+    NEXT_FIT = 3,
+    SEGREGATED_FIT = 4,
+    TLSF = 5 /* two-level segregated fit */
 } std_pool_placement_policy_t;
 
 #define DEFAULT_STDPOOL_POLICY FIRST_FIT
 
+/* Placement policy of the standard pools (read when a pool is initialized and upon each allocation) */
+extern std_pool_placement_policy_t std_pool_policy;
+
+/* Alignment (a power of two, at most STD_MAX_ALIGN) of the payloads of the standard pools (must not change once a pool is initialized) */
+#define STD_MAX_ALIGN 16
+extern size_t std_pool_align;
+
 /////////////////////////////////////////////////////////////////////////////
 
 /* Structure declaration for the header or footer of a standard block */
 typedef struct mem_std_block_headerfooter
 {
-    uint64_t flag_and_size; // bit 63: boolean (0 = free); bits 62-0: payload size
+    uint64_t flag_and_size; // bit 63: boolean (0 = free); bit 62: purged; bit 61: aged; bits 60-0: payload size
 } mem_std_block_header_footer_t;
 
 /* Structure declaration for the start of a standard free block */
@@ -41,14 +50,78 @@ typedef struct mem_std_allocated_block
     mem_std_block_header_footer_t header;
 } mem_std_allocated_block_t;
 
+/*
+ * Size bins of the segregated policies: one free list per range of sizes, and
+ * a bitmap of the non-empty bins (summarized by one bit per word of the bitmap).
+ * With TLSF, a word of the bitmap covers the 64 second-level bins of a power of 2,
+ * so the summary is the first-level bitmap.
+ */
+#define TLSF_SL_LOG2 6
+#define STD_NB_BINS (64 << TLSF_SL_LOG2)
+
+typedef struct mem_std_bins
+{
+    uint64_t summary;                        /* bit w set if bitmap[w] != 0 */
+    uint64_t bitmap[STD_NB_BINS / 64];       /* bit b % 64 of word b / 64 set if bin b is not empty */
+    mem_std_free_block_t *bins[STD_NB_BINS]; /* free blocks of each bin, most recently freed first */
+} mem_std_bins_t;
+
+/* Maximum height of a free block in the skip list indexing the address-ordered free list */
+#define STD_SKIP_LEVELS 16
+
+/* Structure declaration for the descriptor of a segment (located at the beginning of the segment) */
+typedef struct mem_std_segment
+{
+    struct mem_std_segment *prev; /* more recently mapped segment of the pool */
+    struct mem_std_segment *next; /* less recently mapped segment of the pool */
+    char *start;                  /* header of the first block */
+    char *end;                    /* end of the footer of the last block (where the epilogue is located) */
+    size_t offset;                /* position of the segment in the pool (used for the traces) */
+    size_t mapped_size;           /* size of the mapping (metadata included) */
+} mem_std_segment_t;
+
 /////////////////////////////////////////////////////////////////////////////
 
 /* Functions for the management of a standard pool */
 void init_standard_pool(mem_pool_t *p, size_t size, size_t min_request_size, size_t max_request_size);
 void *mem_alloc_standard_pool(mem_pool_t *pool, size_t size);
+
+/*
+ * Same as mem_alloc_standard_pool, and gives the part [*zero_start, *zero_end) of the payload
+ * known to hold zeros (pages never touched since they were mapped or purged), so that calloc
+ * only has to clear the rest of the block (the range is empty if nothing is known).
+ * The range lies within the first size bytes of the payload.
+ */
+void *mem_alloc_standard_pool_clean(mem_pool_t *pool, size_t size, void **zero_start, void **zero_end);
+
+/*
+ * Same as mem_alloc_standard_pool, with a payload aligned on alignment bytes (a power of two).
+ * The space located before the aligned payload is given back to the free list.
+ */
+void *mem_alloc_standard_pool_aligned(mem_pool_t *pool, size_t size, size_t alignment);
 void mem_free_standard_pool(mem_pool_t *pool, void *addr);
 size_t mem_get_allocated_block_size_standard_pool(mem_pool_t *pool, void *addr);
 
+/*
+ * Resizes a block without moving it (pool lock held): it grows by absorbing the following
+ * block if it is free and large enough, and shrinks by giving back its tail.
+ * Returns addr on success, or NULL if the block cannot grow in place (it is then left untouched).
+ */
+void *mem_realloc_standard_pool(mem_pool_t *pool, void *addr, size_t size);
+
+/*
+ * Gives back to the OS the whole pages located inside the free blocks, and the segments
+ * entirely free (pool lock held). If force is 0, a block is only purged if it was already
+ * free at the previous pass (the first pass marks it as aged). Returns the number of bytes purged.
+ */
+size_t mem_purge_standard_pool(mem_pool_t *pool, int force);
+
+/*
+ * Gives the number of free blocks of the pool, the payload size of the largest one and
+ * their total payload size (pool lock held).
+ */
+void mem_get_free_blocks_standard_pool(mem_pool_t *pool, size_t *nb_blocks, size_t *largest, size_t *total);
+
 /////////////////////////////////////////////////////////////////////////////
 
 /* Functions for managing the contents of a header or footer */
@@ -71,6 +144,22 @@ size_t get_block_size(mem_std_block_header_footer_t *m);
 /* Modifies a block header (or footer) to update the size of the block */
 void set_block_size(mem_std_block_header_footer_t *m, size_t size);
 
+/* Flags of the free blocks used by the purge passes (the size and the used flag are not modified) */
+int is_block_purged(mem_std_block_header_footer_t *m);
+int is_block_aged(mem_std_block_header_footer_t *m);
+void set_block_purged(mem_std_block_header_footer_t *m);
+void set_block_aged(mem_std_block_header_footer_t *m);
+void set_block_dirty(mem_std_block_header_footer_t *m);
+
+/* Copies a block header to the footer of the block (located according to the size in the header) */
+void set_block_footer(mem_std_block_header_footer_t *header);
+
+/* Returns the header of the block located right after a given block (given by its header) */
+mem_std_block_header_footer_t *get_next_block(mem_std_block_header_footer_t *header);
+
+/* Returns the header of the block located right before a given block (given by its header), using the footer of the former */
+mem_std_block_header_footer_t *get_previous_block(mem_std_block_header_footer_t *header);
+
 /////////////////////////////////////////////////////////////////////////////
 
 #endif /* !_MEM_ALLOC_STANDARD_POOL_H_ */
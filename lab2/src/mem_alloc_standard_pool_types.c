@@ -25,13 +25,55 @@ void set_block_free(mem_std_block_header_footer_t *m) {
 
 /* Returns the size of a block (as stored in the header/footer) */
 size_t get_block_size(mem_std_block_header_footer_t *m) {
-    uint64_t res = ((m->flag_and_size) & ~(1UL<<63));
+    uint64_t res = ((m->flag_and_size) & ~((1UL<<63) | (1UL<<62) | (1UL<<61)));
     return (size_t)res;
 }
 
 /* Modifies a block header (or footer) to update the size of the block */
 void set_block_size(mem_std_block_header_footer_t *m, size_t size) {
     uint64_t s = (uint64_t)size;
-    uint64_t flag = (m->flag_and_size) & (1UL<<63);
+    uint64_t flag = (m->flag_and_size) & ((1UL<<63) | (1UL<<62) | (1UL<<61));
     m->flag_and_size = flag | s;
 }
+
+/* Returns 1 if the pages of a free block have been given back to the OS since it was freed */
+int is_block_purged(mem_std_block_header_footer_t *m) {
+    return (((m->flag_and_size)>>62) & 1UL);
+}
+
+/* Returns 1 if a free block has survived a purge pass without being purged */
+int is_block_aged(mem_std_block_header_footer_t *m) {
+    return (((m->flag_and_size)>>61) & 1UL);
+}
+
+/* Modifies a block header (or footer) to mark its pages as given back to the OS */
+void set_block_purged(mem_std_block_header_footer_t *m) {
+    m->flag_and_size = ((m->flag_and_size) | (1UL<<62)) & ~(1UL<<61);
+}
+
+/* Modifies a block header (or footer) to mark it as having survived a purge pass */
+void set_block_aged(mem_std_block_header_footer_t *m) {
+    m->flag_and_size = ((m->flag_and_size) | (1UL<<61));
+}
+
+/* Modifies a block header (or footer) to mark its pages as possibly in use (neither purged nor aged) */
+void set_block_dirty(mem_std_block_header_footer_t *m) {
+    m->flag_and_size = ((m->flag_and_size) & ~((1UL<<62) | (1UL<<61)));
+}
+
+/* Copies a block header to the footer of the block (located according to the size in the header) */
+void set_block_footer(mem_std_block_header_footer_t *header) {
+    mem_std_block_header_footer_t *footer = (mem_std_block_header_footer_t *)((char *)header + sizeof(mem_std_block_header_footer_t) + get_block_size(header));
+    *footer = *header;
+}
+
+/* Returns the header of the block located right after a given block (given by its header) */
+mem_std_block_header_footer_t *get_next_block(mem_std_block_header_footer_t *header) {
+    return (mem_std_block_header_footer_t *)((char *)header + get_block_size(header) + sizeof(mem_std_block_header_footer_t) * 2);
+}
+
+/* Returns the header of the block located right before a given block (given by its header), using the footer of the former */
+mem_std_block_header_footer_t *get_previous_block(mem_std_block_header_footer_t *header) {
+    mem_std_block_header_footer_t *prev_footer = header - 1;
+    return (mem_std_block_header_footer_t *)((char *)prev_footer - get_block_size(prev_footer) - sizeof(mem_std_block_header_footer_t));
+}
@@ -0,0 +1,61 @@
+#ifndef   	_MEM_ALLOC_STATS_H_
+#define   	_MEM_ALLOC_STATS_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "mem_alloc_types.h"
+
+/*
+ * Updates of the counters of a pool (see mem_pool_counters_t).
+ * The plain versions are used under the pool lock, the atomic ones by the
+ * pools that are not protected by a lock (huge pool, remote frees): their
+ * operations are much more expensive than these updates anyway.
+ */
+
+static inline void stats_update_peak(mem_pool_counters_t *c)
+{
+    uint64_t in_use = c->allocated_bytes - c->freed_bytes;
+    if (in_use > c->peak_bytes)
+    {
+        c->peak_bytes = in_use;
+    }
+}
+
+static inline void stats_count_alloc(mem_pool_counters_t *c, size_t requested, size_t allocated)
+{
+    c->nb_allocs++;
+    c->requested_bytes += requested;
+    c->allocated_bytes += allocated;
+    stats_update_peak(c);
+}
+
+static inline void stats_count_free(mem_pool_counters_t *c, size_t freed)
+{
+    c->nb_frees++;
+    c->freed_bytes += freed;
+}
+
+static inline void stats_count_alloc_atomic(mem_pool_counters_t *c, size_t requested, size_t allocated)
+{
+    uint64_t allocated_bytes;
+    uint64_t in_use;
+    uint64_t peak;
+
+    __atomic_fetch_add(&(c->nb_allocs), 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&(c->requested_bytes), requested, __ATOMIC_RELAXED);
+    allocated_bytes = __atomic_add_fetch(&(c->allocated_bytes), allocated, __ATOMIC_RELAXED);
+    in_use = allocated_bytes - __atomic_load_n(&(c->freed_bytes), __ATOMIC_RELAXED);
+    peak = __atomic_load_n(&(c->peak_bytes), __ATOMIC_RELAXED);
+    while (in_use > peak && !__atomic_compare_exchange_n(&(c->peak_bytes), &peak, in_use, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+    {
+    }
+}
+
+static inline void stats_count_free_atomic(mem_pool_counters_t *c, size_t freed)
+{
+    __atomic_fetch_add(&(c->nb_frees), 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&(c->freed_bytes), freed, __ATOMIC_RELAXED);
+}
+
+#endif      /* !_MEM_ALLOC_STATS_H_ */
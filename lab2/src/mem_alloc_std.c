@@ -4,12 +4,19 @@
 #include <stdio.h>
 #include <assert.h>
 #include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <malloc.h>
 
 #include "mem_alloc.h"
 #include "mem_alloc_types.h"
 
 
-static int __mem_alloc_init_flag=0;
+/* Set in the thread running memory_init (its nested requests are served by the bootstrap buffers) */
+static __thread int __mem_alloc_init_flag __attribute__((tls_model("initial-exec"))) = 0;
+
+/* Serializes the initialization when the first requests come from several threads */
+static pthread_mutex_t __mem_alloc_init_lock = PTHREAD_MUTEX_INITIALIZER;
 
 /****************************************************************************/
 /*
@@ -92,6 +99,31 @@ int is_bootstrap_buffer(void *p) {
     return res;
 }
 
+/*
+ * Initializes the allocator upon the first request.
+ * Returns 1 if the current request must be served by the bootstrap buffers
+ * (i.e., if it was issued from inside memory_init), 0 otherwise.
+ */
+static int mem_alloc_init(void) {
+    if (__atomic_load_n(&__mem_alloc_init_completed, __ATOMIC_ACQUIRE)) {
+        return 0;
+    }
+    if (__mem_alloc_init_flag) {
+        return 1;
+    }
+    pthread_mutex_lock(&__mem_alloc_init_lock);
+    if (!__mem_alloc_init_completed) {
+        __mem_alloc_init_flag = 1;
+        init_bootstrap_buffers();
+        memory_init();
+        debug_printf("memory_init completed\n"); // FOR DEBUG ONLY
+        __mem_alloc_init_flag = 0;
+        __atomic_store_n(&__mem_alloc_init_completed, 1, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&__mem_alloc_init_lock);
+    return 0;
+}
+
 /****************************************************************************/
 
 
@@ -100,14 +132,7 @@ void *malloc(size_t size){
 
   debug_printf("enter: size = %ld\n", size);
 
-  if(!__mem_alloc_init_flag){
-      __mem_alloc_init_flag = 1;
-      init_bootstrap_buffers();
-      memory_init();
-      debug_printf("memory_init completed\n"); // FOR DEBUG ONLY
-      //print_info();
-      __mem_alloc_init_completed = 1;
-  } else if (!__mem_alloc_init_completed) {
+  if (mem_alloc_init()) {
       res = handle_bootstrap_alloc(size);
       debug_printf("return = %p\n", res);
       return res;
@@ -127,6 +152,15 @@ void free(void *p){
     }
 
     if (p == NULL) return;
+
+    if (find_pool_from_block_address(p) == -1) {
+        /* The block comes from the "real/original" malloc heap (e.g., allocated by a function that is not interposed). */
+        assert(o_free != NULL);
+        o_free(p);
+        debug_printf("return\n");
+        return;
+    }
+
     memory_free(p);
     /*print_free_blocks();*/
     debug_printf("return\n");
@@ -139,14 +173,10 @@ void *calloc(size_t nmemb, size_t size)
     
     debug_printf("enter: nmemb = %ld, size = %ld\n", nmemb, size);
 
-    if(!__mem_alloc_init_flag){
-        __mem_alloc_init_flag = 1;
-        init_bootstrap_buffers();
-        memory_init();
-        //print_info();
-        __mem_alloc_init_completed = 1;
-    } else if (!__mem_alloc_init_completed) {
-      return handle_bootstrap_alloc(size);
+    if (mem_alloc_init()) {
+      /* the bootstrap buffers are cleared when they are released */
+      assert(nmemb <= BOOTSTRAP_BUFFER_SIZE && size <= BOOTSTRAP_BUFFER_SIZE);
+      return handle_bootstrap_alloc(nmemb * size);
     }
 
 #ifdef CALLOC_INTERPOSITION_PASSTROUGH
@@ -156,9 +186,10 @@ void *calloc(size_t nmemb, size_t size)
     return res;
 #endif
 
-    res = memory_alloc(size*nmemb);
-    if (res != NULL) {
-        explicit_bzero(res, size);
+    /* only the memory that may not hold zeros is cleared (see memory_calloc) */
+    res = memory_calloc(nmemb, size);
+    if (res == NULL) {
+        errno = ENOMEM; /* nmemb * size overflows */
     }
 
     debug_printf("return = %p\n", res);
@@ -169,20 +200,12 @@ void *calloc(size_t nmemb, size_t size)
 void *realloc(void *ptr, size_t size){
 
     void *new;
-    size_t old_size;
     void *res;
 
     debug_printf("enter: ptr = %p, size = %ld\n", ptr, size);
 
     /* This should not be needed if realloc is used properly but just in case ... */
-    if(!__mem_alloc_init_flag){ 
-        __mem_alloc_init_flag = 1;
-        init_bootstrap_buffers();
-        memory_init();
-        printf("memory_init completed\n"); // FOR DEBUG ONLY
-        //print_info();
-        __mem_alloc_init_completed = 1;
-    } else if (!__mem_alloc_init_completed) {
+    if (mem_alloc_init()) {
       assert(0); /* Support for bootstrap realloc not implemented */
     }
 
@@ -199,7 +222,6 @@ void *realloc(void *ptr, size_t size){
         return res;
     }
 
-#if (defined(DISABLE_FAST_POOL_ALLOC) || defined(DISABLE_STD_POOL_ALLOC) || defined(DISABLE_CALLOC_INTERPOSITION) || defined(CALLOC_INTERPOSITION_PASSTROUGH) )
     /* Note: we assume that the pointer is valid. */    
     if (find_pool_from_block_address(ptr) == -1) {
         /* 
@@ -211,20 +233,146 @@ void *realloc(void *ptr, size_t size){
         debug_printf("return = %p\n", res);
         return res;
     }
-#endif
 
-    /*
-     * The reallocation is naive/suboptimal (systematic copy) but does not require to
-     * expose much of the allocator internals, nor to support realloc within the allocator.
-     */
-    new = memory_alloc(size);
-    if (new == NULL) {
-        /* The original block is left untouched, as required in the specification. */
-        return NULL; 
-    }
-    old_size = memory_get_allocated_block_size(ptr);
-    memcpy(new, ptr, old_size); /* works because the two areas do not overlap */
-    free(ptr);
+    /* The block is resized in place when possible (see memory_realloc) */
+    new = memory_realloc(ptr, size);
     debug_printf("return = %p\n", new);
     return new;
 }
+
+/* Returns 1 if some memory was given back to the OS (the pad argument is ignored) */
+int malloc_trim(size_t pad){
+    size_t purged;
+
+    debug_printf("enter: pad = %ld\n", pad);
+
+    if (!__atomic_load_n(&__mem_alloc_init_completed, __ATOMIC_ACQUIRE)) {
+        return 0;
+    }
+
+    purged = memory_trim();
+    debug_printf("return = %ld\n", purged);
+    return (purged > 0);
+}
+
+/* Common part of the aligned allocation functions (alignment is a power of two) */
+static void *aligned_alloc_common(size_t alignment, size_t size){
+    void *res;
+
+    if (mem_alloc_init()) {
+      assert(0); /* Support for bootstrap aligned allocations not implemented */
+    }
+
+    res = memory_alloc_aligned(alignment, size);
+    debug_printf("return = %p\n", res);
+    return res;
+}
+
+int posix_memalign(void **memptr, size_t alignment, size_t size){
+    void *res;
+
+    debug_printf("enter: alignment = %ld, size = %ld\n", alignment, size);
+
+    if (alignment == 0 || alignment % sizeof(void*) != 0 || (alignment & (alignment - 1)) != 0) {
+        return EINVAL;
+    }
+    res = aligned_alloc_common(alignment, size);
+    if (res == NULL) {
+        return ENOMEM;
+    }
+    *memptr = res;
+    return 0;
+}
+
+void *aligned_alloc(size_t alignment, size_t size){
+    debug_printf("enter: alignment = %ld, size = %ld\n", alignment, size);
+
+    if (alignment == 0 || (alignment & (alignment - 1)) != 0) {
+        errno = EINVAL;
+        return NULL;
+    }
+    return aligned_alloc_common(alignment, size);
+}
+
+/* Obsolete: the alignment is rounded up to a power of two (as glibc does) */
+void *memalign(size_t alignment, size_t size){
+    size_t a = 1;
+
+    debug_printf("enter: alignment = %ld, size = %ld\n", alignment, size);
+
+    while (a < alignment) {
+        if (a > SIZE_MAX / 2) {
+            errno = EINVAL;
+            return NULL;
+        }
+        a *= 2;
+    }
+    return aligned_alloc_common(a, size);
+}
+
+/* Returns the payload size of an allocated block (0 for NULL) */
+size_t malloc_usable_size(void *ptr){
+    size_t res;
+
+    debug_printf("enter: ptr = %p\n", ptr);
+
+    if (ptr == NULL) {
+        return 0;
+    }
+    if (is_bootstrap_buffer(ptr)) {
+        return BOOTSTRAP_BUFFER_SIZE;
+    }
+    if (find_pool_from_block_address(ptr) == -1) {
+        /* The block comes from the "real/original" malloc heap */
+        assert(o_malloc_usable_size != NULL);
+        return o_malloc_usable_size(ptr);
+    }
+
+    res = memory_get_allocated_block_size(ptr);
+    debug_printf("return = %ld\n", res);
+    return res;
+}
+
+/*
+ * Statistics in the format of glibc (see memory_get_stats): the fast pools hold the
+ * small blocks (fastbins), the standard arenas the ordinary ones and the huge pool
+ * the mmapped ones.
+ */
+struct mallinfo2 mallinfo2(void){
+    struct mallinfo2 res;
+    mem_stats_t stats;
+    int i;
+
+    debug_printf("enter\n");
+
+    memset(&res, 0, sizeof(res));
+    if (!__atomic_load_n(&__mem_alloc_init_completed, __ATOMIC_ACQUIRE)) {
+        return res;
+    }
+
+    memory_get_stats(&stats);
+    for (i = 0; i < stats.nb_pools; i++) {
+        mem_pool_stats_t *ps = &(stats.pools[i]);
+        switch (ps->pool_type) {
+        case FAST_POOL:
+            res.arena += ps->mapped_bytes;
+            res.uordblks += ps->in_use_bytes;
+            res.smblks += ps->nb_free_blocks;
+            res.fsmblks += ps->free_bytes;
+            res.fordblks += ps->free_bytes;
+            break;
+        case STANDARD_POOL:
+            res.arena += ps->mapped_bytes;
+            res.uordblks += ps->in_use_bytes;
+            res.ordblks += ps->nb_free_blocks;
+            res.fordblks += ps->free_bytes;
+            break;
+        case HUGE_POOL:
+            res.hblks += ps->nb_allocs - ps->nb_frees;
+            res.hblkhd += ps->mapped_bytes;
+            break;
+        }
+    }
+    debug_printf("return\n");
+    return res;
+}
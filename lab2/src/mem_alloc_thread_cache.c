@@ -0,0 +1,307 @@
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "mem_alloc_thread_cache.h"
+#include "mem_alloc_fast_pool.h"
+#include "mem_alloc.h"
+#include "my_mmap.h"
+
+/*
+ * The TLS variables must not be allocated lazily by the dynamic loader
+ * (this would call malloc from inside malloc when built as libmalloc.so).
+ */
+#define TLS_INITIAL_EXEC __attribute__((tls_model("initial-exec")))
+
+/* State of the cache of a thread */
+typedef enum
+{
+    TCACHE_NONE = 0,    /* not created yet */
+    TCACHE_ACTIVE = 1,  /* in use */
+    TCACHE_RELEASED = 2 /* the thread is exiting: the pools are used directly */
+} tcache_state_t;
+
+static __thread thread_cache_t *my_cache TLS_INITIAL_EXEC = NULL;
+static __thread tcache_state_t my_cache_state TLS_INITIAL_EXEC = TCACHE_NONE;
+
+/* Used to be notified when a thread exits */
+static pthread_key_t tcache_key;
+
+/* Protects the three lists below */
+static pthread_mutex_t tcache_lock = PTHREAD_MUTEX_INITIALIZER;
+/* All the caches ever created (their counters outlive their thread) */
+static thread_cache_t *all_caches = NULL;
+/* Caches released by exited threads */
+static thread_cache_t *recycled_caches = NULL;
+/* Never used caches of the last mapped chunk */
+static thread_cache_t *spare_caches = NULL;
+static size_t nb_spare_caches = 0;
+
+/* Gives back the bottom of the list of a bin (i.e. all but the keep most recent blocks) to the pool */
+static void flush_bin(thread_cache_bin_t *bin, unsigned int keep)
+{
+    mem_fast_free_block_t *last_kept = NULL;
+    mem_fast_free_block_t *first;
+    mem_fast_free_block_t *last;
+    unsigned int i;
+
+    if (bin->count <= keep)
+    {
+        return;
+    }
+
+    first = (mem_fast_free_block_t *)bin->head;
+    for (i = 0; i < keep; i++)
+    {
+        last_kept = first;
+        first = first->next;
+    }
+    last = first;
+    while (last->next != NULL)
+    {
+        last = last->next;
+    }
+
+    if (last_kept != NULL)
+    {
+        last_kept->next = NULL;
+    }
+    else
+    {
+        bin->head = NULL;
+    }
+    // The fresh blocks are the bottom ones: those given back lose this property
+    bin->nb_fresh = (keep + bin->nb_fresh > bin->count) ? keep + bin->nb_fresh - bin->count : 0;
+    bin->count = keep;
+    mem_free_fast_pool_batch(bin->pool, first, last);
+}
+
+/* Called by pthread when a thread having a cache exits */
+static void release_thread_cache(void *arg)
+{
+    thread_cache_t *tc = (thread_cache_t *)arg;
+    int i;
+
+    for (i = 0; i < NB_FAST_POOLS; i++)
+    {
+        flush_bin(&(tc->bins[i]), 0);
+    }
+    my_cache = NULL;
+    my_cache_state = TCACHE_RELEASED;
+
+    pthread_mutex_lock(&tcache_lock);
+    tc->next = recycled_caches;
+    recycled_caches = tc;
+    pthread_mutex_unlock(&tcache_lock);
+}
+
+/* Returns the cache of the calling thread (creating it if needed), or NULL if it cannot have one */
+static thread_cache_t *get_thread_cache(void)
+{
+    thread_cache_t *tc;
+
+    if (my_cache_state == TCACHE_ACTIVE)
+    {
+        return my_cache;
+    }
+    if (my_cache_state == TCACHE_RELEASED)
+    {
+        return NULL;
+    }
+
+    pthread_mutex_lock(&tcache_lock);
+    if (recycled_caches != NULL)
+    {
+        tc = recycled_caches;
+        recycled_caches = tc->next;
+    }
+    else
+    {
+        if (nb_spare_caches == 0)
+        {
+            spare_caches = my_mmap(TCACHE_CHUNK * sizeof(thread_cache_t));
+            nb_spare_caches = (spare_caches != NULL) ? TCACHE_CHUNK : 0;
+        }
+        tc = (nb_spare_caches > 0) ? spare_caches++ : NULL;
+        if (tc != NULL)
+        {
+            // The new caches are fresh mapped memory (cleared)
+            nb_spare_caches--;
+            tc->all_next = all_caches;
+            __atomic_store_n(&all_caches, tc, __ATOMIC_RELEASE);
+        }
+    }
+    pthread_mutex_unlock(&tcache_lock);
+
+    if (tc == NULL)
+    {
+        /* Running out of memory: this thread goes directly to the pools */
+        my_cache_state = TCACHE_RELEASED;
+        return NULL;
+    }
+    // A recycled cache has been flushed: it only keeps its counters
+    pthread_setspecific(tcache_key, tc);
+
+    my_cache = tc;
+    my_cache_state = TCACHE_ACTIVE;
+    return tc;
+}
+
+/* Sets up a bin the first time the thread uses the corresponding pool */
+static void init_bin(thread_cache_bin_t *bin, mem_pool_t *pool)
+{
+    size_t max = TCACHE_MAX_BYTES / pool->max_req_size;
+
+    if (max < TCACHE_MIN_BLOCKS)
+    {
+        max = TCACHE_MIN_BLOCKS;
+    }
+    if (max > TCACHE_MAX_BLOCKS)
+    {
+        max = TCACHE_MAX_BLOCKS;
+    }
+    bin->max = (unsigned int)max;
+    bin->pool = pool;
+}
+
+void thread_cache_init(void)
+{
+    pthread_key_create(&tcache_key, release_thread_cache);
+}
+
+/* Counter updates (relaxed stores: the owner is the only writer, memory_get_stats may read them at any time) */
+static inline void count_event(uint64_t *counter, uint64_t n)
+{
+    __atomic_store_n(counter, *counter + n, __ATOMIC_RELAXED);
+}
+
+/* Pops a block from the cache of the calling thread, *fresh being set to 1 if it has never been used */
+static void *cache_alloc(mem_pool_t *pool, size_t size, int *fresh)
+{
+    thread_cache_t *tc = get_thread_cache();
+    thread_cache_bin_t *bin;
+    mem_fast_free_block_t *b;
+    size_t nb_fresh;
+
+    *fresh = 0;
+    if (tc == NULL)
+    {
+        return mem_alloc_fast_pool(pool, size);
+    }
+
+    bin = &(tc->bins[pool->pool_id]);
+    if (bin->head == NULL)
+    {
+        if (bin->pool == NULL)
+        {
+            init_bin(bin, pool);
+        }
+        // Refill the list with half of its capacity (a single lock acquisition)
+        bin->count = mem_alloc_fast_pool_batch(pool, &(bin->head), bin->max / 2, &nb_fresh);
+        bin->nb_fresh = (unsigned int)nb_fresh;
+        if (bin->count == 0)
+        {
+            return NULL; // No free blocks available in this pool
+        }
+    }
+
+    b = (mem_fast_free_block_t *)bin->head;
+    bin->head = b->next;
+    if (bin->count <= bin->nb_fresh)
+    {
+        *fresh = 1;
+        bin->nb_fresh--;
+    }
+    bin->count--;
+    count_event(&(bin->nb_allocs), 1);
+    count_event(&(bin->requested_bytes), size);
+    return b;
+}
+
+void *thread_cache_alloc(mem_pool_t *pool, size_t size)
+{
+    int fresh;
+    return cache_alloc(pool, size, &fresh);
+}
+
+void *thread_cache_calloc(mem_pool_t *pool, size_t size)
+{
+    int fresh;
+    mem_fast_free_block_t *b = cache_alloc(pool, size, &fresh);
+
+    if (b != NULL)
+    {
+        if (fresh)
+        {
+            b->next = NULL; // The link to the next block is the only data written in a fresh block
+        }
+        else
+        {
+            memset(b, 0, size);
+        }
+    }
+    return b;
+}
+
+void thread_cache_free(mem_pool_t *pool, void *b)
+{
+    thread_cache_t *tc = get_thread_cache();
+    thread_cache_bin_t *bin;
+
+    if (tc == NULL)
+    {
+        mem_free_fast_pool(pool, b);
+        return;
+    }
+
+    bin = &(tc->bins[pool->pool_id]);
+    if (bin->pool == NULL)
+    {
+        init_bin(bin, pool);
+    }
+    ((mem_fast_free_block_t *)b)->next = bin->head;
+    bin->head = b;
+    bin->count++;
+    count_event(&(bin->nb_frees), 1);
+
+    if (bin->count > bin->max)
+    {
+        // Keep the most recently freed half, which is the most likely to be reused soon
+        flush_bin(bin, bin->max / 2);
+    }
+}
+
+void thread_cache_flush(void)
+{
+    int i;
+
+    if (my_cache_state != TCACHE_ACTIVE)
+    {
+        return;
+    }
+    for (i = 0; i < NB_FAST_POOLS; i++)
+    {
+        if (my_cache->bins[i].pool != NULL)
+        {
+            flush_bin(&(my_cache->bins[i]), 0);
+        }
+    }
+}
+
+void thread_cache_get_counters(int pool_id, uint64_t *nb_allocs, uint64_t *nb_frees, uint64_t *requested_bytes)
+{
+    thread_cache_t *tc;
+
+    *nb_allocs = 0;
+    *nb_frees = 0;
+    *requested_bytes = 0;
+    // The caches are never unmapped: the list only grows, at its head
+    for (tc = __atomic_load_n(&all_caches, __ATOMIC_ACQUIRE); tc != NULL; tc = tc->all_next)
+    {
+        thread_cache_bin_t *bin = &(tc->bins[pool_id]);
+        *nb_allocs += __atomic_load_n(&(bin->nb_allocs), __ATOMIC_RELAXED);
+        *nb_frees += __atomic_load_n(&(bin->nb_frees), __ATOMIC_RELAXED);
+        *requested_bytes += __atomic_load_n(&(bin->requested_bytes), __ATOMIC_RELAXED);
+    }
+}
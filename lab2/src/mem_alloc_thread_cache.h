@@ -0,0 +1,75 @@
+#ifndef   	_MEM_ALLOC_THREAD_CACHE_H_
+#define   	_MEM_ALLOC_THREAD_CACHE_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "mem_alloc_types.h"
+
+/*
+ * Per-thread caches placed in front of the fast pools.
+ *
+ * Each thread owns one LIFO list of free blocks per fast pool. Allocations
+ * and deallocations are served from this list without any synchronization.
+ * The shared free list of the pool (protected by the pool lock) is only
+ * accessed by batches: to refill an empty list, or to give back the oldest
+ * half of a list that grew above its limit. Giving back blocks does not take
+ * the lock (see the remote free stack in mem_alloc_fast_pool.c), so a thread
+ * freeing blocks allocated by another one never waits for it.
+ *
+ * Note: the cached blocks are always the most recently freed ones, so the
+ * order in which blocks are handed out is the same as with a single free list.
+ */
+
+/* Maximum amount of memory (in bytes) kept by one thread for one fast pool */
+#ifndef TCACHE_MAX_BYTES
+#define TCACHE_MAX_BYTES 16384
+#endif
+
+/* Bounds on the number of blocks kept by one thread for one fast pool */
+#define TCACHE_MIN_BLOCKS 4
+#define TCACHE_MAX_BLOCKS 64
+
+/* Number of caches mapped at once (they are recycled when a thread exits) */
+#define TCACHE_CHUNK 64
+
+/* List of the blocks cached by a thread for one fast pool */
+typedef struct thread_cache_bin {
+    void *head;         /* most recently freed block */
+    unsigned int count; /* number of blocks in the list */
+    unsigned int max;   /* the list is partially flushed above this number of blocks */
+    unsigned int nb_fresh; /* number of never used blocks at the bottom of the list */
+    mem_pool_t *pool;   /* pool the blocks belong to */
+    /* Statistics (written by the owner of the cache only, read by memory_get_stats) */
+    uint64_t nb_allocs;
+    uint64_t nb_frees;
+    uint64_t requested_bytes;
+} thread_cache_bin_t;
+
+typedef struct thread_cache {
+    thread_cache_bin_t bins[NB_FAST_POOLS]; /* indexed by pool id */
+    struct thread_cache *next;              /* link in the list of recycled caches */
+    struct thread_cache *all_next;          /* link in the list of all the caches (never removed) */
+} thread_cache_t;
+
+/* Must be called once (by memory_init) before any other function of this file */
+void thread_cache_init(void);
+
+/* Same semantics as mem_alloc_fast_pool / mem_free_fast_pool, through the cache of the calling thread */
+void *thread_cache_alloc(mem_pool_t *pool, size_t size);
+void thread_cache_free(mem_pool_t *pool, void *b);
+
+/* Same as thread_cache_alloc, with the block cleared (only its first word if it has never been used) */
+void *thread_cache_calloc(mem_pool_t *pool, size_t size);
+
+/* Gives back all the blocks cached by the calling thread to their pools */
+void thread_cache_flush(void);
+
+/*
+ * Gives the number of allocations, of frees and the cumulative requested size of the
+ * requests served by the caches of all the threads (past and present) for a fast pool.
+ * The requests that went directly to the pool are counted by the pool.
+ */
+void thread_cache_get_counters(int pool_id, uint64_t *nb_allocs, uint64_t *nb_frees, uint64_t *requested_bytes);
+
+#endif      /* !_MEM_ALLOC_THREAD_CACHE_H_ */
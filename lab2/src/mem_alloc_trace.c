@@ -0,0 +1,189 @@
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sched.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "mem_alloc_trace.h"
+#include "mem_alloc.h"
+#include "my_mmap.h"
+
+#ifdef TRACE_MODE
+/* Get the value provided by the Makefile */
+trace_mode_t trace_mode = TRACE_MODE;
+#else
+trace_mode_t trace_mode = TRACE_TEXT;
+#endif
+
+#define TRACE_NB_CHUNKS (TRACE_RING_EVENTS / TRACE_CHUNK_EVENTS)
+
+/* Number of the calling thread (0: no event logged yet) */
+static __thread uint32_t my_trace_thread __attribute__((tls_model("initial-exec"))) = 0;
+static uint32_t nb_trace_threads = 0;
+
+/* Trace file (-1 if closed) */
+static int trace_fd = -1;
+
+/*
+ * Ring buffer: the event number n is stored in the slot n % TRACE_RING_EVENTS.
+ * trace_head is the number of the next event, trace_written the number of the
+ * first event not written to the file yet (a multiple of TRACE_CHUNK_EVENTS, except
+ * once the file is closed). chunk_filled[c] counts the events filled in chunk c.
+ */
+static mem_trace_event_t *trace_ring = NULL;
+static uint64_t trace_head = 0;
+static uint64_t trace_written = 0;
+static uint32_t chunk_filled[TRACE_NB_CHUNKS];
+
+/* Taken by the thread writing to the file (the chunks are written in order) */
+static pthread_mutex_t trace_write_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Writes size bytes to the trace file (write lock held) */
+static void write_all(const void *buf, size_t size)
+{
+    const char *p = buf;
+
+    while (size > 0)
+    {
+        ssize_t n = write(trace_fd, p, size);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            perror("trace write failed");
+            return;
+        }
+        p += n;
+        size -= (size_t)n;
+    }
+}
+
+/* Writes the chunks completed since the last write, in order (write lock held) */
+static void write_chunks(void)
+{
+    while (1)
+    {
+        uint64_t first = __atomic_load_n(&trace_written, __ATOMIC_RELAXED);
+        unsigned int c = (first / TRACE_CHUNK_EVENTS) % TRACE_NB_CHUNKS;
+
+        if (__atomic_load_n(&(chunk_filled[c]), __ATOMIC_ACQUIRE) != TRACE_CHUNK_EVENTS)
+        {
+            return;
+        }
+        write_all(&(trace_ring[first % TRACE_RING_EVENTS]), TRACE_CHUNK_EVENTS * sizeof(mem_trace_event_t));
+        // The slots of the chunk can be reused
+        chunk_filled[c] = 0;
+        __atomic_store_n(&trace_written, first + TRACE_CHUNK_EVENTS, __ATOMIC_RELEASE);
+    }
+}
+
+int trace_open(const char *path)
+{
+    char default_path[64];
+    mem_trace_header_t header;
+
+    if (path == NULL || path[0] == '\0')
+    {
+        snprintf(default_path, sizeof(default_path), TRACE_FILE_DEFAULT, (int)getpid());
+        path = default_path;
+    }
+    trace_ring = my_mmap(TRACE_RING_EVENTS * sizeof(mem_trace_event_t));
+    if (trace_ring == NULL)
+    {
+        return -1;
+    }
+    trace_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (trace_fd < 0)
+    {
+        fprintf(stderr, "%s: ", path);
+        perror("cannot open the trace file");
+        my_munmap(trace_ring, TRACE_RING_EVENTS * sizeof(mem_trace_event_t));
+        trace_ring = NULL;
+        return -1;
+    }
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+    header.version = TRACE_VERSION;
+    header.event_size = sizeof(mem_trace_event_t);
+    write_all(&header, sizeof(header));
+    return 0;
+}
+
+void trace_log(trace_op_t op, int pool, size_t offset, int64_t size)
+{
+    struct timespec ts;
+    mem_trace_event_t *e;
+    uint64_t n;
+
+    if (my_trace_thread == 0)
+    {
+        my_trace_thread = __atomic_add_fetch(&nb_trace_threads, 1, __ATOMIC_RELAXED);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    n = __atomic_fetch_add(&trace_head, 1, __ATOMIC_RELAXED);
+    // The ring is full: wait for its oldest chunk to be written (no event is lost)
+    while (n - __atomic_load_n(&trace_written, __ATOMIC_ACQUIRE) >= TRACE_RING_EVENTS)
+    {
+        if (__atomic_load_n(&trace_fd, __ATOMIC_RELAXED) < 0)
+        {
+            return; // Closed
+        }
+        sched_yield();
+    }
+
+    e = &(trace_ring[n % TRACE_RING_EVENTS]);
+    e->timestamp = (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+    e->offset = offset;
+    e->size = size;
+    e->thread = my_trace_thread;
+    e->pool = (uint16_t)pool;
+    e->op = (uint8_t)op;
+    e->reserved = 0;
+
+    if (__atomic_add_fetch(&(chunk_filled[(n / TRACE_CHUNK_EVENTS) % TRACE_NB_CHUNKS]), 1, __ATOMIC_RELEASE) == TRACE_CHUNK_EVENTS)
+    {
+        pthread_mutex_lock(&trace_write_lock);
+        write_chunks();
+        pthread_mutex_unlock(&trace_write_lock);
+    }
+}
+
+void trace_close(void)
+{
+    uint64_t first;
+    uint64_t last;
+    unsigned int c;
+
+    if (trace_fd < 0)
+    {
+        return;
+    }
+    // The events logged from now on are dropped
+    trace_mode = TRACE_NONE;
+
+    pthread_mutex_lock(&trace_write_lock);
+    write_chunks();
+    // The last chunk is partially filled (with the events of the threads still running, some may be missing)
+    first = __atomic_load_n(&trace_written, __ATOMIC_RELAXED);
+    last = __atomic_load_n(&trace_head, __ATOMIC_RELAXED);
+    c = (first / TRACE_CHUNK_EVENTS) % TRACE_NB_CHUNKS;
+    if (last - first > TRACE_CHUNK_EVENTS)
+    {
+        last = first + TRACE_CHUNK_EVENTS;
+    }
+    if (__atomic_load_n(&(chunk_filled[c]), __ATOMIC_ACQUIRE) < last - first)
+    {
+        last = first + __atomic_load_n(&(chunk_filled[c]), __ATOMIC_ACQUIRE);
+    }
+    write_all(&(trace_ring[first % TRACE_RING_EVENTS]), (size_t)(last - first) * sizeof(mem_trace_event_t));
+    close(trace_fd);
+    __atomic_store_n(&trace_fd, -1, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&trace_write_lock);
+}
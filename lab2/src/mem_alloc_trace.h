@@ -0,0 +1,81 @@
+#ifndef   	_MEM_ALLOC_TRACE_H_
+#define   	_MEM_ALLOC_TRACE_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+
+/*
+ * Traces of the allocations and deallocations (see print_alloc_info and print_free_info).
+ *
+ * TRACE_TEXT prints one line on stderr per operation (the format compared by the tests).
+ * TRACE_BINARY stores the events in a lock-free ring buffer in memory: a thread logging an
+ * event only reserves a slot with an atomic increment and fills it. The ring is made of
+ * chunks: the thread completing a chunk writes all the completed chunks to the trace file
+ * (one write per chunk), the other threads go on logging in the other chunks meanwhile.
+ * The last events are written at exit. bin/mem_trace_dump converts a trace file back to
+ * the text format.
+ * TRACE_NONE disables the traces.
+ */
+typedef enum
+{
+    TRACE_NONE = 0,
+    TRACE_TEXT = 1,
+    TRACE_BINARY = 2
+} trace_mode_t;
+
+/* Mode of the traces (TRACE_MODE in Makefile.config, can be set by MEMALLOC_CONF) */
+extern trace_mode_t trace_mode;
+
+/* Name of the trace file when none is given (%d: pid of the process) */
+#define TRACE_FILE_DEFAULT "memalloc.%d.trace"
+
+/* Number of events of the ring buffer, and of one of its chunks (powers of two) */
+#define TRACE_RING_EVENTS (1 << 16)
+#define TRACE_CHUNK_EVENTS (1 << 12)
+
+/* Operations */
+typedef enum
+{
+    TRACE_ALLOC = 1,
+    TRACE_FREE = 2,
+    TRACE_ALLOC_ERROR = 3
+} trace_op_t;
+
+/* Pool of the free of a NULL pointer */
+#define TRACE_NO_POOL 0xffff
+
+/* Trace file: a header followed by the events, in the order in which they were logged */
+#define TRACE_MAGIC "MEMTRACE"
+#define TRACE_VERSION 1
+
+typedef struct mem_trace_header
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t event_size; /* sizeof(mem_trace_event_t) */
+} mem_trace_header_t;
+
+typedef struct mem_trace_event
+{
+    uint64_t timestamp; /* in ns (CLOCK_MONOTONIC) */
+    uint64_t offset;    /* offset of the block in its pool (0 for the errors) */
+    int64_t size;       /* requested size (0 for the frees) */
+    uint32_t thread;    /* thread number (in the order of their first event, from 1) */
+    uint16_t pool;      /* pool id */
+    uint8_t op;         /* trace_op_t */
+    uint8_t reserved;
+} mem_trace_event_t;
+
+/*
+ * Opens the trace file (TRACE_FILE_DEFAULT if path is NULL) and maps the ring buffer
+ * (called by memory_init in binary mode). Returns 0 on success, -1 otherwise.
+ */
+int trace_open(const char *path);
+
+/* Logs an event (binary mode, once trace_open has succeeded) */
+void trace_log(trace_op_t op, int pool, size_t offset, int64_t size);
+
+/* Writes the events not written yet and closes the trace file (no event is logged afterwards) */
+void trace_close(void);
+
+#endif      /* !_MEM_ALLOC_TRACE_H_ */
@@ -2,19 +2,59 @@
 #define   	_MEM_ALLOC_TYPES_H_
 
 #include <stdint.h>
+#include <pthread.h>
 
-typedef enum {FAST_POOL = 1, STANDARD_POOL = 2} pool_category_t ; 
+/*
+ * Number of fast pools (the first pools, indexed by pool id), i.e. of size classes,
+ * and largest request size served by a fast pool.
+ * The lab layout (3 pools of 64, 256 and 1024 bytes blocks) is the one of the simulator.
+ */
+#ifdef FINE_SIZE_CLASSES
+#define NB_FAST_POOLS 40
+#define FAST_POOL_MAX_SIZE 16384
+#else
+#define NB_FAST_POOLS 3
+#define FAST_POOL_MAX_SIZE 1024
+#endif
+
+typedef enum {FAST_POOL = 1, STANDARD_POOL = 2, HUGE_POOL = 3} pool_category_t ; 
+
+/*
+ * Counters kept by a pool (see memory_get_stats), updated under the pool lock or atomically
+ * (see mem_alloc_stats.h). The requests served by the thread caches are counted by the caches.
+ */
+typedef struct mem_pool_counters {
+    uint64_t nb_allocs;
+    uint64_t nb_frees;
+    uint64_t nb_failures;
+    uint64_t requested_bytes; /* cumulative size of the requests */
+    uint64_t allocated_bytes; /* cumulative payload size of the allocated blocks */
+    uint64_t freed_bytes;     /* cumulative payload size of the freed blocks */
+    uint64_t peak_bytes;      /* largest payload size in use (allocated_bytes - freed_bytes) */
+    uint64_t mapped_bytes;    /* size of the memory currently mapped by the pool (metadata included) */
+    uint64_t search_steps;    /* standard pools: cumulative number of free blocks examined to find a block */
+} mem_pool_counters_t;
 
 typedef struct mem_pool {
     int pool_id;
     const char *pool_name; 
-    size_t pool_size; /* initial size, in bytes (including metadata) */
+    size_t pool_size; /* initial size, in bytes (including metadata); fast pools: size of each slab */
     size_t min_req_size; /* min size (in bytes) managed by this pool */ 
     size_t max_req_size; /* max size (in bytes) managed by this pool */ 
-    void *start_addr; /* smallest address in the heap */
-    void *end_addr;   /* highest address in the heap */
+    void *start_addr; /* smallest address in the heap (fast pools: in the first slab) */
+    void *end_addr;   /* highest address in the heap (fast pools: in the first slab) */
     void *first_free; /* first block in the free list */
     pool_category_t pool_type;
+    pthread_mutex_t lock; /* protects the free list (and the pool metadata) */
+    size_t block_size; /* fast pools: size of the blocks */
+    void *slabs;       /* fast pools: list of the slabs, most recently mapped first */
+    void *remote_free; /* fast pools: blocks freed by threads not holding the lock (lock-free stack) */
+    void *carve_slab;  /* fast pools: first slab where never used blocks may remain (NULL: none) */
+    void *segments;   /* standard pools: list of the segments, most recently mapped first */
+    void *next_fit;   /* standard pools: free block where the next fit search starts (NULL: first block) */
+    void *bins;       /* standard pools: size bins of the segregated policies (NULL: single address-ordered free list) */
+    void *skip_list;  /* standard pools: upper levels of the head of the skip list indexing the address-ordered free list */
+    mem_pool_counters_t counters; /* statistics */
 } mem_pool_t;
 
 
@@ -0,0 +1,106 @@
+/*
+ * Converts a binary trace file (see mem_alloc_trace.h) to the text traces
+ * printed by print_alloc_info and print_free_info.
+ *
+ * usage: mem_trace_dump [-v] trace_file
+ *   -v: each line starts with the time of the event (in ns, from the first event) and the thread number
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "mem_alloc_trace.h"
+
+#define NB_EVENTS_READ 4096
+
+static void print_event(const mem_trace_event_t *e, uint64_t start, int verbose)
+{
+    if (verbose)
+    {
+        // The events are in the order of their slots: their times may be slightly out of order
+        printf("[%12ld ns, thread %u] ", (long)(e->timestamp - start), e->thread);
+    }
+    switch (e->op)
+    {
+    case TRACE_ALLOC:
+        printf("ALLOC at : %lu (%d byte(s)) -- pool %d\n", (unsigned long)e->offset, (int)e->size, e->pool);
+        break;
+    case TRACE_FREE:
+        if (e->pool == TRACE_NO_POOL)
+        {
+            printf("FREE  at : %lu \n", 0UL);
+        }
+        else
+        {
+            printf("FREE  at : %lu -- pool %d\n", (unsigned long)e->offset, e->pool);
+        }
+        break;
+    case TRACE_ALLOC_ERROR:
+        printf("ALLOC error : can't allocate %d bytes\n", (int)e->size);
+        break;
+    default:
+        fprintf(stderr, "Unknown operation %d\n", e->op);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    mem_trace_event_t events[NB_EVENTS_READ];
+    mem_trace_header_t header;
+    uint64_t start = 0;
+    int verbose = 0;
+    size_t nb_events;
+    size_t i;
+    FILE *f;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "v")) != -1)
+    {
+        switch (opt)
+        {
+        case 'v':
+            verbose = 1;
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-v] trace_file\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (optind != argc - 1)
+    {
+        fprintf(stderr, "usage: %s [-v] trace_file\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    f = fopen(argv[optind], "rb");
+    if (f == NULL)
+    {
+        perror(argv[optind]);
+        return EXIT_FAILURE;
+    }
+    if (fread(&header, sizeof(header), 1, f) != 1 || memcmp(header.magic, TRACE_MAGIC, sizeof(header.magic)) != 0)
+    {
+        fprintf(stderr, "%s: not a trace file\n", argv[optind]);
+        return EXIT_FAILURE;
+    }
+    if (header.version != TRACE_VERSION || header.event_size != sizeof(mem_trace_event_t))
+    {
+        fprintf(stderr, "%s: unsupported trace version %u\n", argv[optind], header.version);
+        return EXIT_FAILURE;
+    }
+
+    while ((nb_events = fread(events, sizeof(mem_trace_event_t), NB_EVENTS_READ, f)) > 0)
+    {
+        if (start == 0)
+        {
+            start = events[0].timestamp;
+        }
+        for (i = 0; i < nb_events; i++)
+        {
+            print_event(&(events[i]), start, verbose);
+        }
+    }
+    fclose(f);
+    return EXIT_SUCCESS;
+}
@@ -1,11 +1,21 @@
+#define _GNU_SOURCE
+
 #include <stdlib.h>
 #include <assert.h>
 #include <stdio.h>
 #include <unistd.h>
+#include <stdint.h>
 
 #include "my_mmap.h"
 #include "mem_alloc.h"
 
+#ifdef HUGE_PAGES
+/* Get the value provided by the Makefile */
+int my_mmap_huge_pages = HUGE_PAGES;
+#else
+int my_mmap_huge_pages = HUGE_PAGES_NONE;
+#endif
+
 /* 
  * The address returned by mmap is always a multiple of 
  * the base OS page size.
@@ -52,6 +62,73 @@ long get_os_page_size() {
 }
 
 
+/* Returns 1 if a region of a given size is mapped with huge pages (see my_mmap.h) */
+static int use_huge_pages(size_t size) {
+    return (my_mmap_huge_pages != HUGE_PAGES_NONE && size >= OS_HUGE_PAGE_SIZE);
+}
+
+/* Size of a region mapped with huge pages */
+static size_t compute_huge_size(size_t size) {
+    return (size + OS_HUGE_PAGE_SIZE - 1) & ~((size_t)OS_HUGE_PAGE_SIZE - 1);
+}
+
+/*
+ * Helper function:
+ * maps a region of actual_size bytes (a multiple of the huge page size)
+ * at an address aligned on the huge page size, backed by huge pages if possible.
+ * Returns NULL if the mapping failed.
+ */
+static void *mmap_huge(size_t actual_size) {
+    char *res;
+    size_t head;
+    size_t tail;
+
+#ifdef MAP_HUGETLB
+    if (my_mmap_huge_pages == HUGE_PAGES_HUGETLB) {
+        /* The kernel aligns the hugetlb mappings on the huge page size */
+        res = mmap(NULL,
+                    actual_size,
+                    PROT_READ | PROT_WRITE | PROT_EXEC,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB,
+                    0,
+                    0);
+        debug_printf("\tmmap(MAP_HUGETLB) returned address %p\n", res);
+        if (res != MAP_FAILED) {
+            return res;
+        }
+        /* No huge page reserved: fall back to transparent huge pages */
+    }
+#endif
+
+    /* Map one extra huge page, then trim the misaligned head and the tail */
+    res = mmap(NULL,
+                actual_size + OS_HUGE_PAGE_SIZE,
+                PROT_READ | PROT_WRITE | PROT_EXEC,
+                MAP_PRIVATE | MAP_ANONYMOUS,
+                0,
+                0);
+    if (res == MAP_FAILED) {
+        return NULL;
+    }
+    head = (OS_HUGE_PAGE_SIZE - ((uintptr_t)res % OS_HUGE_PAGE_SIZE)) % OS_HUGE_PAGE_SIZE;
+    tail = OS_HUGE_PAGE_SIZE - head;
+    if (head != 0) {
+        munmap(res, head);
+    }
+    if (tail != 0) {
+        munmap(res + head + actual_size, tail);
+    }
+    res += head;
+
+#ifdef MADV_HUGEPAGE
+    /* Fails (harmlessly) if transparent huge pages are disabled: the region is then backed by base pages */
+    if (madvise(res, actual_size, MADV_HUGEPAGE) != 0) {
+        debug_printf("\tmadvise(MADV_HUGEPAGE) failed\n");
+    }
+#endif
+    return res;
+}
+
 void *my_mmap(size_t size) {
     void *res;
     unsigned long leftover;
@@ -68,6 +145,18 @@ void *my_mmap(size_t size) {
      */
     assert(MEM_ALIGN <= OS_BASE_PAGE_SIZE);
 
+    if (use_huge_pages(size)) {
+        /* The address is aligned on the huge page size, and thus on MEM_ALIGN */
+        actual_size = compute_huge_size(size);
+        res = mmap_huge(actual_size);
+        if (res == NULL) {
+            perror("mmap failed");
+        }
+        debug_printf("\tactual_size = %ld (huge pages)\n", actual_size);
+        debug_printf("\t%s returning aligned address %p\n", __FUNCTION__, res);
+        return res;
+    }
+
     actual_size = compute_real_size(size);
 
     res = mmap(NULL,
@@ -107,6 +196,15 @@ int my_munmap(void *addr, size_t size) {
 
     assert(((unsigned long)addr) % MEM_ALIGN == 0);
 
+    if (use_huge_pages(size)) {
+        assert(((unsigned long)addr) % OS_HUGE_PAGE_SIZE == 0);
+        res = munmap(addr, compute_huge_size(size));
+        if (res != 0) {
+            perror("munmap failed");
+        }
+        return res;
+    }
+
     actual_size = compute_real_size(size);
 
     leftover = ((unsigned long)addr) % OS_BASE_PAGE_SIZE;
@@ -130,3 +228,91 @@ int my_munmap(void *addr, size_t size) {
     }
     return res;
 }
+
+
+/*
+ * Helper function:
+ * gives the start and the size of the actual mapping of a region returned by my_mmap
+ */
+static void get_mapping(void *addr, size_t size, char **start, size_t *actual_size) {
+    if (use_huge_pages(size)) {
+        *start = addr;
+        *actual_size = compute_huge_size(size);
+    } else {
+        *start = (char*)addr - ((unsigned long)addr) % OS_BASE_PAGE_SIZE;
+        *actual_size = compute_real_size(size);
+    }
+}
+
+int my_mremap(void *addr, size_t old_size, size_t new_size) {
+    char *start;
+    size_t old_actual_size;
+    size_t new_actual_size;
+    void *res;
+
+    debug_printf("%s(addr = %p , old_size = %ld, new_size = %ld):\n", __FUNCTION__, addr, old_size, new_size);
+
+    /* Switching between base and huge pages changes the layout of the mapping */
+    if (use_huge_pages(old_size) != use_huge_pages(new_size)) {
+        return -1;
+    }
+    get_mapping(addr, old_size, &start, &old_actual_size);
+    get_mapping(addr, new_size, &start, &new_actual_size);
+    if (new_actual_size == old_actual_size) {
+        return 0;
+    }
+
+    res = mremap(start, old_actual_size, new_actual_size, 0);
+    debug_printf("\tmremap returned %p\n", res);
+    return (res == MAP_FAILED) ? -1 : 0;
+}
+
+int my_mremap_to(void *old_addr, size_t old_size, void *new_addr, size_t new_size) {
+    char *old_start;
+    char *new_start;
+    size_t old_actual_size;
+    size_t new_actual_size;
+    void *res;
+
+    debug_printf("%s(old_addr = %p , old_size = %ld, new_addr = %p, new_size = %ld):\n", __FUNCTION__, old_addr, old_size, new_addr, new_size);
+
+    get_mapping(old_addr, old_size, &old_start, &old_actual_size);
+    get_mapping(new_addr, new_size, &new_start, &new_actual_size);
+    /* The data must keep its position relative to the start of the mapping */
+    if ((char*)old_addr - old_start != (char*)new_addr - new_start) {
+        return -1;
+    }
+
+    res = mremap(old_start, old_actual_size, new_actual_size, MREMAP_MAYMOVE | MREMAP_FIXED, new_start);
+    debug_printf("\tmremap returned %p\n", res);
+    return (res == MAP_FAILED) ? -1 : 0;
+}
+
+void my_madvise_range(void *addr, size_t size, size_t region_size, char **first, char **last) {
+    unsigned long page_size;
+
+    /* The regions smaller than a huge page are mapped with base pages whatever the mode */
+    page_size = use_huge_pages(region_size) ? OS_HUGE_PAGE_SIZE : OS_BASE_PAGE_SIZE;
+    *first = (char*)(((unsigned long)addr + page_size - 1) & ~(page_size - 1));
+    *last = (char*)(((unsigned long)addr + size) & ~(page_size - 1));
+}
+
+size_t my_madvise_free(void *addr, size_t size, size_t region_size) {
+    char *first;
+    char *last;
+    int res;
+
+    my_madvise_range(addr, size, region_size, &first, &last);
+    if (last <= first) {
+        return 0;
+    }
+
+    res = madvise(first, last - first, PURGE_ADVICE);
+    debug_printf("%s(addr = %p , size = %ld): madvise(%p, %ld) returned %d\n", __FUNCTION__, addr, size, first, last - first, res);
+
+    if (res != 0) {
+        perror("madvise failed");
+        return 0;
+    }
+    return last - first;
+}
@@ -11,6 +11,24 @@
  */
 #define OS_BASE_PAGE_SIZE 4096
 
+/*
+ * Huge pages (opt-in, see HUGE_PAGES in Makefile.config):
+ * the regions of at least OS_HUGE_PAGE_SIZE bytes are mapped with a size and an address
+ * that are multiples of OS_HUGE_PAGE_SIZE, and backed by huge pages to reduce TLB misses.
+ * - HUGE_PAGES_THP: transparent huge pages (madvise(MADV_HUGEPAGE)),
+ * - HUGE_PAGES_HUGETLB: pages reserved in the hugetlb pool (MAP_HUGETLB), falling back
+ *   to transparent huge pages when none is available.
+ * The smaller regions are still mapped with base pages.
+ */
+#define OS_HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+#define HUGE_PAGES_NONE 0
+#define HUGE_PAGES_THP 1
+#define HUGE_PAGES_HUGETLB 2
+
+/* Huge page mode used by the next calls to my_mmap (a region must be unmapped in the mode it was mapped with) */
+extern int my_mmap_huge_pages;
+
 /* 
  * Allocates a region of virtual memory
  * and returns a pointer to the start of this region
@@ -24,4 +42,48 @@ void *my_mmap(size_t size);
  */
 int my_munmap(void *addr, size_t size); 
 
+/*
+ * Resizes a region returned by my_mmap (of old_size bytes) without moving it.
+ * Returns 0 on success, or -1 if the region cannot be resized in place
+ * (it is then left untouched).
+ */
+int my_mremap(void *addr, size_t old_size, size_t new_size);
+
+/*
+ * Moves the pages of a region returned by my_mmap (old_addr, old_size) to
+ * another one (new_addr, new_size), without copying them: the contents of the
+ * latter are replaced by the ones of the former (truncated, or extended with
+ * zeros) and the former is unmapped.
+ * Returns 0 on success, or -1 on failure (both regions are then left untouched).
+ */
+int my_mremap_to(void *old_addr, size_t old_size, void *new_addr, size_t new_size);
+
+/*
+ * Gives back to the OS the physical memory of the whole pages located
+ * in [addr, addr + size), inside a region of region_size bytes returned by
+ * my_mmap (the range is shrunk to page boundaries; huge page boundaries if
+ * the region is mapped with huge pages, so as not to split them).
+ * The pages stay mapped: they read as zeros (or as their former contents
+ * with MADV_FREE, until the kernel reclaims them) when touched again.
+ * Returns the number of bytes purged (0 if the range holds no whole page).
+ */
+size_t my_madvise_free(void *addr, size_t size, size_t region_size);
+
+/* Gives the range [*first, *last) of the pages purged by my_madvise_free(addr, size, region_size) (empty if *last <= *first) */
+void my_madvise_range(void *addr, size_t size, size_t region_size, char **first, char **last);
+
+/*
+ * Advice used to purge pages: MADV_DONTNEED releases them immediately,
+ * MADV_FREE (Linux >= 4.5) lets the kernel reclaim them lazily, under memory pressure.
+ * PURGED_PAGES_ARE_ZERO tells whether the purged pages (and the never touched ones
+ * of the regions that may be purged) can be assumed to hold zeros.
+ */
+#if defined(PURGE_WITH_MADV_FREE) && defined(MADV_FREE)
+#define PURGE_ADVICE MADV_FREE
+#define PURGED_PAGES_ARE_ZERO 0
+#else
+#define PURGE_ADVICE MADV_DONTNEED
+#define PURGED_PAGES_ARE_ZERO 1
+#endif
+
 #endif      /* !_MY_MMAP_H_ */
@@ -0,0 +1,116 @@
+/*
+ * Regression: aligned allocation functions.
+ * The invalid alignments are rejected as glibc does (posix_memalign with an alignment
+ * of 0 used to divide by zero), and the valid ones give aligned, usable blocks of
+ * every pool (fast, standard and huge).
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <malloc.h>
+
+#define NB_BLOCKS (sizeof(alignments) / sizeof(alignments[0]) * sizeof(sizes) / sizeof(sizes[0]))
+
+static const size_t alignments[] = {8, 16, 32, 64, 128, 4096, 65536, 2097152};
+static const size_t sizes[] = {1, 24, 64, 100, 1000, 4096, 20000, 1048576, 3000000};
+
+/* Checks a block returned by an aligned allocation function */
+static int check_block(const char *fn, void *p, size_t alignment, size_t size)
+{
+    if (p == NULL)
+    {
+        printf("%s(%zu, %zu) failed\n", fn, alignment, size);
+        return -1;
+    }
+    if ((uintptr_t)p % alignment != 0)
+    {
+        printf("%s(%zu, %zu) = %p: not aligned\n", fn, alignment, size, p);
+        return -1;
+    }
+    if (malloc_usable_size(p) < size)
+    {
+        printf("%s(%zu, %zu): usable size %zu\n", fn, alignment, size, malloc_usable_size(p));
+        return -1;
+    }
+    memset(p, 0xa5, size);
+    return 0;
+}
+
+static int check_invalid(void)
+{
+    static const size_t invalid[] = {0, 1, 2, 4, 12, 24, 100};
+    void *p = NULL;
+    size_t i;
+
+    for (i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++)
+    {
+        // Below sizeof(void *) or not a power of two
+        if (invalid[i] != sizeof(void *) && posix_memalign(&p, invalid[i], 32) != EINVAL)
+        {
+            printf("posix_memalign(%zu, 32) did not fail with EINVAL\n", invalid[i]);
+            return -1;
+        }
+    }
+    errno = 0;
+    if (aligned_alloc(0, 32) != NULL || errno != EINVAL)
+    {
+        printf("aligned_alloc(0, 32) did not fail with EINVAL\n");
+        return -1;
+    }
+    errno = 0;
+    if (aligned_alloc(24, 32) != NULL || errno != EINVAL)
+    {
+        printf("aligned_alloc(24, 32) did not fail with EINVAL\n");
+        return -1;
+    }
+    return 0;
+}
+
+int main(void)
+{
+    void *blocks[NB_BLOCKS];
+    size_t nb_blocks = 0;
+    size_t a;
+    size_t s;
+    size_t i;
+
+    if (check_invalid() != 0)
+    {
+        return EXIT_FAILURE;
+    }
+    for (a = 0; a < sizeof(alignments) / sizeof(alignments[0]); a++)
+    {
+        for (s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+        {
+            void *p = NULL;
+
+            if (posix_memalign(&p, alignments[a], sizes[s]) != 0 ||
+                check_block("posix_memalign", p, alignments[a], sizes[s]) != 0)
+            {
+                return EXIT_FAILURE;
+            }
+            blocks[nb_blocks++] = p;
+            p = aligned_alloc(alignments[a], sizes[s]);
+            if (check_block("aligned_alloc", p, alignments[a], sizes[s]) != 0)
+            {
+                return EXIT_FAILURE;
+            }
+            free(p);
+            // memalign rounds the alignment up to a power of two
+            p = memalign(alignments[a] - 1, sizes[s]);
+            if (check_block("memalign", p, alignments[a], sizes[s]) != 0)
+            {
+                return EXIT_FAILURE;
+            }
+            free(p);
+        }
+    }
+    for (i = 0; i < nb_blocks; i++)
+    {
+        free(blocks[i]);
+    }
+    printf("PASSED\n");
+    return EXIT_SUCCESS;
+}
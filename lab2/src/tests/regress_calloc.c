@@ -0,0 +1,103 @@
+/*
+ * Regression: calloc returns zeroed memory when it reuses blocks, including after
+ * a purge (the blocks of a purged fast slab used to be all taken as fresh, although the
+ * pages only partially covered by the purge, or all of them when the slab is smaller than
+ * the huge pages used for the purge, still held their former contents; and with align=16,
+ * the part of a standard block known to hold zeros could extend past the requested size).
+ * Each size is allocated and dirtied, freed, purged with malloc_trim and allocated again
+ * with calloc. Run it with the coarse and fine size classes (make -B SIZE_CLASSES=FINE regress).
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <malloc.h>
+
+#define NB_BLOCKS 4000
+
+static const size_t sizes[] = {1, 8, 16, 24, 48, 64, 85, 100, 128, 150, 200, 230, 256, 500,
+                               1000, 1024, 2000, 4000, 5001, 9000, 16384, 16385, 100000, 2000000};
+
+static char *blocks[NB_BLOCKS];
+
+/* Returns the number of blocks that do not hold zeros */
+static size_t check_zero(size_t nb_blocks, size_t size)
+{
+    size_t nb_dirty = 0;
+    size_t i;
+    size_t j;
+
+    for (i = 0; i < nb_blocks; i++)
+    {
+        for (j = 0; j < size; j++)
+        {
+            if (blocks[i][j] != 0)
+            {
+                nb_dirty++;
+                break;
+            }
+        }
+    }
+    return nb_dirty;
+}
+
+/* Allocates nb_blocks blocks with calloc (after freeing them and purging the pools if trim is set) */
+static int run(size_t size, int trim)
+{
+    size_t nb_blocks = (size > 100000) ? 8 : NB_BLOCKS;
+    size_t nb_dirty;
+    size_t i;
+
+    for (i = 0; i < nb_blocks; i++)
+    {
+        blocks[i] = malloc(size);
+        if (blocks[i] == NULL)
+        {
+            printf("malloc(%zu) failed\n", size);
+            return -1;
+        }
+        memset(blocks[i], 0xa5, size);
+    }
+    for (i = 0; i < nb_blocks; i++)
+    {
+        free(blocks[i]);
+    }
+    if (trim)
+    {
+        malloc_trim(0);
+    }
+    for (i = 0; i < nb_blocks; i++)
+    {
+        blocks[i] = calloc(1, size);
+        if (blocks[i] == NULL)
+        {
+            printf("calloc(1, %zu) failed\n", size);
+            return -1;
+        }
+    }
+    nb_dirty = check_zero(nb_blocks, size);
+    for (i = 0; i < nb_blocks; i++)
+    {
+        free(blocks[i]);
+    }
+    if (nb_dirty > 0)
+    {
+        printf("calloc(1, %zu)%s: %zu blocks of %zu not zeroed\n", size, trim ? " after malloc_trim" : "", nb_dirty, nb_blocks);
+        return -1;
+    }
+    return 0;
+}
+
+int main(void)
+{
+    size_t s;
+
+    for (s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+    {
+        if (run(sizes[s], 0) != 0 || run(sizes[s], 1) != 0)
+        {
+            return EXIT_FAILURE;
+        }
+    }
+    printf("PASSED\n");
+    return EXIT_SUCCESS;
+}
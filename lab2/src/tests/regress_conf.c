@@ -0,0 +1,135 @@
+/*
+ * Regression: parser of the runtime configuration (MEMALLOC_CONF).
+ * The valid settings are applied, and the invalid ones (unknown keys, malformed
+ * or out of range values, overflows, values too long) are counted and leave the
+ * configuration untouched. Linked with mem_alloc_conf.o (the parser does not
+ * depend on the rest of the allocator).
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "mem_alloc_conf.h"
+#include "my_mmap.h"
+
+#define CHECK(cond)                                            \
+    do                                                         \
+    {                                                          \
+        if (!(cond))                                           \
+        {                                                      \
+            printf("line %d: %s is false\n", __LINE__, #cond); \
+            return EXIT_FAILURE;                               \
+        }                                                      \
+    } while (0)
+
+/* Settings rejected whatever the configuration (each of them is one error) */
+static const char *invalid[] = {
+    "foo=1", "pool4=1M", "pool=1M", "pool3", "=1M", "pool3=", "pool3=-1", "pool3=16Q", "pool3=1K",
+    "pool3=99999999999999999999", "pool3=17179869184G", "policy=XX", "policy=", "align=0", "align=3",
+    "align=32", "align=1K", "purge_decay=5m", "purge_decay=-1", "purge_decay=18446744073709552s",
+    "arena_binding=NUMA", "huge_pages=2M", "stats_print=2", "stats_print=", "trace=XML",
+    "trace_file=", "prof_sample=1T", "prof_prefix="};
+
+/* Returns a configuration set to fixed values (the defaults of the allocator do not matter here) */
+static mem_alloc_conf_t reference_conf(void)
+{
+    mem_alloc_conf_t conf;
+    int i;
+
+    memset(&conf, 0, sizeof(conf));
+    for (i = 0; i < CONF_NB_POOL_SIZES; i++)
+    {
+        conf.pool_sizes[i] = 65536;
+    }
+    conf.policy = FIRST_FIT;
+    conf.align = 8;
+    conf.purge_decay_ms = 1000;
+    conf.arena_binding = ARENA_ROUND_ROBIN;
+    conf.huge_pages = HUGE_PAGES_NONE;
+    conf.trace = TRACE_TEXT;
+    strcpy(conf.trace_file, "memalloc.trace");
+    conf.prof_sample = 0;
+    strcpy(conf.prof_prefix, "memalloc");
+    return conf;
+}
+
+int main(void)
+{
+    mem_alloc_conf_t ref = reference_conf();
+    mem_alloc_conf_t conf = ref;
+    char long_setting[CONF_MAX_VALUE + 32];
+    size_t i;
+
+    // Nothing to apply
+    CHECK(mem_alloc_conf_parse(&conf, "") == 0);
+    CHECK(mem_alloc_conf_parse(&conf, ",,,") == 0);
+    CHECK(memcmp(&conf, &ref, sizeof(conf)) == 0);
+
+    // Each invalid setting is counted, and ignored
+    for (i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++)
+    {
+        if (mem_alloc_conf_parse(&conf, invalid[i]) != 1 || memcmp(&conf, &ref, sizeof(conf)) != 0)
+        {
+            printf("invalid setting '%s' not rejected\n", invalid[i]);
+            return EXIT_FAILURE;
+        }
+    }
+    memset(long_setting, 0, sizeof(long_setting));
+    strcpy(long_setting, "trace_file=");
+    memset(long_setting + strlen(long_setting), 'a', CONF_MAX_VALUE);
+    CHECK(mem_alloc_conf_parse(&conf, long_setting) == 1);
+    CHECK(memcmp(&conf, &ref, sizeof(conf)) == 0);
+    long_setting[strlen("trace_file=") + CONF_MAX_VALUE - 1] = '\0';
+    CHECK(mem_alloc_conf_parse(&conf, long_setting) == 0);
+    CHECK(strlen(conf.trace_file) == CONF_MAX_VALUE - 1);
+
+    // The valid settings are applied, around the invalid ones
+    conf = ref;
+    CHECK(mem_alloc_conf_parse(&conf, "pool3=64M,policy=bf,bogus,align=16,purge_decay=10s,,align=3") == 2);
+    CHECK(conf.pool_sizes[3] == 64UL << 20);
+    CHECK(conf.policy == BEST_FIT);
+    CHECK(conf.align == 16);
+    CHECK(conf.purge_decay_ms == 10000);
+
+    CHECK(mem_alloc_conf_parse(&conf, "pool0=4096,pool1=8k,pool2=1G,policy=TLSF,align=1") == 0);
+    CHECK(conf.pool_sizes[0] == OS_BASE_PAGE_SIZE);
+    CHECK(conf.pool_sizes[1] == 8192);
+    CHECK(conf.pool_sizes[2] == 1UL << 30);
+    CHECK(conf.policy == TLSF);
+    CHECK(conf.align == 1);
+
+    CHECK(mem_alloc_conf_parse(&conf, "policy=NF,purge_decay=250ms,arena_binding=cpu,huge_pages=THP") == 0);
+    CHECK(conf.policy == NEXT_FIT);
+    CHECK(conf.purge_decay_ms == 250);
+    CHECK(conf.arena_binding == ARENA_PER_CPU);
+    CHECK(conf.huge_pages == HUGE_PAGES_THP);
+
+    CHECK(mem_alloc_conf_parse(&conf, "policy=SF,purge_decay=0,huge_pages=hugetlb,stats_print=1,trace=binary") == 0);
+    CHECK(conf.policy == SEGREGATED_FIT);
+    CHECK(conf.purge_decay_ms == 0);
+    CHECK(conf.huge_pages == HUGE_PAGES_HUGETLB);
+    CHECK(conf.stats_print == 1);
+    CHECK(conf.trace == TRACE_BINARY);
+
+    CHECK(mem_alloc_conf_parse(&conf, "trace_file=/tmp/a=b.trace,prof_sample=512K,prof_prefix=heap,trace=NONE") == 0);
+    CHECK(strcmp(conf.trace_file, "/tmp/a=b.trace") == 0);
+    CHECK(conf.prof_sample == 512 * 1024);
+    CHECK(strcmp(conf.prof_prefix, "heap") == 0);
+    CHECK(conf.trace == TRACE_NONE);
+
+    // errno is left untouched (the parser is called from malloc)
+    errno = EINTR;
+    CHECK(mem_alloc_conf_parse(&conf, "pool3=99999999999999999999,pool3=1M") == 1);
+    CHECK(errno == EINTR);
+    CHECK(conf.pool_sizes[3] == 1UL << 20);
+
+    // The last setting of a key wins
+    CHECK(mem_alloc_conf_parse(&conf, "policy=FF,arena_binding=RR,stats_print=0,policy=BF") == 0);
+    CHECK(conf.policy == BEST_FIT);
+    CHECK(conf.arena_binding == ARENA_ROUND_ROBIN);
+    CHECK(conf.stats_print == 0);
+
+    printf("PASSED\n");
+    return EXIT_SUCCESS;
+}
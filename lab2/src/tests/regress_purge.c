@@ -0,0 +1,81 @@
+/*
+ * Regression: malloc_trim gives back to the OS the memory of the freed blocks,
+ * whatever the huge page mode (with huge_pages=THP, the regions mapped with base
+ * pages used to be purged by huge pages, i.e. hardly at all).
+ * The resident memory must drop by at least half of the freed bytes (some of the
+ * pages may be purged as soon as they are freed, depending on purge_decay).
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <malloc.h>
+
+#define NB_BLOCKS 4096
+
+static const size_t sizes[] = {48, 1000, 4000};
+
+/* Resident anonymous memory of the process, in bytes (from the page tables: the counters of statm are approximate, and count the code) */
+static long resident_bytes(void)
+{
+    FILE *f = fopen("/proc/self/smaps_rollup", "r");
+    char line[256];
+    long resident = -1;
+
+    if (f == NULL)
+    {
+        return -1;
+    }
+    while (fgets(line, sizeof(line), f) != NULL)
+    {
+        if (sscanf(line, "Anonymous: %ld kB", &resident) == 1)
+        {
+            break;
+        }
+    }
+    fclose(f);
+    return (resident < 0) ? -1 : resident * 1024;
+}
+
+int main(void)
+{
+    static char *blocks[NB_BLOCKS];
+    size_t s;
+    size_t i;
+
+    for (s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+    {
+        size_t freed = NB_BLOCKS * sizes[s];
+        long before;
+        long after;
+
+        for (i = 0; i < NB_BLOCKS; i++)
+        {
+            blocks[i] = malloc(sizes[s]);
+            if (blocks[i] == NULL)
+            {
+                printf("malloc(%zu) failed\n", sizes[s]);
+                return EXIT_FAILURE;
+            }
+            memset(blocks[i], 0xa5, sizes[s]);
+        }
+        before = resident_bytes();
+        for (i = 0; i < NB_BLOCKS; i++)
+        {
+            free(blocks[i]);
+        }
+        malloc_trim(0);
+        after = resident_bytes();
+        if (before < 0 || after < 0)
+        {
+            printf("cannot read /proc/self/smaps_rollup\n");
+            return EXIT_FAILURE;
+        }
+        if (before - after < (long)(freed / 2))
+        {
+            printf("blocks of %zu bytes: %zu bytes freed, resident memory %ld -> %ld bytes\n", sizes[s], freed, before, after);
+            return EXIT_FAILURE;
+        }
+    }
+    printf("PASSED\n");
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,203 @@
+/*
+ * Regression: realloc keeps the contents of the blocks, and resizes them in place
+ * when their pool allows it (a fast block within its size class, a standard block
+ * shrinking or growing into the free block that follows it, a huge block shrinking),
+ * whether it stays in place, moves its pages with mremap (huge blocks) or is copied
+ * to another pool.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <malloc.h>
+
+#define KB 1024UL
+#define MB (1024UL * 1024UL)
+
+/* Fills the first size bytes of a block with a pattern depending on the position */
+static void fill(char *p, size_t size)
+{
+    size_t i;
+
+    for (i = 0; i < size; i++)
+    {
+        p[i] = (char)(i * 7 + 3);
+    }
+}
+
+/* Returns 0 if the first size bytes of the block hold the pattern */
+static int check(const char *p, size_t size)
+{
+    size_t i;
+
+    for (i = 0; i < size; i++)
+    {
+        if (p[i] != (char)(i * 7 + 3))
+        {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* Resizes a block filled with the pattern, checks its contents and refills it */
+static char *resize(char *p, size_t old_size, size_t size, int in_place)
+{
+    char *res = realloc(p, size);
+
+    if (res == NULL)
+    {
+        printf("realloc(%zu -> %zu) failed\n", old_size, size);
+        return NULL;
+    }
+    if (in_place && res != p)
+    {
+        printf("realloc(%zu -> %zu) moved the block\n", old_size, size);
+        return NULL;
+    }
+    if (check(res, (old_size < size) ? old_size : size) != 0)
+    {
+        printf("realloc(%zu -> %zu) lost the contents of the block\n", old_size, size);
+        return NULL;
+    }
+    if (malloc_usable_size(res) < size)
+    {
+        printf("realloc(%zu -> %zu): usable size %zu\n", old_size, size, malloc_usable_size(res));
+        return NULL;
+    }
+    fill(res, size);
+    return res;
+}
+
+/* A block resized up to its usable size stays in place (fast, standard and huge blocks) */
+static int test_usable_size(void)
+{
+    static const size_t sizes[] = {1, 20, 100, 1000, 5000, 100000, 3 * MB};
+    size_t s;
+
+    for (s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+    {
+        char *p = malloc(sizes[s]);
+
+        if (p == NULL)
+        {
+            printf("malloc(%zu) failed\n", sizes[s]);
+            return -1;
+        }
+        fill(p, sizes[s]);
+        p = resize(p, sizes[s], malloc_usable_size(p), 1);
+        if (p == NULL)
+        {
+            return -1;
+        }
+        free(p);
+    }
+    return 0;
+}
+
+/* A standard block (above the fast pools of all the size classes) shrinks in place, and grows into the following free block */
+static int test_standard(void)
+{
+    char *p = malloc(24 * KB);
+    char *next = malloc(24 * KB);
+    int adjacent = (next > p && next < p + 25 * KB);
+
+    if (p == NULL || next == NULL)
+    {
+        printf("malloc(%zu) failed\n", 24 * KB);
+        return -1;
+    }
+    fill(p, 24 * KB);
+    p = resize(p, 24 * KB, 18 * KB, 1);
+    if (p == NULL || (p = resize(p, 18 * KB, 24 * KB, 1)) == NULL)
+    {
+        return -1;
+    }
+    // Grows into the following block once it is freed (if it follows it)
+    free(next);
+    if ((p = resize(p, 24 * KB, 40 * KB, adjacent)) == NULL)
+    {
+        return -1;
+    }
+    free(p);
+    return 0;
+}
+
+/* A huge block shrinks in place, and grows in place or by moving its pages (mremap) */
+static int test_huge(void)
+{
+    char *p = malloc(4 * MB);
+    char *other;
+
+    if (p == NULL)
+    {
+        printf("malloc(%zu) failed\n", 4 * MB);
+        return -1;
+    }
+    fill(p, 4 * MB);
+    if ((p = resize(p, 4 * MB, 3 * MB, 1)) == NULL || (p = resize(p, 3 * MB, 8 * MB, 0)) == NULL)
+    {
+        return -1;
+    }
+    // A mapping right after the block may force the move of its pages
+    other = malloc(4 * MB);
+    if (other == NULL)
+    {
+        printf("malloc(%zu) failed\n", 4 * MB);
+        return -1;
+    }
+    if ((p = resize(p, 8 * MB, 32 * MB, 0)) == NULL || (p = resize(p, 32 * MB, 5 * MB, 1)) == NULL)
+    {
+        return -1;
+    }
+    free(other);
+    free(p);
+    return 0;
+}
+
+/* A block goes through all the pools, and back */
+static int test_pools(void)
+{
+    static const size_t sizes[] = {10, 60, 200, 1000, 5000, 50000, 3 * MB, 50000, 1000, 60, 10};
+    char *p = malloc(sizes[0]);
+    size_t s;
+
+    if (p == NULL)
+    {
+        printf("malloc(%zu) failed\n", sizes[0]);
+        return -1;
+    }
+    fill(p, sizes[0]);
+    for (s = 1; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+    {
+        if ((p = resize(p, sizes[s - 1], sizes[s], 0)) == NULL)
+        {
+            return -1;
+        }
+    }
+    free(p);
+    return 0;
+}
+
+int main(void)
+{
+    char *p;
+
+    if (test_usable_size() != 0 || test_standard() != 0 || test_huge() != 0 || test_pools() != 0)
+    {
+        return EXIT_FAILURE;
+    }
+    // realloc(NULL, size) allocates, realloc(p, 0) frees
+    p = realloc(NULL, 100);
+    if (p == NULL)
+    {
+        printf("realloc(NULL, 100) failed\n");
+        return EXIT_FAILURE;
+    }
+    if (realloc(p, 0) != NULL)
+    {
+        printf("realloc(p, 0) did not free the block\n");
+        return EXIT_FAILURE;
+    }
+    printf("PASSED\n");
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,112 @@
+/*
+ * Regression: the segments of the standard pools are given back to the OS by the purge
+ * passes only (a segment used to be unmapped as soon as it was entirely free, so that
+ * alternately allocating and freeing a block mapped and unmapped a segment each time).
+ * The mapped memory (mallinfo2().arena) must not change while blocks are allocated and
+ * freed again, and must drop once the segments stay free for a purge period
+ * (purge_decay, 1 s by default) or upon malloc_trim.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <malloc.h>
+
+#define NB_BLOCKS 64
+#define BLOCK_SIZE 30000 // Above the fast pools of all the size classes
+#define NB_ROUNDS 10000
+#define MAX_WAIT_MS 5000
+
+static char *blocks[NB_BLOCKS];
+
+static long long now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
+
+static size_t mapped_bytes(void)
+{
+    return mallinfo2().arena;
+}
+
+/* Allocates the blocks (several segments) and frees them; returns the mapped memory when they were allocated */
+static size_t alloc_free_blocks(void)
+{
+    size_t mapped;
+    int i;
+
+    for (i = 0; i < NB_BLOCKS; i++)
+    {
+        blocks[i] = malloc(BLOCK_SIZE);
+        if (blocks[i] == NULL)
+        {
+            printf("malloc(%d) failed\n", BLOCK_SIZE);
+            exit(EXIT_FAILURE);
+        }
+        memset(blocks[i], 0xa5, BLOCK_SIZE);
+    }
+    mapped = mapped_bytes();
+    for (i = 0; i < NB_BLOCKS; i++)
+    {
+        free(blocks[i]);
+    }
+    return mapped;
+}
+
+int main(void)
+{
+    size_t mapped;
+    size_t freed;
+    long long start;
+    int i;
+
+    // The empty segments stay mapped, and are reused
+    mapped = alloc_free_blocks();
+    if (mapped_bytes() != mapped)
+    {
+        printf("segments released upon free: %zu bytes mapped -> %zu\n", mapped, mapped_bytes());
+        return EXIT_FAILURE;
+    }
+    for (i = 0; i < NB_ROUNDS; i++)
+    {
+        char *p = malloc(BLOCK_SIZE);
+        if (p == NULL)
+        {
+            printf("malloc(%d) failed\n", BLOCK_SIZE);
+            return EXIT_FAILURE;
+        }
+        p[0] = 1;
+        free(p);
+    }
+    if (mapped_bytes() != mapped)
+    {
+        printf("segments mapped or released by malloc/free: %zu bytes mapped -> %zu\n", mapped, mapped_bytes());
+        return EXIT_FAILURE;
+    }
+
+    // malloc_trim releases them
+    malloc_trim(0);
+    freed = mapped - mapped_bytes();
+    if (mapped_bytes() > mapped || freed < NB_BLOCKS * BLOCK_SIZE / 2)
+    {
+        printf("malloc_trim: %zu bytes mapped -> %zu\n", mapped, mapped_bytes());
+        return EXIT_FAILURE;
+    }
+
+    // So do the purge passes run by the frees, once the segments stayed empty for a purge period
+    mapped = alloc_free_blocks();
+    start = now_ms();
+    while (mapped_bytes() + NB_BLOCKS * BLOCK_SIZE / 2 > mapped)
+    {
+        if (now_ms() - start > MAX_WAIT_MS)
+        {
+            printf("purge passes: %zu bytes mapped -> %zu after %d ms\n", mapped, mapped_bytes(), MAX_WAIT_MS);
+            return EXIT_FAILURE;
+        }
+        free(malloc(16));
+    }
+    printf("PASSED\n");
+    return EXIT_SUCCESS;
+}
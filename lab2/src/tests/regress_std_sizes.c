@@ -0,0 +1,67 @@
+/*
+ * Regression: standard and huge allocations of sizes that need a new segment,
+ * across the second-level ranges of TLSF (all of them used to fail with policy=TLSF).
+ * Each block is filled with a pattern, checked before it is freed.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NB_SIZES (sizeof(sizes) / sizeof(sizes[0]))
+
+static const size_t sizes[] = {70000, 100000, 174068, 500000, 1000, 4096, 65536, 65537,
+                               131071, 131072, 262143, 1048575, 1048576, 3000000};
+
+static int check(const unsigned char *p, size_t size, unsigned char c)
+{
+    size_t i;
+
+    for (i = 0; i < size; i++)
+    {
+        if (p[i] != c)
+        {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int main(void)
+{
+    unsigned char *blocks[NB_SIZES];
+    size_t round;
+    size_t i;
+
+    for (round = 0; round < 3; round++)
+    {
+        for (i = 0; i < NB_SIZES; i++)
+        {
+            blocks[i] = malloc(sizes[i]);
+            if (blocks[i] == NULL)
+            {
+                printf("malloc(%zu) failed\n", sizes[i]);
+                return EXIT_FAILURE;
+            }
+            memset(blocks[i], (int)(i + round), sizes[i]);
+        }
+        // Frees every other block first, so the next round reuses and splits them
+        for (i = 0; i < NB_SIZES; i++)
+        {
+            if (check(blocks[i], sizes[i], (unsigned char)(i + round)) != 0)
+            {
+                printf("block of %zu bytes overwritten\n", sizes[i]);
+                return EXIT_FAILURE;
+            }
+            if (i % 2 == 0)
+            {
+                free(blocks[i]);
+            }
+        }
+        for (i = 1; i < NB_SIZES; i += 2)
+        {
+            free(blocks[i]);
+        }
+    }
+    printf("PASSED\n");
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,261 @@
+/*
+ * Regression: the concurrent paths of the allocator keep the blocks intact.
+ * 1. Producer threads allocate blocks of mixed sizes and hand them to consumer threads,
+ *    which check and free them (frees from other threads than the allocating ones:
+ *    remote-free stacks of the fast pools, and arenas locked by a foreign thread), while
+ *    both sides also allocate and free blocks of their own (thread cache refills and flushes).
+ * 2. More threads than standard arenas allocate and free blocks concurrently (arena
+ *    trylock fallback to the other arenas).
+ * Each block holds a pattern depending on its sequence number, checked before it is freed
+ * (a block given to two threads at once, or overwritten, breaks the pattern).
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#define NB_PAIRS 4
+#define NB_TRANSFERS 10000 // per producer
+#define QUEUE_SIZE 256
+#define NB_LOCAL_SLOTS 64
+#define NB_ARENA_THREADS 24 // more than the standard arenas (8 by default)
+#define NB_ARENA_OPS 5000   // per thread
+
+/* Queue of the blocks handed from a producer to a consumer */
+typedef struct
+{
+    char *blocks[QUEUE_SIZE];
+    size_t sizes[QUEUE_SIZE];
+    uint64_t seqs[QUEUE_SIZE];
+    int head;
+    int count;
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+} queue_t;
+
+static queue_t queues[NB_PAIRS];
+static int nb_errors = 0;
+
+/* Mostly fast pool blocks, some standard ones, a few huge ones */
+static size_t random_size(unsigned int *seed)
+{
+    int r = rand_r(seed) % 1000;
+
+    if (r < 800)
+    {
+        return 1 + (size_t)rand_r(seed) % 1024;
+    }
+    if (r < 998)
+    {
+        return 1025 + (size_t)rand_r(seed) % 20000;
+    }
+    return (1 << 20) + (size_t)rand_r(seed) % (1 << 20);
+}
+
+/* Writes the pattern of a block: its sequence number and the offset every 64 bytes (before its last byte), and its last byte */
+static void fill(char *p, size_t size, uint64_t seq)
+{
+    size_t i;
+
+    for (i = 0; i + sizeof(uint64_t) < size; i += 64)
+    {
+        uint64_t v = (seq << 20) ^ i;
+        memcpy(p + i, &v, sizeof(v));
+    }
+    p[size - 1] = (char)seq;
+}
+
+/* Checks the pattern of a block, and frees it */
+static void check_free(char *p, size_t size, uint64_t seq)
+{
+    size_t i;
+
+    for (i = 0; i + sizeof(uint64_t) < size; i += 64)
+    {
+        uint64_t v;
+        memcpy(&v, p + i, sizeof(v));
+        if (v != ((seq << 20) ^ i))
+        {
+            break;
+        }
+    }
+    if (i + sizeof(uint64_t) < size || p[size - 1] != (char)seq)
+    {
+        printf("block %p of %zu bytes (sequence %lu) corrupted\n", (void *)p, size, (unsigned long)seq);
+        __atomic_add_fetch(&nb_errors, 1, __ATOMIC_RELAXED);
+    }
+    free(p);
+}
+
+static char *alloc_fill(size_t size, uint64_t seq)
+{
+    char *p = malloc(size);
+
+    if (p == NULL)
+    {
+        printf("malloc(%zu) failed\n", size);
+        exit(EXIT_FAILURE);
+    }
+    fill(p, size, seq);
+    return p;
+}
+
+/* Replaces a block of the local slots of a thread */
+static void local_op(char **slots, size_t *sizes, uint64_t *seqs, unsigned int *seed, uint64_t seq)
+{
+    int s = rand_r(seed) % NB_LOCAL_SLOTS;
+
+    if (slots[s] != NULL)
+    {
+        check_free(slots[s], sizes[s], seqs[s]);
+    }
+    sizes[s] = random_size(seed);
+    seqs[s] = seq;
+    slots[s] = alloc_fill(sizes[s], seq);
+}
+
+static void free_local_slots(char **slots, size_t *sizes, uint64_t *seqs)
+{
+    int s;
+
+    for (s = 0; s < NB_LOCAL_SLOTS; s++)
+    {
+        if (slots[s] != NULL)
+        {
+            check_free(slots[s], sizes[s], seqs[s]);
+        }
+    }
+}
+
+static void *producer(void *arg)
+{
+    int id = (int)(intptr_t)arg;
+    queue_t *q = &(queues[id]);
+    unsigned int seed = (unsigned int)id + 1;
+    char *slots[NB_LOCAL_SLOTS] = {NULL};
+    size_t sizes[NB_LOCAL_SLOTS];
+    uint64_t seqs[NB_LOCAL_SLOTS];
+    uint64_t seq = (uint64_t)id << 40;
+    int n;
+
+    for (n = 0; n < NB_TRANSFERS; n++)
+    {
+        size_t size = random_size(&seed);
+        char *p = alloc_fill(size, ++seq);
+        int tail;
+
+        pthread_mutex_lock(&(q->lock));
+        while (q->count == QUEUE_SIZE)
+        {
+            pthread_cond_wait(&(q->not_full), &(q->lock));
+        }
+        tail = (q->head + q->count) % QUEUE_SIZE;
+        q->blocks[tail] = p;
+        q->sizes[tail] = size;
+        q->seqs[tail] = seq;
+        q->count++;
+        pthread_cond_signal(&(q->not_empty));
+        pthread_mutex_unlock(&(q->lock));
+
+        local_op(slots, sizes, seqs, &seed, ++seq);
+    }
+    free_local_slots(slots, sizes, seqs);
+    return NULL;
+}
+
+static void *consumer(void *arg)
+{
+    int id = (int)(intptr_t)arg;
+    queue_t *q = &(queues[id]);
+    unsigned int seed = (unsigned int)id + 1000;
+    char *slots[NB_LOCAL_SLOTS] = {NULL};
+    size_t sizes[NB_LOCAL_SLOTS];
+    uint64_t seqs[NB_LOCAL_SLOTS];
+    uint64_t seq = ((uint64_t)id + NB_PAIRS) << 40;
+    int n;
+
+    for (n = 0; n < NB_TRANSFERS; n++)
+    {
+        char *p;
+        size_t size;
+        uint64_t block_seq;
+
+        pthread_mutex_lock(&(q->lock));
+        while (q->count == 0)
+        {
+            pthread_cond_wait(&(q->not_empty), &(q->lock));
+        }
+        p = q->blocks[q->head];
+        size = q->sizes[q->head];
+        block_seq = q->seqs[q->head];
+        q->head = (q->head + 1) % QUEUE_SIZE;
+        q->count--;
+        pthread_cond_signal(&(q->not_full));
+        pthread_mutex_unlock(&(q->lock));
+
+        // Freed by this thread, which did not allocate it
+        check_free(p, size, block_seq);
+        local_op(slots, sizes, seqs, &seed, ++seq);
+    }
+    free_local_slots(slots, sizes, seqs);
+    return NULL;
+}
+
+static void *arena_worker(void *arg)
+{
+    int id = (int)(intptr_t)arg;
+    unsigned int seed = (unsigned int)id + 2000;
+    char *slots[NB_LOCAL_SLOTS] = {NULL};
+    size_t sizes[NB_LOCAL_SLOTS];
+    uint64_t seqs[NB_LOCAL_SLOTS];
+    uint64_t seq = ((uint64_t)id + 2 * NB_PAIRS) << 40;
+    int n;
+
+    for (n = 0; n < NB_ARENA_OPS; n++)
+    {
+        local_op(slots, sizes, seqs, &seed, ++seq);
+    }
+    free_local_slots(slots, sizes, seqs);
+    return NULL;
+}
+
+int main(void)
+{
+    pthread_t threads[NB_ARENA_THREADS];
+    int i;
+
+    for (i = 0; i < NB_PAIRS; i++)
+    {
+        pthread_mutex_init(&(queues[i].lock), NULL);
+        pthread_cond_init(&(queues[i].not_empty), NULL);
+        pthread_cond_init(&(queues[i].not_full), NULL);
+    }
+    for (i = 0; i < NB_PAIRS; i++)
+    {
+        pthread_create(&(threads[2 * i]), NULL, producer, (void *)(intptr_t)i);
+        pthread_create(&(threads[2 * i + 1]), NULL, consumer, (void *)(intptr_t)i);
+    }
+    for (i = 0; i < 2 * NB_PAIRS; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+
+    for (i = 0; i < NB_ARENA_THREADS; i++)
+    {
+        pthread_create(&(threads[i]), NULL, arena_worker, (void *)(intptr_t)i);
+    }
+    for (i = 0; i < NB_ARENA_THREADS; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+
+    if (nb_errors > 0)
+    {
+        printf("%d blocks corrupted\n", nb_errors);
+        return EXIT_FAILURE;
+    }
+    printf("PASSED\n");
+    return EXIT_SUCCESS;
+}